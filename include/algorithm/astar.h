@@ -1,5 +1,8 @@
 #ifndef __ALGORITHM_ASTAR_H
 #define __ALGORITHM_ASTAR_H
+#include "algorithm/astar_parallel.h"
+#include "algorithm/astar_prune.h"
+#include "algorithm/astar_stats.h"
 #include "struct/bool.h"
 #include "struct/point.h"
 #include "struct/tile.h"
@@ -38,21 +41,70 @@ typedef struct __astar_context_struct {
   size_t comparison_count;
   size_t path_length;
   aster_cost_t path_cost;
+  bool optimal; /// the path is a shortest one, see astar_resolve_parallel
   point start_point;
   point end_point;
   tile_map map;
+  bool owns_map; /// freed by astar_free, see astar_set_owns_map
   point *queue;
   point *queue_start;
   point *queue_end;
   double estimate_cost_factor;
+  bool expand_kernel; /// relax neighbours with astar_expand, see astar_expand.h
+  astar_prune prune;  /// skips pruned tiles, see astar_prune.h
+  bool pruning;       /// prune matches the map in the running search
+  astar_prune_query prune_query;
+  struct __astar_recorder_struct *recorder; /// sees every state change
+  /// called after every iteration, see astar_set_observer
+  void (*observer)(struct __astar_context_struct *astar, void *context);
+  void *observer_context;
+#ifdef ASTAR_STATS
+  astar_stats stats;
+#endif
   astar_point_state states[];
 } *astar_context;
 
 astar_context astar_init(const tile_map map, point start, point end);
+/// Frees the context, and the map unless astar_set_owns_map said otherwise.
 void astar_free(astar_context *astar_ptr);
+/// Clears the search for a new query on the same map, keeping the
+/// allocations, the options and the recorder.
+void astar_reset(astar_context astar, point start, point end);
+
+/// Statistics of the last search, NULL when built without ASTAR_STATS.
+const astar_stats *astar_get_stats(const astar_context astar);
 
+/// Whether astar_free frees the map, true after astar_init. Contexts on a
+/// shared map leave it to one of them or to the caller.
+void astar_set_owns_map(astar_context astar, bool owns);
 bool astar_set_estimate_cost_factor(astar_context astar, double factor);
+void astar_set_expand_kernel(astar_context astar, bool enabled);
+/// Searches skip the tiles `prune` removes, NULL to search every tile.
+/// Ignored while `prune` was built for other tiles than the map holds. The
+/// prune stays owned by the caller.
+void astar_set_prune(astar_context astar, const astar_prune prune);
+
+/// Sees a running search: called with `context` after every iteration and
+/// once more when the search has ended, with the path marked. Observers read
+/// the context and must not change it.
+typedef void (*astar_observer)(const astar_context astar, void *context);
+
+/// NULL stops observing. Kept by astar_reset like the other options.
+void astar_set_observer(astar_context astar, astar_observer observer,
+                        void *context);
 astar_state astar_resolve(astar_context astar);
+/// Resolves `count` independent searches on one thread, taking turns one
+/// expansion each and prefetching the cells the next expansion of a search
+/// reads while the others run. Contexts that are not freshly initialized or
+/// reset are skipped. Results match astar_resolve; with ASTAR_STATS the
+/// expand phase is not timed, as the searches share the time.
+void astar_resolve_interleaved(astar_context *contexts, size_t count);
+/// Resolves one query on `threads` threads, all online ones for 0, with the
+/// optimal path, see astar_parallel.h. Iteration counts the expansions of
+/// all threads. Observers and recorders only see the finished search, and
+/// traces only its start and end. Sets `optimal`. `stats` may be NULL.
+astar_state astar_resolve_parallel(astar_context astar, size_t threads,
+                                   astar_parallel_stats *stats);
 void astar_print(const astar_context astar, FILE *f);
 
 typedef enum __astar_point_type {
@@ -67,4 +119,18 @@ typedef enum __astar_point_type {
 astar_point_type astar_get_point_type(const astar_context astar, size_t row,
                                       size_t col);
 
+/// One run of the path: `count` consecutive moves towards `direction`.
+typedef struct __astar_path_step {
+  direction_t direction;
+  size_t count;
+} astar_path_step;
+
+/// Both functions write the path from start to end into the caller's buffer,
+/// truncated to `capacity`, and return the full length. They walk the
+/// direction back-pointers once per call and never allocate.
+size_t astar_path_points(const astar_context astar, point *buffer,
+                         size_t capacity);
+size_t astar_path_steps(const astar_context astar, astar_path_step *buffer,
+                        size_t capacity);
+
 #endif
@@ -0,0 +1,47 @@
+#ifndef __ALGORITHM_ASTAR_CACHE_H
+#define __ALGORITHM_ASTAR_CACHE_H
+
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <stddef.h>
+
+/// Path cache in front of astar_resolve.
+///
+/// Entries are keyed on (map id, map version, estimate cost factor, start,
+/// end). Paths of searches that are optimal, such as astar_resolve_parallel
+/// stored with astar_cache_store, have every point indexed as well, so a
+/// query whose start lies on such a path towards the same end is answered
+/// with the suffix of that path. The suffix is a shortest path, which may
+/// cost less than what astar_resolve finds for the query: astar_resolve
+/// stops once the end is queued and is not optimal at any factor, so its
+/// paths only answer their own start. Memory is bounded by the total number
+/// of cached path points and the least recently used entries are evicted
+/// first. All functions are thread-safe.
+
+typedef struct __astar_cache_stats {
+  size_t hits;        /// answered by a path cached for the same endpoints
+  size_t suffix_hits; /// answered by the suffix of a longer cached path
+  size_t misses;      /// had to run astar_resolve
+  size_t evictions;   /// entries dropped to stay within capacity
+  size_t entries;     /// entries currently cached
+  size_t points;      /// path points currently cached
+} astar_cache_stats;
+
+typedef struct __astar_cache_struct *astar_cache;
+
+astar_cache astar_cache_new(size_t capacity);
+void astar_cache_free(astar_cache *cache_ptr);
+
+astar_state astar_cache_lookup(astar_cache cache, const tile_map map,
+                               point start, point end, double factor,
+                               point *buffer, size_t capacity, size_t *length,
+                               aster_cost_t *cost);
+void astar_cache_store(astar_cache cache, const astar_context astar);
+astar_state astar_cache_resolve(astar_cache cache, astar_context astar);
+
+astar_cache_stats astar_cache_get_stats(astar_cache cache);
+double astar_cache_hit_rate(astar_cache cache);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __ALGORITHM_ASTAR_CPD_H
+#define __ALGORITHM_ASTAR_CPD_H
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Compressed path database: the first move of a shortest path from every
+/// empty tile to every other, for maps that do not change.
+///
+/// Empty tiles are ranked along a Hilbert curve, so tiles close on the map
+/// are close in the table. The row of a source lists the first moves towards
+/// the targets in rank order as runs `target_rank << 4 | direction`, each
+/// holding until the next one, and neighbouring targets mostly share a first
+/// move. A query follows first moves from the start, one binary search in
+/// the row of the current tile per step, without any search.
+///
+/// Building runs a Dijkstra from every empty tile, spread over
+/// parallel_threads(), in O(n^2 log n) for n empty tiles: meant for arena
+/// maps of a few ten thousand tiles. The database is one flat image, written
+/// as is and mapped read-only by astar_cpd_open.
+
+/// Direction of runs towards targets the source cannot reach.
+#define ASTAR_CPD_UNREACHABLE 15
+#define ASTAR_CPD_DIRECTION_BITS 4
+
+typedef struct __astar_cpd_header {
+  char magic[8]; /// ASTAR_CPD_MAGIC
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t tiles_hash; /// of the map it was built for
+  uint64_t tile_count; /// empty tiles
+  uint64_t run_count;
+} astar_cpd_header;
+
+#define ASTAR_CPD_MAGIC "ASTARCPD"
+
+typedef struct __astar_cpd_struct {
+  const astar_cpd_header *header;
+  const uint32_t *ranks; /// Hilbert rank of each position, UINT32_MAX walls
+  const uint64_t *rows;  /// first run of each source rank, tile_count + 1
+  const uint32_t *runs;
+  void *image; /// header and arrays, mapped or allocated
+  size_t image_size;
+  bool mapped;
+} *astar_cpd;
+
+/// NULL for maps with 1 << 28 empty tiles or more.
+astar_cpd astar_cpd_build(const tile_map map);
+/// Maps a file written by astar_cpd_write, NULL when it is not one.
+astar_cpd astar_cpd_open(const char *path);
+void astar_cpd_free(astar_cpd *cpd_ptr);
+bool astar_cpd_write(const astar_cpd cpd, FILE *file);
+
+/// Whether `cpd` was built for the tiles `map` holds.
+bool astar_cpd_matches(const astar_cpd cpd, const tile_map map);
+
+/// First move from `from` towards `to`: a direction, DIRECTION_NONE when
+/// they are equal, or ASTAR_CPD_UNREACHABLE, also for walls and points off
+/// the map.
+direction_t astar_cpd_first_move(const astar_cpd cpd, point from, point to);
+
+/// Writes up to `capacity` points of the path from `start` to `end` to
+/// `buffer`, like astar_cache_lookup: ASTAR_SUCCEEDED with the full length
+/// and cost even when the buffer is too short, or ASTAR_FAILED.
+astar_state astar_cpd_path(const astar_cpd cpd, point start, point end,
+                           point *buffer, size_t capacity, size_t *length,
+                           aster_cost_t *cost);
+
+#endif
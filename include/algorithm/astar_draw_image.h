@@ -3,9 +3,18 @@
 
 #include "algorithm/astar.h"
 #include "image/bitmap.h"
+#include "struct/bool.h"
 #include "struct/tile.h"
+#include <stdio.h>
 
 bitmap_image tile_map_draw_image(const tile_map map);
 bitmap_image astar_draw_image(const astar_context astar);
+void astar_draw_path(bitmap_image image, const astar_context astar);
+void astar_draw_cell(bitmap_image image, const astar_context astar,
+                     size_t row, size_t col);
+
+/// Stream the same images straight to a file, one row at a time.
+bool tile_map_write_image(const tile_map map, FILE *file);
+bool astar_write_image(const astar_context astar, FILE *file);
 
 #endif
@@ -0,0 +1,48 @@
+#ifndef __ALGORITHM_ASTAR_EXPAND_H
+#define __ALGORITHM_ASTAR_EXPAND_H
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+
+/// Relaxes the 8 neighbours of an expanded cell in one pass.
+///
+/// astar_push_next_points recomputes every neighbour's cost from all of its
+/// marked neighbours. This kernel only offers the cost through the expanded
+/// cell and keeps it when it is cheaper, as textbook A* does, so searches
+/// using it may expand other cells and return other paths. Passability, the
+/// tentative paid costs and the (floored octile) estimates of all neighbours
+/// are evaluated together with AVX2 or SSE4.1 when the CPU has them, and
+/// neighbours on the map border fall back to the scalar kernel. Every ISA
+/// returns bit-identical results.
+
+#define ASTAR_EXPAND_NEIGHBOURS 8
+
+/// Neighbour i lies towards astar_expand_directions[i], in the order of
+/// direction_start().
+extern const direction_t astar_expand_directions[ASTAR_EXPAND_NEIGHBOURS];
+
+typedef struct __astar_expansion {
+  aster_cost_t paid_cost[ASTAR_EXPAND_NEIGHBOURS]; /// through the expanded cell
+  aster_cost_t predict_cost[ASTAR_EXPAND_NEIGHBOURS];
+} astar_expansion;
+
+typedef enum __astar_expand_isa {
+  ASTAR_EXPAND_SCALAR = 0,
+  ASTAR_EXPAND_SSE41,
+  ASTAR_EXPAND_AVX2,
+} astar_expand_isa;
+
+#define ASTAR_EXPAND_ISA_LENGTH 3
+
+/// Returns the mask of neighbours that are empty, not visited and either
+/// unmarked or cheaper through `pt`. Costs are only set for those.
+unsigned astar_expand(const astar_context astar, point pt,
+                      astar_expansion *out);
+
+char *astar_expand_isa_str(astar_expand_isa isa);
+astar_expand_isa astar_expand_best_isa();
+astar_expand_isa astar_expand_get_isa();
+/// Selects the kernel of every context, false when the CPU lacks `isa`.
+bool astar_expand_set_isa(astar_expand_isa isa);
+
+#endif
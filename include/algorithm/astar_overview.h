@@ -0,0 +1,36 @@
+#ifndef __ALGORITHM_ASTAR_OVERVIEW_H
+#define __ALGORITHM_ASTAR_OVERVIEW_H
+#include "algorithm/astar.h"
+#include "image/bitmap.h"
+#include "struct/tile.h"
+#include <stddef.h>
+
+/// Level-of-detail overview of a map and its search state.
+///
+/// Level 0 holds one sample per cell and every next level halves both sides,
+/// so a sample of level k summarises a 2^k x 2^k block of cells. Wall and
+/// searched samples are densities from 0 to 255, path samples are 255 when
+/// any cell of the block lies on the path. Renders pick the level closest to
+/// the requested zoom, so their cost depends on the output size only.
+
+typedef struct __astar_mip_level {
+  size_t rows;
+  size_t cols;
+  bitmap_byte *walls;    /// wall density
+  bitmap_byte *searched; /// marked or visited density
+  bitmap_byte *path;     /// path presence
+} astar_mip_level;
+
+typedef struct __astar_mip_struct {
+  size_t level_count;
+  astar_mip_level levels[];
+} *astar_mip;
+
+astar_mip astar_mip_build(const tile_map map, const astar_context astar);
+void astar_mip_free(astar_mip *mip_ptr);
+
+bitmap_image astar_mip_render(const astar_mip mip, size_t row, size_t col,
+                              size_t rows, size_t cols, size_t width,
+                              size_t height);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __ALGORITHM_ASTAR_PARALLEL_H
+#define __ALGORITHM_ASTAR_PARALLEL_H
+#include <stddef.h>
+
+/// One query searched by several threads with hash-distributed A* (HDA*).
+///
+/// Cells are grouped in blocks of ASTAR_PARALLEL_BLOCK x ASTAR_PARALLEL_BLOCK
+/// and every block is hashed to the thread that owns it. Only the owner of a
+/// cell writes its state and holds it in its own binary heap, so the states
+/// need no locks. A cell reached from the block of another thread is sent to
+/// its owner in batches of up to ASTAR_PARALLEL_BATCH cells, pushed on a
+/// lock-free stack per receiver and taken all at once.
+///
+/// The cost of the best path to the end found so far, the incumbent, is
+/// shared: cells whose estimate reaches it are dropped. The search ends when
+/// a single counter of busy threads plus batches in flight drops to zero,
+/// and then every open cell is estimated no cheaper than the incumbent. The
+/// estimate is scaled by the estimate_cost_factor of the context only when
+/// the factor is at most 1, so that it stays admissible and the path is
+/// optimal, unlike astar_resolve's. Cells may be expanded again when a
+/// cheaper route reaches them later, and searches expand more cells than a
+/// serial search with the same estimate; astar_parallel_stats tells how
+/// many. With more threads than processors, a thread running alone expands
+/// cells whose cheaper routes wait in the queues of threads that are not
+/// running, so threads then yield every ASTAR_PARALLEL_FLUSH_INTERVAL
+/// expansions.
+
+#define ASTAR_PARALLEL_BLOCK_BITS 3
+#define ASTAR_PARALLEL_BLOCK (1 << ASTAR_PARALLEL_BLOCK_BITS)
+#define ASTAR_PARALLEL_BATCH 64
+/// Expansions between two sends of the partly filled batches.
+#define ASTAR_PARALLEL_FLUSH_INTERVAL 16
+
+typedef struct __astar_parallel_stats {
+  size_t threads;
+  size_t expansions;     /// of all threads, also the iteration of the search
+  size_t reexpansions;   /// of cells expanded before with a higher cost
+  size_t busiest;        /// expansions of the busiest thread
+  size_t messages;       /// cells sent to another thread
+  size_t batches;        /// in which they were sent
+} astar_parallel_stats;
+
+struct __astar_context_struct;
+
+/// The search of astar_resolve_parallel, on a context that astar.c has
+/// prepared. Leaves the touched points in the queue and the state.
+void astar_parallel_search(struct __astar_context_struct *astar,
+                           size_t threads, astar_parallel_stats *stats);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __ALGORITHM_ASTAR_PRUNE_H
+#define __ALGORITHM_ASTAR_PRUNE_H
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Offline pruning of the tiles no shortest path needs, unless one of its
+/// endpoints lies among them.
+///
+/// Pockets are the areas cut off by a single tile (an articulation point of
+/// the 8-connected empty tiles): a shortest path between two tiles outside a
+/// pocket never enters it. Pockets nest, and each one is an interval of the
+/// depth-first preorder, so a tile is kept when the interval of its
+/// innermost pocket holds an endpoint. The depth-first pass is sequential.
+///
+/// Swamps are tiles removed one at a time while every pair of their
+/// neighbours stays as close through the other neighbours, which keeps all
+/// distances between the remaining tiles. Removals run in parallel over the
+/// nine classes of (row % 3, col % 3), whose tiles never see each other.
+/// Removed tiles are grouped in 8-connected regions and a region is kept
+/// when it holds an endpoint.
+///
+/// Searches given a prune with astar_set_prune skip the other tiles. The
+/// shortest distances between the kept tiles do not change, so optimal
+/// searches find paths of the same cost, though maybe on another route.
+/// astar_resolve's weighted estimate finds no shortest paths and its costs
+/// may differ with and without the prune, either way.
+
+typedef struct __astar_prune_tile {
+  uint32_t order;  /// depth-first preorder, ASTAR_PRUNE_NONE for walls
+  uint32_t pocket; /// innermost pocket, 0 for none
+  uint32_t swamp;  /// swamp region, 0 for kept tiles
+} astar_prune_tile;
+
+/// Preorder interval [first, end) of the tiles of a pocket.
+typedef struct __astar_prune_pocket {
+  uint32_t first;
+  uint32_t end;
+} astar_prune_pocket;
+
+#define ASTAR_PRUNE_NONE UINT32_MAX
+
+typedef struct __astar_prune_struct {
+  size_t rows;
+  size_t cols;
+  uint64_t map_id; /// map the prune was built for, see tile_map
+  size_t version;
+  size_t empty_count;
+  size_t pocket_count; /// pockets, not counting the 0 entry
+  size_t swamp_count;  /// swamp regions
+  size_t swamp_tiles;  /// empty tiles in swamps
+  size_t rounds;       /// swamp removal rounds
+  astar_prune_pocket *pockets; /// pocket_count + 1 entries
+  astar_prune_tile tiles[];
+} *astar_prune;
+
+/// What a search keeps: the preorder and swamp region of both endpoints.
+typedef struct __astar_prune_query {
+  uint32_t order[2];
+  uint32_t swamp[2];
+} astar_prune_query;
+
+/// NULL for maps with UINT32_MAX tiles or more.
+astar_prune astar_prune_new(const tile_map map);
+void astar_prune_free(astar_prune *prune_ptr);
+
+/// Whether `prune` describes the tiles `map` holds now.
+bool astar_prune_matches(const astar_prune prune, const tile_map map);
+astar_prune_query astar_prune_query_new(const astar_prune prune, point start,
+                                        point end);
+/// Empty tiles searches for `query` skip, counted in parallel.
+size_t astar_prune_count(const astar_prune prune,
+                         const astar_prune_query *query);
+
+/// Whether searches for `query` skip the empty tile at `pos`.
+static inline bool astar_prune_skip(const astar_prune prune,
+                                    const astar_prune_query *query,
+                                    size_t pos) {
+  const astar_prune_tile *tile = prune->tiles + pos;
+  if (tile->swamp && tile->swamp != query->swamp[0] &&
+      tile->swamp != query->swamp[1]) {
+    return true;
+  }
+  if (!tile->pocket) {
+    return false;
+  }
+  // both endpoints outside [first, end), compared unsigned
+  const astar_prune_pocket *pocket = prune->pockets + tile->pocket;
+  uint32_t size = pocket->end - pocket->first;
+  return query->order[0] - pocket->first >= size &&
+         query->order[1] - pocket->first >= size;
+}
+
+#endif
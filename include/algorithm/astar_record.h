@@ -0,0 +1,41 @@
+#ifndef __ALGORITHM_ASTAR_RECORD_H
+#define __ALGORITHM_ASTAR_RECORD_H
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include <stddef.h>
+
+/// Records a search as an animation.
+///
+/// The recorder keeps one persistent image of the search. astar_resolve
+/// reports every cell whose marked, visited or is_path state changed, and
+/// after each iteration only those cells are redrawn, so recording costs
+/// O(changes) per iteration. Every `frame_interval` iterations the image is
+/// written out, either as numbered bitmaps `<path>000000.bmp`, ... or
+/// appended to the single raw video file `<path>` (bgr24, bottom-up rows,
+/// width x height from astar_recorder_size).
+///
+/// The recorder stays with its context across astar_reset, which reports
+/// the cells it clears and both pairs of endpoints, so the next search is
+/// drawn on a clean image. A reset clearing every state repaints all cells.
+
+typedef enum __astar_record_format {
+  ASTAR_RECORD_BMP = 0,
+  ASTAR_RECORD_RAW,
+} astar_record_format;
+
+typedef struct __astar_recorder_struct *astar_recorder;
+
+astar_recorder astar_recorder_new(astar_context astar, const char *path,
+                                  astar_record_format format,
+                                  size_t frame_interval);
+void astar_recorder_free(astar_recorder *recorder_ptr);
+
+void astar_recorder_touch(astar_recorder recorder, size_t pos);
+bool astar_recorder_frame(astar_recorder recorder, const astar_context astar);
+bool astar_recorder_flush(astar_recorder recorder, const astar_context astar);
+
+size_t astar_recorder_frames(astar_recorder recorder);
+void astar_recorder_size(astar_recorder recorder, size_t *width,
+                         size_t *height);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __ALGORITHM_ASTAR_SCENARIO_H
+#define __ALGORITHM_ASTAR_SCENARIO_H
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Fixed list of queries on one map, so measurements can be repeated.
+
+typedef struct __astar_query {
+  point start;
+  point end;
+  double optimal_cost; /// reference cost from a scenario file, or 0
+} astar_query;
+
+typedef struct __astar_scenario_struct {
+  size_t count;
+  astar_query queries[];
+} *astar_scenario;
+
+/// Draws `count` queries between distinct empty points from the stream
+/// `seed`, fewer when the map has less than two empty tiles.
+astar_scenario astar_scenario_random(const tile_map map, size_t count,
+                                     uint64_t seed);
+/// Same with every end within `radius` rows and columns of its start, for
+/// local queries on large maps. Starts without an empty tile in reach are
+/// skipped.
+astar_scenario astar_scenario_random_near(const tile_map map, size_t count,
+                                          size_t radius, uint64_t seed);
+/// Reads up to `limit` queries of a MovingAI `.scen` file, all when 0.
+astar_scenario astar_scenario_read_movingai(const char *path, size_t limit);
+void astar_scenario_free(astar_scenario *scenario_ptr);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef __ALGORITHM_ASTAR_SERVICE_H
+#define __ALGORITHM_ASTAR_SERVICE_H
+#include "struct/bool.h"
+#include "struct/tile.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Long-running path service: one map, a pool of workers keeping warm
+/// contexts, and any number of connections.
+///
+/// Every message is a u32 byte length followed by the payload, in native
+/// byte order since both ends run on one host. A request payload is an
+/// astar_service_request. A response payload is an astar_service_response
+/// followed by `step_count` u32 runs of the path from start to end, each
+/// `count << ASTAR_SERVICE_STEP_BITS | direction`. Responses of a connection
+/// may be sent out of order and carry the id of their request.
+///
+/// A connection queues all the requests of one read at once. Once it has
+/// ASTAR_SERVICE_MAX_PENDING requests queued or being solved, it reads no
+/// more until some are answered, so a client with more requests in flight
+/// must read responses while it writes. Workers take up to `batch` queued
+/// requests per wakeup, and the responses of a batch that go to one
+/// connection are sent with one write.
+
+typedef struct __astar_service_request {
+  uint32_t id;
+  uint32_t start_row;
+  uint32_t start_col;
+  uint32_t end_row;
+  uint32_t end_col;
+} astar_service_request;
+
+typedef struct __astar_service_response {
+  uint32_t id;
+  uint32_t state;       /// astar_state, failed for endpoints that are not empty
+  uint32_t path_length; /// points from start to end, 0 without a path
+  uint32_t step_count;
+  double cost;
+  uint64_t latency_ns; /// from reading the request to the response ready
+} astar_service_response;
+
+#define ASTAR_SERVICE_STEP_BITS 4
+/// Longest message accepted, larger lengths close the connection.
+#define ASTAR_SERVICE_MAX_MESSAGE 65536
+/// Requests of one connection queued or being solved at most.
+#define ASTAR_SERVICE_MAX_PENDING 16384
+
+/// Latency histogram, 4 buckets per power of two nanoseconds.
+#define ASTAR_LATENCY_BUCKETS 256
+
+typedef struct __astar_latency {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t buckets[ASTAR_LATENCY_BUCKETS];
+} astar_latency;
+
+void astar_latency_clear(astar_latency *latency);
+void astar_latency_add(astar_latency *latency, uint64_t ns);
+void astar_latency_merge(astar_latency *into, const astar_latency *from);
+/// Upper bound of the bucket holding the `percent` percentile.
+uint64_t astar_latency_percentile(const astar_latency *latency,
+                                  double percent);
+/// Count, mean, percentiles and the non-empty buckets as [upper_ns, count].
+void astar_latency_write_json(const astar_latency *latency, FILE *file);
+
+typedef struct __astar_service_struct *astar_service;
+
+/// Copies `map`, which all workers then read, and starts `workers` threads.
+astar_service astar_service_new(const tile_map map, size_t workers,
+                                size_t batch, bool expand_kernel);
+/// Stops the workers once the queue is empty, connections must be done.
+void astar_service_free(astar_service *service_ptr);
+
+/// Answers the requests read from `in` on `out` until `in` ends, and returns
+/// once all of them are answered. Serve each connection from its own thread.
+/// False when the connection broke or sent a malformed message.
+bool astar_service_serve(astar_service service, int in, int out);
+
+/// Request counters and the latency histogram as one JSON object.
+void astar_service_write_stats(astar_service service, FILE *file);
+
+/// Transfer exactly `size` bytes, retrying short transfers and signals.
+bool astar_service_read_all(int fd, void *buffer, size_t size);
+bool astar_service_write_all(int fd, const void *buffer, size_t size);
+
+#endif
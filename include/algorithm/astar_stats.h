@@ -0,0 +1,98 @@
+#ifndef __ALGORITHM_ASTAR_STATS_H
+#define __ALGORITHM_ASTAR_STATS_H
+#include "struct/bool.h"
+#include <stddef.h>
+#include <stdio.h>
+
+// #define ASTAR_STATS
+
+/// Search statistics, collected only when built with ASTAR_STATS. Without it
+/// the context has no stats block and every hook below expands to nothing.
+
+#define ASTAR_STATS_BUCKETS 32 /// bucket k counts sizes in [2^(k-1), 2^k)
+
+typedef enum __astar_phase {
+  ASTAR_PHASE_INIT = 0, /// astar_init and astar_reset
+  ASTAR_PHASE_EXPAND,   /// astar_resolve without path extraction
+  ASTAR_PHASE_PATH,     /// path extraction
+  ASTAR_PHASE_RENDER,   /// images drawn or written from the context
+} astar_phase;
+
+#define ASTAR_PHASE_LENGTH 4
+
+typedef struct __astar_stats {
+  size_t pushes;        /// cells added to the open list
+  size_t pops;          /// cells taken from the open list
+  size_t decrease_keys; /// open cells reached again at a lower cost
+  size_t reexpansions;  /// pops of cells already expanded
+  size_t open_peak;
+  size_t open_histogram[ASTAR_STATS_BUCKETS]; /// open size at every pop
+  double phase_ms[ASTAR_PHASE_LENGTH];
+  long peak_rss_kb; /// process high-water mark when the search ended
+} astar_stats;
+
+char *astar_phase_str(astar_phase phase);
+double astar_stats_clock();
+long astar_stats_peak_rss_kb();
+void astar_stats_clear(astar_stats *stats);
+/// Writes `stats` as one JSON object, or `null` when it is NULL.
+void astar_stats_write_json(const astar_stats *stats, FILE *f);
+
+static inline void astar_stats_open_size(astar_stats *stats, size_t size) {
+  size_t bucket = size ? 64 - __builtin_clzll(size) : 0;
+  if (bucket >= ASTAR_STATS_BUCKETS) {
+    bucket = ASTAR_STATS_BUCKETS - 1;
+  }
+  stats->open_histogram[bucket]++;
+  if (size > stats->open_peak) {
+    stats->open_peak = size;
+  }
+}
+
+#ifdef ASTAR_STATS
+#define ASTAR_STATS_ENABLED 1
+#define astar_stats_reset(astar)                                               \
+  do {                                                                         \
+    astar_stats_clear(&(astar)->stats);                                        \
+  } while (false)
+#define astar_stats_count(astar, field)                                        \
+  do {                                                                         \
+    (astar)->stats.field++;                                                    \
+  } while (false)
+#define astar_stats_open(astar, size)                                          \
+  do {                                                                         \
+    astar_stats_open_size(&(astar)->stats, size);                              \
+  } while (false)
+#define astar_stats_begin(started)                                             \
+  double started = astar_stats_clock()
+#define astar_stats_end(astar, phase, started)                                 \
+  do {                                                                         \
+    (astar)->stats.phase_ms[phase] += astar_stats_clock() - (started);         \
+  } while (false)
+#define astar_stats_finish(astar)                                              \
+  do {                                                                         \
+    (astar)->stats.peak_rss_kb = astar_stats_peak_rss_kb();                    \
+  } while (false)
+#else
+#define ASTAR_STATS_ENABLED 0
+#define astar_stats_reset(astar)                                               \
+  do {                                                                         \
+  } while (false)
+#define astar_stats_count(astar, field)                                        \
+  do {                                                                         \
+  } while (false)
+#define astar_stats_open(astar, size)                                          \
+  do {                                                                         \
+  } while (false)
+#define astar_stats_begin(started)                                             \
+  do {                                                                         \
+  } while (false)
+#define astar_stats_end(astar, phase, started)                                 \
+  do {                                                                         \
+  } while (false)
+#define astar_stats_finish(astar)                                              \
+  do {                                                                         \
+  } while (false)
+#endif
+
+#endif
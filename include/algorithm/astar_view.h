@@ -0,0 +1,91 @@
+#ifndef __ALGORITHM_ASTAR_VIEW_H
+#define __ALGORITHM_ASTAR_VIEW_H
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Live terminal view of a search, redrawn in place with ANSI escapes.
+///
+/// The viewport shows `rows` x `cols` screen cells, two columns wide each,
+/// from the map cell (row, col) on. At zoom z a screen cell stands for a
+/// z x z block of map cells and shows the first of end, start, path,
+/// visited, marked found in it, else wall when walls are the majority.
+/// Walls are read once per viewport and map version. Search cells come from
+/// the queued points or the states in the viewport, whichever are fewer.
+/// Queued points outside the viewport are skipped before their state is
+/// read, so a frame never reads the state of a cell outside the viewport.
+///
+/// A draw compares the frame with the one on screen and writes only the
+/// cells that changed, a cursor move before each run of them and a colour
+/// change when the colour differs, all into one buffer written at once.
+/// Moving, zooming or resizing repaints everything on the next draw.
+
+typedef enum __astar_view_cell {
+  ASTAR_VIEW_EMPTY = 0,
+  ASTAR_VIEW_WALL,
+  ASTAR_VIEW_MARKED,
+  ASTAR_VIEW_VISITED,
+  ASTAR_VIEW_PATH,
+  ASTAR_VIEW_START,
+  ASTAR_VIEW_END,
+  ASTAR_VIEW_OUTSIDE, /// past the map edge
+  ASTAR_VIEW_CELL_COUNT,
+} astar_view_cell;
+
+/// Frame codes before any draw, different from every cell.
+#define ASTAR_VIEW_UNDRAWN 0xff
+
+typedef struct __astar_view_struct {
+  FILE *file;
+  size_t rows; /// screen cells, a status line goes below them
+  size_t cols;
+  size_t row; /// map cell at the top left
+  size_t col;
+  size_t zoom;           /// map cells per screen cell along each side
+  size_t frame_interval; /// iterations between draws of astar_view_observe
+  size_t frames;         /// draws so far
+  size_t bytes;          /// written by all draws
+  uint8_t *screen;       /// astar_view_cell on screen, rows * cols
+  uint8_t *frame;        /// frame being drawn
+  uint8_t *tiles;        /// walls and empty tiles of the viewport
+  bool tiles_valid;
+  uint64_t tiles_map_id; /// map the tiles were read from, see tile_map
+  size_t tiles_version;
+  char *out;
+  size_t out_size;
+  size_t out_capacity;
+} *astar_view;
+
+/// A view of `rows` x `cols` screen cells writing to `file`, at zoom 1 from
+/// the top left of the map.
+astar_view astar_view_new(FILE *file, size_t rows, size_t cols);
+/// Leaves the cursor below the view and restores the colours.
+void astar_view_free(astar_view *view_ptr);
+
+/// Screen cells that fit the terminal of `file`, less the status line, and
+/// false when it is not a terminal.
+bool astar_view_terminal_size(FILE *file, size_t *rows, size_t *cols);
+
+void astar_view_resize(astar_view view, size_t rows, size_t cols);
+/// Scrolls to the map cell (row, col) at the top left.
+void astar_view_move(astar_view view, size_t row, size_t col);
+/// Zoom of at least 1, keeping the map cell at the centre in place.
+void astar_view_zoom(astar_view view, size_t zoom, const tile_map map);
+/// Smallest zoom showing the whole map, from its top left.
+void astar_view_fit(astar_view view, const tile_map map);
+/// Scrolls so that `pt` is at the centre, as far as the map allows.
+void astar_view_center(astar_view view, const tile_map map, point pt);
+
+/// Draws the search on its map, or only `map` when `astar` is NULL.
+bool astar_view_draw(astar_view view, const astar_context astar,
+                     const tile_map map);
+
+/// astar_observer drawing every frame_interval iterations and once the
+/// search has ended, with a view as `context`:
+///   astar_set_observer(astar, astar_view_observe, view);
+void astar_view_observe(const astar_context astar, void *context);
+
+#endif
@@ -8,6 +8,10 @@
 #define BYTES_PER_PIXEL 3 // red + green + blue
 #define FILE_HEADER_SIZE 14
 #define INFO_HEADER_SIZE 40
+#define BITMAP_MAX_DIMENSION 0x7fffffffUL // signed 32-bit width and height
+#define BITMAP_MAX_FILE_SIZE 0xffffffffUL // unsigned 32-bit file size
+#define BITMAP_PIXELS_PER_METER 2835      // 72 dpi
+#define BITMAP_WRITE_BLOCK_SIZE (1 << 20) // bytes per fwrite
 
 typedef unsigned char bitmap_byte;
 
@@ -34,11 +38,46 @@ typedef struct __bitmap_image {
 } *bitmap_image;
 
 bitmap_image bitmap_new(size_t width, size_t height);
+bitmap_image bitmap_alloc(size_t width, size_t height); // pixels left unset
 void bitmap_free(bitmap_image *image_ptr);
 bitmap_color bitmap_get_color(bitmap_image image, size_t x, size_t y);
 void bitmap_set_color(bitmap_image image, size_t x, size_t y,
                       bitmap_color color);
+bitmap_byte *bitmap_row(bitmap_image image, size_t y);
+void bitmap_fill_span(bitmap_byte *ptr, bitmap_color color, size_t count);
 
+/// Both writers refuse images whose sizes overflow the 32-bit fields of the
+/// format: width or height above BITMAP_MAX_DIMENSION, or a file above
+/// BITMAP_MAX_FILE_SIZE bytes, about 1.4 G pixels (e.g. a 16k x 16k map
+/// drawn with 3 pixels per tile). They then print the size to stderr,
+/// write nothing and return false.
 bool bitmap_image_write(bitmap_image image, FILE *file);
 
+/// Memory-mapped bitmap file, read row by row without decoding into a
+/// bitmap_image. Supports uncompressed 1-, 8- and 24-bit files.
+typedef struct __bitmap_reader_struct {
+  size_t width;
+  size_t height;
+  size_t bits_per_pixel;
+  size_t stride;              /// bytes per row, padding included
+  bool top_down;              /// rows stored top row first
+  size_t palette_size;        /// entries of 4 bytes: blue, green, red, unused
+  const bitmap_byte *palette; /// NULL for 24-bit files
+  const bitmap_byte *pixels;
+  void *mapping;
+  size_t mapping_size;
+} *bitmap_reader;
+
+bitmap_reader bitmap_open(const char *path);
+void bitmap_close(bitmap_reader *reader_ptr);
+const bitmap_byte *bitmap_reader_row(const bitmap_reader reader, size_t y);
+
+/// Fills row `y` of the pixel array (bottom-up, blue-green-red bytes).
+typedef bool (*bitmap_row_writer)(void *context, size_t y, bitmap_byte *row);
+
+/// Writes a bitmap row by row without holding the whole image in memory,
+/// within the limits of bitmap_image_write.
+bool bitmap_stream_write(size_t width, size_t height, bitmap_row_writer writer,
+                         void *context, FILE *file);
+
 #endif
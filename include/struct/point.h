@@ -9,6 +9,7 @@ typedef unsigned char direction_t;
 #define DIRECTION_NORTH 1
 #define DIRECTION_NORTH_EAST 2
 #define DIRECTION_WEST 3
+#define DIRECTION_NONE 4
 #define DIRECTION_EAST 5
 #define DIRECTION_SOUTH_WEST 6
 #define DIRECTION_SOUTH 7
@@ -3,6 +3,7 @@
 #include "image/bitmap.h"
 #include "struct/point.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define BORDER_BLOCK "███"
@@ -18,9 +19,21 @@ typedef enum __tile_t_enum {
   TILE_INVALID
 } tile_t;
 
+/// Snapshot views read their tiles from fixed-size chunks, addressed by
+/// position like the flat layout.
+#define TILE_CHUNK_BITS 12
+#define TILE_CHUNK_SIZE ((size_t)1 << TILE_CHUNK_BITS)
+#define TILE_CHUNK_MASK (TILE_CHUNK_SIZE - 1)
+
+struct __tile_snapshot_struct;
+
 typedef struct __tile_map_struct {
   size_t rows;
   size_t cols;
+  size_t version; /// bumped on every write, keys data derived from the tiles
+  uint64_t id; /// unique in the process, shared by the views of one store
+  tile_t **chunks;    /// chunk table of a read-only snapshot view, or NULL
+  struct __tile_snapshot_struct *snapshot; /// pinned while the view lives
   tile_t tiles[];
 } *tile_map;
 
@@ -29,9 +42,21 @@ tile_t tile_from_int(int i);
 tile_t tile_from_char(char c);
 
 tile_map tile_map_new(size_t rows, size_t cols);
+/// An id no map had before in the process, see tile_map_new.
+uint64_t tile_map_new_id();
 void tile_map_free(tile_map *map_ptr);
+/// Prints the map with a border, one buffered write per row.
 void tile_map_print(const tile_map map, FILE *f);
 
+/// Bytes of a printed row of a map `cols` wide: blocks of at most
+/// sizeof(BORDER_BLOCK) - 1 bytes, borders and the newline.
+#define TILE_PRINT_LINE(cols) (((cols) + 2) * (sizeof(BORDER_BLOCK) - 1) + 1)
+/// Appends `block` at `out` and returns the end, to build printed rows.
+char *tile_print_block(char *out, const char *block);
+/// Writes the border row of a map `cols` wide, built in `line` of
+/// TILE_PRINT_LINE(cols) bytes.
+void tile_print_border(char *line, size_t cols, FILE *f);
+
 tile_t tile_map_get(const tile_map map, size_t row, size_t col);
 void tile_map_set(tile_map map, size_t row, size_t col, tile_t value);
 
@@ -41,4 +66,23 @@ void tile_map_pos_set(tile_map map, size_t pos, tile_t value);
 
 bool tile_map_contains(tile_map map, point pt);
 
+/// Tile painted with a color in map images. Colors missing from the list
+/// load as walls when dark and as empty tiles when light.
+typedef struct __tile_color {
+  bitmap_color color;
+  tile_t tile;
+} tile_color;
+
+tile_map tile_map_read_bitmap(const char *path, const tile_color *colors,
+                              size_t color_count);
+/// Writes one pixel per tile: empty white, wall black and invalid magenta.
+bool tile_map_write_bitmap(const tile_map map, FILE *file);
+
+/// Reads a MovingAI grid map: `.`, `G` and `S` are empty, anything else is a
+/// wall.
+tile_map tile_map_read_movingai(const char *path);
+/// Reads a `.map` file as above, or any other path as a bitmap written by
+/// tile_map_write_bitmap.
+tile_map tile_map_read(const char *path);
+
 #endif
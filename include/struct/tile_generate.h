@@ -0,0 +1,52 @@
+#ifndef __STRUCT_TILE_GENERATE_H
+#define __STRUCT_TILE_GENERATE_H
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/// Random maps drawn from counter-based streams (util/random.h). Rows are
+/// filled in parallel and every tile only depends on the seed and its
+/// position, so a seed gives the same map whatever the thread count.
+
+/// Independent tiles, empty with probability `empty_ratio`.
+tile_map tile_map_generate(size_t rows, size_t cols, double empty_ratio,
+                           uint64_t seed);
+/// Caves: noise smoothed by a few rounds of the 4-5 cellular automaton.
+/// Caves may be split into several regions.
+tile_map tile_map_generate_cave(size_t rows, size_t cols, uint64_t seed);
+/// Perfect maze (sidewinder): one tile wide corridors on odd rows and
+/// columns, every corridor reachable from every other.
+tile_map tile_map_generate_maze(size_t rows, size_t cols, uint64_t seed);
+/// Rectangular rooms joined in sequence by L-shaped corridors.
+tile_map tile_map_generate_rooms(size_t rows, size_t cols, size_t room_count,
+                                 uint64_t seed);
+
+/// One of the generators above by name: "random" (60% empty), "cave",
+/// "maze" or "rooms" (24 rooms). NULL for other names.
+tile_map tile_map_generate_named(const char *name, size_t rows, size_t cols,
+                                 uint64_t seed);
+
+#define TILE_EMPTY_BLOCK 256
+
+/// Number of empty tiles before every block of TILE_EMPTY_BLOCK positions,
+/// to draw uniform empty points without retries.
+typedef struct __tile_empty_index_struct {
+  size_t count; /// empty tiles in the map
+  size_t block_count;
+  size_t prefix[]; /// block_count + 1 entries
+} *tile_empty_index;
+
+tile_empty_index tile_empty_index_new(const tile_map map);
+void tile_empty_index_free(tile_empty_index *index_ptr);
+
+/// The empty tile of rank `k` in row-major order, k < index->count.
+point tile_empty_index_get(const tile_empty_index index, const tile_map map,
+                           size_t k);
+/// Draw `counter` of the stream `seed`: a uniform empty point other than
+/// `except`, or an out-of-map point when there is none.
+point tile_empty_index_sample(const tile_empty_index index,
+                              const tile_map map, uint64_t seed,
+                              uint64_t counter, const point *except);
+
+#endif
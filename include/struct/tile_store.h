@@ -0,0 +1,32 @@
+#ifndef __STRUCT_TILE_STORE_H
+#define __STRUCT_TILE_STORE_H
+#include "struct/tile.h"
+#include <stddef.h>
+
+/// Versioned tile map with chunk-level copy-on-write.
+///
+/// Searches pin the current version with tile_store_acquire, which returns a
+/// read-only tile_map view and never takes a lock. Writers stage edits with
+/// tile_store_set, copying only the chunks they touch, and make them visible
+/// with tile_store_publish without waiting for the searches still running on
+/// older versions. A version is reclaimed once it is no longer current and
+/// its last view has been freed with tile_map_free.
+///
+/// Writers are serialized among themselves. The store must outlive every
+/// view acquired from it.
+
+typedef struct __tile_snapshot_struct *tile_snapshot;
+typedef struct __tile_store_struct *tile_store;
+
+tile_store tile_store_new(const tile_map map);
+void tile_store_free(tile_store *store_ptr);
+
+tile_map tile_store_acquire(tile_store store);
+void tile_snapshot_release(tile_snapshot snapshot);
+
+void tile_store_set(tile_store store, size_t row, size_t col, tile_t value);
+size_t tile_store_publish(tile_store store);
+size_t tile_store_reclaim(tile_store store);
+size_t tile_store_version(tile_store store);
+
+#endif
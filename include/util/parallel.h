@@ -0,0 +1,15 @@
+#ifndef __UTIL_PARALLEL_H
+#define __UTIL_PARALLEL_H
+#include <stddef.h>
+
+/// Runs `task` over [begin, end) split into one contiguous range per thread.
+/// The calling thread takes the first range and returns once all are done.
+typedef void (*parallel_task)(void *context, size_t begin, size_t end);
+
+/// Threads of parallel_for: the online processors unless set, 0 detects them
+/// again. Both are capped at 256 and safe to call from any thread.
+size_t parallel_threads();
+void parallel_set_threads(size_t threads);
+void parallel_for(size_t begin, size_t end, parallel_task task, void *context);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __UTIL_RANDOM_H
+#define __UTIL_RANDOM_H
+#include <stdint.h>
+
+/// Counter-based random numbers: the n-th number of a stream is a hash of
+/// (seed, n), so any range of a stream can be drawn by any thread, in any
+/// order, with the same result. Streams are split off a seed by key.
+
+#define RANDOM_GOLDEN 0x9e3779b97f4a7c15ull
+
+/// splitmix64 finaliser.
+static inline uint64_t random_mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+/// 32 bit finaliser, cheap enough to vectorise (SSE4.1 and AVX2 have 32 bit
+/// multiplies, not 64 bit ones).
+static inline uint32_t random_mix32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  return x ^ (x >> 16);
+}
+
+/// Number `counter` of the stream `seed`.
+static inline uint64_t random_at(uint64_t seed, uint64_t counter) {
+  return random_mix64(seed + (counter + 1) * RANDOM_GOLDEN);
+}
+
+/// Seed of an independent stream, e.g. one per map row or per purpose.
+static inline uint64_t random_split(uint64_t seed, uint64_t key) {
+  return random_mix64(seed ^ random_mix64(key + RANDOM_GOLDEN));
+}
+
+/// Uniform in [0, bound) without division (Lemire), bound > 0.
+static inline uint64_t random_below(uint64_t seed, uint64_t counter,
+                                    uint64_t bound) {
+  return (uint64_t)(((unsigned __int128)random_at(seed, counter) * bound) >>
+                    64);
+}
+
+/// Uniform in [0, 1).
+static inline double random_unit(uint64_t seed, uint64_t counter) {
+  return (double)(random_at(seed, counter) >> 11) * 0x1.0p-53;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __UTIL_TRACE_H
+#define __UTIL_TRACE_H
+#include "struct/bool.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Binary trace of fixed-size events, cheap enough to leave in hot loops.
+///
+/// Every thread appends to its own ring of the last TRACE_RING_SIZE events,
+/// so writers never share a cache line or take a lock. Tracing is switched
+/// on and off at runtime; while off, a trace point costs one relaxed load.
+/// trace_dump writes all rings to a file that trace_decode turns back into
+/// text or an animation. Rings of exited threads are kept until another
+/// thread takes them over.
+
+#define TRACE_RING_BITS 16
+#define TRACE_RING_SIZE ((size_t)1 << TRACE_RING_BITS)
+#define TRACE_MAGIC "ASTRACE1"
+#define TRACE_VERSION 1
+
+typedef enum __trace_kind {
+  TRACE_NONE = 0,
+  TRACE_MAP,     /// a: rows, b: cols
+  TRACE_QUERY,   /// a: start position, b: end position
+  TRACE_STATE,   /// value: astar_state, a: iteration, b: nanoseconds
+  TRACE_ENQUEUE, /// a: position, b: open size before
+  TRACE_DEQUEUE, /// a: position, b: open size before
+  TRACE_EXPAND,  /// a: position, cell visited
+  TRACE_MARK,    /// value: direction, a: position, b: paid cost bits
+  TRACE_PATH,    /// a: position, cell on the path
+} trace_kind;
+
+#define TRACE_KIND_LENGTH 9
+
+typedef struct __trace_event {
+  uint32_t kind;
+  uint32_t value;
+  uint64_t a;
+  uint64_t b;
+} trace_event;
+
+/// Dump layout: TRACE_MAGIC, then uint32 version and event size, then for
+/// every ring a uint64 thread number and event count followed by its events,
+/// oldest first. All integers are native endian.
+
+extern atomic_bool trace_enabled;
+
+char *trace_kind_str(trace_kind kind);
+void trace_enable(bool enabled);
+void trace_write(trace_kind kind, uint32_t value, uint64_t a, uint64_t b);
+uint64_t trace_double_bits(double value);
+double trace_bits_double(uint64_t bits);
+uint64_t trace_clock_ns();
+
+/// Writes every ring to `path`, returns false when the file cannot be
+/// written. Rings written to while dumping may lose their newest events.
+bool trace_dump(const char *path);
+/// Sets where trace_fail dumps to, NULL to never dump on failure.
+void trace_set_failure_path(const char *path);
+/// Reports a failure: dumps to the failure path when tracing is on.
+void trace_fail();
+
+/// Arguments are only evaluated while tracing is on.
+#define trace_emit(kind, value, a, b)                                          \
+  do {                                                                         \
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {          \
+      trace_write(kind, value, a, b);                                          \
+    }                                                                          \
+  } while (false)
+
+#endif
@@ -1,32 +1,54 @@
 #include "algorithm/astar.h"
+#include "algorithm/astar_expand.h"
+#include "algorithm/astar_record.h"
+#include "algorithm/astar_stats.h"
 #include "struct/point.h"
 #include "struct/tile.h"
-#include "util/debug.h"
+#include "util/trace.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/resource.h>
 
 #define ASTAR_START_BLOCK "[S]"
 #define ASTAR_END_BLOCK "[E]"
 #define ASTAR_PATH_BLOCK "[+]"
 #define ASTAR_MARKED_BLOCK " - "
 #define ASTAR_VISITED_BLOCK " + "
+/// astar_reset clears only the queued points when they are fewer than one
+/// in ASTAR_SPARSE_RESET of the map, instead of every state.
+#define ASTAR_SPARSE_RESET 16
 
 void astar_enqueue(astar_context astar, const point *pt);
 point *astar_dequeue(astar_context astar);
 bool astar_queue_contains(astar_context astar, const point *pt);
 void astar_iterate(astar_context astar);
+point *astar_select_point(astar_context astar);
+void astar_expand_point(astar_context astar, point *pt);
 void astar_peek_min_cost(astar_context astar);
 astar_point_state *astar_point_ptr_by_pos(const astar_context astar, size_t row,
                                           size_t col);
 astar_point_state *astar_point_ptr(const astar_context astar, point *pt);
 int astar_push_next_points(astar_context astar, point pt);
+void astar_relax_next_points(astar_context astar, point pt);
 void aster_calculate_point(astar_context astar, point *pt);
 void astar_resolve_path(astar_context astar);
 
+static inline void astar_touch(astar_context astar, const point *pt) {
+  if (astar->recorder) {
+    astar_recorder_touch(astar->recorder,
+                         tile_map_pos(astar->map, pt->row, pt->col));
+  }
+}
+
+static inline uint64_t astar_trace_pos(const astar_context astar,
+                                       const point *pt) {
+  return pt->row * astar->map->cols + pt->col;
+}
+
 astar_context astar_init(tile_map map, point start, point end) {
+  astar_stats_begin(started);
   astar_context astar;
   size_t state_size = sizeof(astar_point_state) * map->rows * map->cols;
   astar = (astar_context)malloc(sizeof(*astar) + state_size);
@@ -35,16 +57,40 @@ astar_context astar_init(tile_map map, point start, point end) {
   astar->iteration = 0;
   astar->comparison_count = 0;
   astar->path_length = 0;
+  astar->path_cost = 0;
+  astar->optimal = false;
   astar->start_point = start;
   astar->end_point = end;
   astar->map = map;
+  astar->owns_map = true;
   astar->queue = (point *)malloc(sizeof(point) * map->rows * map->cols);
   astar->queue_start = astar->queue;
   astar->queue_end = astar->queue;
   astar->estimate_cost_factor = 1.4142;
+  astar->expand_kernel = false;
+  astar->prune = NULL;
+  astar->pruning = false;
+  astar->recorder = NULL;
+  astar->observer = NULL;
+  astar->observer_context = NULL;
+  astar_stats_reset(astar);
+  astar_stats_end(astar, ASTAR_PHASE_INIT, started);
   return astar;
 }
 
+const astar_stats *astar_get_stats(const astar_context astar) {
+#ifdef ASTAR_STATS
+  return &astar->stats;
+#else
+  (void)astar;
+  return NULL;
+#endif
+}
+
+void astar_set_owns_map(astar_context astar, bool owns) {
+  astar->owns_map = owns;
+}
+
 bool astar_set_estimate_cost_factor(astar_context astar, double factor) {
   if (factor > 0 && factor < 10) {
     astar->estimate_cost_factor = factor;
@@ -53,10 +99,32 @@ bool astar_set_estimate_cost_factor(astar_context astar, double factor) {
   return false;
 }
 
+void astar_set_expand_kernel(astar_context astar, bool enabled) {
+  astar->expand_kernel = enabled;
+}
+
+void astar_set_prune(astar_context astar, const astar_prune prune) {
+  astar->prune = prune;
+}
+
+void astar_set_observer(astar_context astar, astar_observer observer,
+                        void *context) {
+  astar->observer = observer;
+  astar->observer_context = context;
+}
+
+/// Whether the running search skips the empty tile at `pos`.
+static inline bool astar_pruned(const astar_context astar, size_t pos) {
+  return astar->pruning &&
+         astar_prune_skip(astar->prune, &astar->prune_query, pos);
+}
+
 void astar_free(astar_context *astar_ptr) {
-  if (astar_ptr) {
+  if (astar_ptr && *astar_ptr) {
     astar_context astar = *astar_ptr;
-    tile_map_free(&astar->map);
+    if (astar->owns_map) {
+      tile_map_free(&astar->map);
+    }
     if (astar->queue) {
       free(astar->queue);
       astar->queue = NULL;
@@ -66,6 +134,42 @@ void astar_free(astar_context *astar_ptr) {
   }
 }
 
+void astar_reset(astar_context astar, point start, point end) {
+  astar_stats_begin(started);
+  size_t size = astar->map->rows * astar->map->cols;
+  size_t queued = astar->queue_end - astar->queue;
+  // the recorder redraws the cleared cells and the old and new endpoints
+  astar_touch(astar, &astar->start_point);
+  astar_touch(astar, &astar->end_point);
+  if (queued < size / ASTAR_SPARSE_RESET) {
+    // every state written by the last search is of a point once queued
+    for (point *pt = astar->queue; pt < astar->queue_end; pt++) {
+      astar_touch(astar, pt);
+      astar->states[tile_map_pos(astar->map, pt->row, pt->col)] =
+          (astar_point_state){0};
+    }
+  } else {
+    for (size_t pos = 0; astar->recorder && pos < size; pos++) {
+      astar_recorder_touch(astar->recorder, pos);
+    }
+    memset(astar->states, 0, sizeof(astar_point_state) * size);
+  }
+  astar->state = ASTAR_INIT;
+  astar->iteration = 0;
+  astar->comparison_count = 0;
+  astar->path_length = 0;
+  astar->path_cost = 0;
+  astar->optimal = false;
+  astar->start_point = start;
+  astar->end_point = end;
+  astar_touch(astar, &astar->start_point);
+  astar_touch(astar, &astar->end_point);
+  astar->queue_start = astar->queue;
+  astar->queue_end = astar->queue;
+  astar_stats_reset(astar);
+  astar_stats_end(astar, ASTAR_PHASE_INIT, started);
+}
+
 astar_point_type astar_get_point_type(const astar_context astar, size_t row,
                                       size_t col) {
   point pt = {row, col};
@@ -91,97 +195,241 @@ astar_point_type astar_get_point_type(const astar_context astar, size_t row,
   return ASTAR_ORIGINAL;
 }
 
+/// Block of the cell at `pos` for astar_print, reading its state directly.
+static const char *astar_print_block(const astar_context astar, size_t row,
+                                     size_t col, size_t pos) {
+  if (row == astar->end_point.row && col == astar->end_point.col) {
+    return ASTAR_END_BLOCK;
+  }
+  if (row == astar->start_point.row && col == astar->start_point.col) {
+    return ASTAR_START_BLOCK;
+  }
+  const astar_point_state *state = astar->states + pos;
+  if (state->is_path) {
+    return ASTAR_PATH_BLOCK;
+  }
+  if (state->visited) {
+    return ASTAR_VISITED_BLOCK;
+  }
+  if (state->marked) {
+    return ASTAR_MARKED_BLOCK;
+  }
+  return tile_str(tile_map_pos_get(astar->map, pos));
+}
+
 void astar_print(const astar_context astar, FILE *f) {
   if (!f) {
     f = stdout;
   }
-  fprintf(f, "\n");
-  fprintf(f, BORDER_BLOCK);
-  for (size_t c = 0; c < astar->map->cols; c++) {
-    fprintf(f, BORDER_BLOCK);
-  }
-  fprintf(f, BORDER_BLOCK);
-  fprintf(f, "\n");
-  for (size_t r = 0; r < astar->map->rows; r++) {
-    fprintf(f, BORDER_BLOCK);
-    for (size_t c = 0; c < astar->map->cols; c++) {
-      astar_point_type point_type = astar_get_point_type(astar, r, c);
-      switch (point_type) {
-      case ASTAR_ORIGINAL:
-        fprintf(f, "%s", tile_str(tile_map_get(astar->map, r, c)));
-        break;
-      case ASTAR_START_POINT:
-        fprintf(f, ASTAR_START_BLOCK);
-        break;
-      case ASTAR_END_POINT:
-        fprintf(f, ASTAR_END_BLOCK);
-        break;
-      case ASTAR_PATH:
-        fprintf(f, ASTAR_PATH_BLOCK);
-        // fprintf(f, " %s ", direction_str(astar_point_ptr(astar,
-        // &curr)->direction));
-        break;
-      case ASTAR_MARKED:
-        fprintf(f, ASTAR_MARKED_BLOCK);
-        break;
-        break;
-      case ASTAR_VISITED:
-        fprintf(f, ASTAR_VISITED_BLOCK);
-      }
+  tile_map map = astar->map;
+  char *line = (char *)malloc(TILE_PRINT_LINE(map->cols));
+  fputc('\n', f);
+  tile_print_border(line, map->cols, f);
+  for (size_t r = 0; r < map->rows; r++) {
+    char *out = tile_print_block(line, BORDER_BLOCK);
+    for (size_t c = 0; c < map->cols; c++) {
+      out = tile_print_block(
+          out, astar_print_block(astar, r, c, r * map->cols + c));
     }
-    fprintf(f, BORDER_BLOCK);
-    fprintf(f, "\n");
-  }
-  fprintf(f, BORDER_BLOCK);
-  for (size_t c = 0; c < astar->map->cols; c++) {
-    fprintf(f, BORDER_BLOCK);
+    out = tile_print_block(out, BORDER_BLOCK);
+    *out++ = '\n';
+    fwrite(line, 1, out - line, f);
   }
-  fprintf(f, BORDER_BLOCK);
-  fprintf(f, "\n");
+  tile_print_border(line, map->cols, f);
+  free(line);
   fprintf(f, "astar iteration: %zu %s\n", astar->iteration,
           astar_state_str(astar->state));
 }
 
+/// Starts a search, see astar_resolve and astar_resolve_parallel.
+static void astar_resolve_prepare(astar_context astar) {
+  astar->state = ASTAR_RUNNING;
+  trace_emit(TRACE_MAP, 0, astar->map->rows, astar->map->cols);
+  trace_emit(TRACE_QUERY, 0, astar_trace_pos(astar, &astar->start_point),
+             astar_trace_pos(astar, &astar->end_point));
+  trace_emit(TRACE_STATE, astar->state, 0, trace_clock_ns());
+  astar->pruning = astar_prune_matches(astar->prune, astar->map);
+  if (astar->pruning) {
+    astar->prune_query = astar_prune_query_new(
+        astar->prune, astar->start_point, astar->end_point);
+  }
+}
+
+/// Queues the start point, see astar_resolve.
+static void astar_resolve_begin(astar_context astar) {
+  astar_resolve_prepare(astar);
+  aster_calculate_point(astar, &astar->start_point);
+  astar_enqueue(astar, &astar->start_point);
+}
+
+/// Extracts the path of a finished search, see astar_resolve.
+static void astar_resolve_end(astar_context astar) {
+  if (astar->state == ASTAR_SUCCEEDED) {
+    astar_stats_begin(path_started);
+    astar_resolve_path(astar);
+    astar_stats_end(astar, ASTAR_PHASE_PATH, path_started);
+  }
+  astar_stats_finish(astar);
+  if (astar->recorder) {
+    astar_recorder_flush(astar->recorder, astar);
+  }
+  if (astar->observer) {
+    astar->observer(astar, astar->observer_context);
+  }
+  trace_emit(TRACE_STATE, astar->state, astar->iteration, trace_clock_ns());
+  if (astar->state == ASTAR_FAILED) {
+    trace_fail();
+  }
+}
+
 astar_state astar_resolve(astar_context astar) {
   if (astar->state != ASTAR_INIT) {
     return astar->state;
   }
-  debugf("\n===================\n");
-  debugf("astar start running\n");
-  astar->state = ASTAR_RUNNING;
-  aster_calculate_point(astar, &astar->start_point);
-  astar_enqueue(astar, &astar->start_point);
+  astar_stats_begin(started);
+  astar_resolve_begin(astar);
   while (astar->state == ASTAR_RUNNING) {
     astar_iterate(astar);
-    // astar_print(astar, stderr);
+    if (astar->recorder) {
+      astar_recorder_frame(astar->recorder, astar);
+    }
+    if (astar->observer) {
+      astar->observer(astar, astar->observer_context);
+    }
   }
-  debugf("astar stop: %s\n", astar_state_str(astar->state));
+  astar_stats_end(astar, ASTAR_PHASE_EXPAND, started);
+  astar_resolve_end(astar);
   return astar->state;
 }
 
-void astar_iterate(astar_context astar) {
+astar_state astar_resolve_parallel(astar_context astar, size_t threads,
+                                   astar_parallel_stats *stats) {
+  if (astar->state != ASTAR_INIT) {
+    return astar->state;
+  }
+  astar_stats_begin(started);
+  astar_resolve_prepare(astar);
+  astar_parallel_search(astar, threads, stats);
+  astar->optimal = true;
+  for (point *pt = astar->queue; pt < astar->queue_end; pt++) {
+    astar_touch(astar, pt);
+  }
+  astar_stats_end(astar, ASTAR_PHASE_EXPAND, started);
+  astar_resolve_end(astar);
+  return astar->state;
+}
+
+/// Fetches the states and tiles that expanding `pt` reads: the neighbours
+/// and, for astar_push_next_points, their own neighbours.
+static void astar_prefetch(const astar_context astar, const point *pt) {
+  tile_map map = astar->map;
+  size_t first = pt->row > 1 ? pt->row - 2 : 0;
+  size_t last = pt->row + 2 < map->rows ? pt->row + 2 : map->rows - 1;
+  size_t left = pt->col > 1 ? pt->col - 2 : 0;
+  size_t right = pt->col + 2 < map->cols ? pt->col + 2 : map->cols - 1;
+  for (size_t row = first; row <= last; row++) {
+    size_t pos = row * map->cols;
+    // five states span at most three cache lines
+    __builtin_prefetch(astar->states + pos + left, 1);
+    __builtin_prefetch(astar->states + pos + pt->col, 1);
+    __builtin_prefetch(astar->states + pos + right, 1);
+    if (!map->chunks) {
+      __builtin_prefetch(map->tiles + pos + left, 0);
+      __builtin_prefetch(map->tiles + pos + right, 0);
+    }
+  }
+}
+
+void astar_resolve_interleaved(astar_context *contexts, size_t count) {
+  point **selected = (point **)malloc(sizeof(point *) * count);
+  size_t running = 0;
+  for (size_t i = 0; i < count; i++) {
+    selected[i] = NULL;
+    if (contexts[i]->state == ASTAR_INIT) {
+      astar_resolve_begin(contexts[i]);
+      running++;
+    }
+  }
+  // every round expands the cell each search selected in the round before,
+  // then selects and prefetches the next one, so that the other searches
+  // run while the prefetches are in flight
+  while (running) {
+    running = 0;
+    for (size_t i = 0; i < count; i++) {
+      astar_context astar = contexts[i];
+      if (astar->state != ASTAR_RUNNING) {
+        continue;
+      }
+      if (selected[i]) {
+        astar_expand_point(astar, selected[i]);
+        if (astar->recorder) {
+          astar_recorder_frame(astar->recorder, astar);
+        }
+        if (astar->observer) {
+          astar->observer(astar, astar->observer_context);
+        }
+        selected[i] = NULL;
+      }
+      if (astar->state == ASTAR_RUNNING) {
+        selected[i] = astar_select_point(astar);
+      }
+      if (astar->state != ASTAR_RUNNING) {
+        astar_resolve_end(astar);
+        continue;
+      }
+      astar_prefetch(astar, selected[i]);
+      running++;
+    }
+  }
+  free(selected);
+}
+
+point *astar_select_point(astar_context astar) {
   astar->iteration++;
-  debugf("\n-------------------\n");
-  debugf("astar start iteration %zu start\n", astar->iteration);
+  astar_stats_open(astar, astar->queue_end - astar->queue_start);
   astar_peek_min_cost(astar);
   point *pt = astar_dequeue(astar);
   if (!pt) {
     astar->state = ASTAR_FAILED;
-    debugf("astar start iteration %zu failed\n", astar->iteration);
+  }
+  return pt;
+}
+
+void astar_expand_point(astar_context astar, point *pt) {
+  astar_point_state *pt_state = astar_point_ptr(astar, pt);
+  if (ASTAR_STATS_ENABLED && pt_state->visited) {
+    astar_stats_count(astar, reexpansions);
+  }
+  pt_state->visited = true;
+  trace_emit(TRACE_EXPAND, 0, astar_trace_pos(astar, pt), 0);
+  astar_touch(astar, pt);
+  if (astar->expand_kernel) {
+    astar_relax_next_points(astar, *pt);
+    // marked and not visited cells are exactly the queued ones
+    if (tile_map_contains(astar->map, astar->end_point) &&
+        astar_point_ptr(astar, &astar->end_point)->marked) {
+      astar->state = ASTAR_SUCCEEDED;
+    }
     return;
   }
-  astar_point_ptr(astar, pt)->visited = true;
   astar_push_next_points(astar, *pt);
   if (astar_queue_contains(astar, &astar->end_point)) {
-    debugf("astar reach end point\n");
-    astar_resolve_path(astar);
+    // the path is extracted by astar_resolve, outside the expand phase
     astar->state = ASTAR_SUCCEEDED;
   }
-  debugf("astar start iteration %zu end\n", astar->iteration);
+}
+
+void astar_iterate(astar_context astar) {
+  point *pt = astar_select_point(astar);
+  if (pt) {
+    astar_expand_point(astar, pt);
+  }
 }
 
 inline void astar_enqueue(astar_context astar, const point *pt) {
-  debugf("astar enqueue (%zu, %zu)\n", pt->row, pt->col);
+  trace_emit(TRACE_ENQUEUE, 0, astar_trace_pos(astar, pt),
+             astar->queue_end - astar->queue_start);
+  astar_stats_count(astar, pushes);
   *astar->queue_end++ = *pt;
 }
 
@@ -190,8 +438,9 @@ inline point *astar_dequeue(astar_context astar) {
       astar->queue_start >= astar->queue_end) {
     return NULL;
   }
-  debugf("astar dequeue (%zu, %zu)\n", astar->queue_start->row,
-         astar->queue_start->col);
+  trace_emit(TRACE_DEQUEUE, 0, astar_trace_pos(astar, astar->queue_start),
+             astar->queue_end - astar->queue_start);
+  astar_stats_count(astar, pops);
   return astar->queue_start++;
 }
 
@@ -247,6 +496,7 @@ inline astar_point_state *astar_point_ptr(astar_context astar, point *pt) {
 
 void aster_calculate_point(astar_context astar, point *pt) {
   astar_point_state *pt_state = astar_point_ptr(astar, pt);
+  aster_cost_t old_cost = pt_state->paid_cost;
   bool init = false;
   for (direction_t *d = direction_start(); d != direction_end();
        d = direction_next(d)) {
@@ -269,18 +519,22 @@ void aster_calculate_point(astar_context astar, point *pt) {
       pt_state->paid_cost +
       (aster_cost_t)(astar_estimate_cost(pt, &astar->end_point) *
                      astar->estimate_cost_factor);
-  pt_state->marked = true;
-  debugf(
-      "astar calculate point %s (%zu, %zu) paid cost: %ld, predict cost: %ld\n",
-      direction_str(pt_state->direction), pt->row, pt->col, pt_state->paid_cost,
-      pt_state->predict_cost);
+  if (!pt_state->marked) {
+    pt_state->marked = true;
+    astar_touch(astar, pt);
+  } else if (ASTAR_STATS_ENABLED && pt_state->paid_cost < old_cost) {
+    astar_stats_count(astar, decrease_keys);
+  }
+  trace_emit(TRACE_MARK, pt_state->direction, astar_trace_pos(astar, pt),
+             trace_double_bits(pt_state->paid_cost));
 }
 
 int astar_push_next_point(astar_context astar, point pt) {
   if (!tile_map_contains(astar->map, pt)) {
     return 0;
   }
-  if (tile_map_get(astar->map, pt.row, pt.col) != TILE_EMPTY) {
+  if (tile_map_get(astar->map, pt.row, pt.col) != TILE_EMPTY ||
+      astar_pruned(astar, tile_map_pos(astar->map, pt.row, pt.col))) {
     return 0;
   }
   if (astar_point_ptr(astar, &pt)->visited) {
@@ -302,6 +556,31 @@ int astar_push_next_points(astar_context astar, point pt) {
   return count;
 }
 
+void astar_relax_next_points(astar_context astar, point pt) {
+  astar_expansion expansion;
+  unsigned improved = astar_expand(astar, pt, &expansion);
+  for (; improved; improved &= improved - 1) {
+    unsigned i = __builtin_ctz(improved);
+    point next = point_move(pt, astar_expand_directions[i]);
+    if (astar_pruned(astar, tile_map_pos(astar->map, next.row, next.col))) {
+      continue;
+    }
+    astar_point_state *next_state = astar_point_ptr(astar, &next);
+    if (!next_state->marked) {
+      astar_enqueue(astar, &next);
+      next_state->marked = true;
+      astar_touch(astar, &next);
+    } else {
+      astar_stats_count(astar, decrease_keys);
+    }
+    next_state->direction = astar_expand_directions[i];
+    next_state->paid_cost = expansion.paid_cost[i];
+    next_state->predict_cost = expansion.predict_cost[i];
+    trace_emit(TRACE_MARK, next_state->direction, astar_trace_pos(astar, &next),
+               trace_double_bits(next_state->paid_cost));
+  }
+}
+
 inline aster_cost_t direction_cost(direction_t d) {
   return d % 2 == 1 ? ASTAR_PARALLEL_COST : ASTAR_DIAGONAL_COST;
 }
@@ -318,6 +597,63 @@ inline aster_cost_t astar_estimate_cost(point *a, point *b) {
   return direct_cost;
 }
 
+size_t astar_path_points(const astar_context astar, point *buffer,
+                         size_t capacity) {
+  if (astar->state != ASTAR_SUCCEEDED) {
+    return 0;
+  }
+  size_t length = astar->path_length;
+  point pt = astar->end_point;
+  for (size_t i = length; i-- > 0;) {
+    if (i < capacity) {
+      buffer[i] = pt;
+    }
+    pt = point_move(pt,
+                    direction_reverse(astar_point_ptr(astar, &pt)->direction));
+  }
+  return length;
+}
+
+size_t astar_path_steps(const astar_context astar, astar_path_step *buffer,
+                        size_t capacity) {
+  if (astar->state != ASTAR_SUCCEEDED || astar->path_length < 2) {
+    return 0;
+  }
+  // the walk goes from end to start, so count the runs first to know where
+  // the last one lands in the buffer
+  size_t runs = 0;
+  direction_t last = DIRECTION_NONE;
+  point pt = astar->end_point;
+  for (size_t i = 1; i < astar->path_length; i++) {
+    direction_t d = astar_point_ptr(astar, &pt)->direction;
+    if (d != last) {
+      runs++;
+      last = d;
+    }
+    pt = point_move(pt, direction_reverse(d));
+  }
+
+  size_t run = runs;
+  last = DIRECTION_NONE;
+  pt = astar->end_point;
+  for (size_t i = 1; i < astar->path_length; i++) {
+    direction_t d = astar_point_ptr(astar, &pt)->direction;
+    if (d != last) {
+      run--;
+      last = d;
+      if (run < capacity) {
+        buffer[run].direction = d;
+        buffer[run].count = 0;
+      }
+    }
+    if (run < capacity) {
+      buffer[run].count++;
+    }
+    pt = point_move(pt, direction_reverse(d));
+  }
+  return runs;
+}
+
 char *astar_state_str(astar_state s) {
   static char *strs[ASTAR_STATE_LENGTH] = {"INIT", "RUNNING", "SUCCEEDED",
                                            "FAILED"};
@@ -333,11 +669,14 @@ void astar_resolve_path(astar_context astar) {
        !point_equal(pt, astar->start_point) && limit-- > 0;
        pt = point_move(
            pt, direction_reverse(astar_point_ptr(astar, &pt)->direction))) {
-    debugf("astar mark path at (%zu, %zu)\n", pt.row, pt.col);
+    trace_emit(TRACE_PATH, 0, astar_trace_pos(astar, &pt), 0);
     astar_point_ptr(astar, &pt)->is_path = true;
+    astar_touch(astar, &pt);
     astar->path_length++;
   }
+  trace_emit(TRACE_PATH, 0, astar_trace_pos(astar, &astar->start_point), 0);
   astar_point_ptr(astar, &astar->start_point)->is_path = true;
+  astar_touch(astar, &astar->start_point);
   astar->path_length++;
   astar->path_cost = astar_point_ptr(astar, &astar->end_point)->paid_cost;
 }
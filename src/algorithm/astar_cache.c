@@ -0,0 +1,372 @@
+#include "algorithm/astar_cache.h"
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/debug.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASTAR_CACHE_MIN_BUCKETS 64
+
+struct __astar_cache_entry;
+
+typedef struct __astar_cache_node {
+  struct __astar_cache_node *next; /// next node in the same bucket
+  struct __astar_cache_entry *entry;
+  size_t offset; /// index of the indexed point in entry->points
+} astar_cache_node;
+
+typedef struct __astar_cache_entry {
+  struct __astar_cache_entry *prev; /// more recently used
+  struct __astar_cache_entry *next; /// less recently used
+  uint64_t map; /// id, see tile_map
+  size_t version;
+  double factor;
+  point start;
+  point end;
+  astar_state state;
+  bool optimal;            /// of a search finding shortest paths
+  size_t length;           /// number of points, 0 for failed searches
+  point *points;           /// path from start to end
+  aster_cost_t *costs;     /// cost paid from start to each point
+  astar_cache_node *nodes; /// one per point, or one for the start only
+  size_t node_count;
+  size_t size; /// points counted against the capacity, at least 1
+} astar_cache_entry;
+
+struct __astar_cache_struct {
+  pthread_mutex_t lock;
+  size_t capacity; /// max cached nodes
+  size_t bucket_mask;
+  astar_cache_node **buckets;
+  astar_cache_entry *head; /// most recently used
+  astar_cache_entry *tail; /// least recently used
+  astar_cache_stats stats;
+};
+
+static size_t astar_cache_hash(uint64_t map, size_t version, double factor,
+                               point pt, point end);
+static astar_cache_node *astar_cache_find(astar_cache cache, uint64_t map,
+                                          size_t version, double factor,
+                                          point start, point end);
+static void astar_cache_hit(astar_cache cache, astar_cache_node *node);
+static void astar_cache_touch(astar_cache cache, astar_cache_entry *entry);
+static void astar_cache_unlink(astar_cache cache, astar_cache_entry *entry);
+static void astar_cache_evict(astar_cache cache, astar_cache_entry *entry);
+static astar_cache_entry *astar_cache_entry_new(const astar_context astar);
+
+astar_cache astar_cache_new(size_t capacity) {
+  astar_cache cache = (astar_cache)malloc(sizeof(*cache));
+  size_t buckets = ASTAR_CACHE_MIN_BUCKETS;
+  while (buckets < capacity) {
+    buckets <<= 1;
+  }
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->capacity = capacity;
+  cache->bucket_mask = buckets - 1;
+  cache->buckets =
+      (astar_cache_node **)calloc(buckets, sizeof(astar_cache_node *));
+  cache->head = NULL;
+  cache->tail = NULL;
+  memset(&cache->stats, 0, sizeof(cache->stats));
+  return cache;
+}
+
+void astar_cache_free(astar_cache *cache_ptr) {
+  if (cache_ptr && *cache_ptr) {
+    astar_cache cache = *cache_ptr;
+    while (cache->tail) {
+      astar_cache_evict(cache, cache->tail);
+    }
+    free(cache->buckets);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+    *cache_ptr = NULL;
+  }
+}
+
+astar_state astar_cache_lookup(astar_cache cache, const tile_map map,
+                               point start, point end, double factor,
+                               point *buffer, size_t capacity, size_t *length,
+                               aster_cost_t *cost) {
+  pthread_mutex_lock(&cache->lock);
+  astar_cache_node *node =
+      astar_cache_find(cache, map->id, map->version, factor, start, end);
+  if (!node) {
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return ASTAR_INIT;
+  }
+  astar_cache_hit(cache, node);
+  astar_cache_entry *entry = node->entry;
+  size_t path_length = entry->length - node->offset;
+  if (entry->state == ASTAR_SUCCEEDED) {
+    size_t copy_length = path_length < capacity ? path_length : capacity;
+    if (buffer && copy_length) {
+      memcpy(buffer, entry->points + node->offset,
+             sizeof(point) * copy_length);
+    }
+  } else {
+    path_length = 0;
+  }
+  if (length) {
+    *length = path_length;
+  }
+  if (cost) {
+    *cost = path_length ? entry->costs[entry->length - 1] -
+                              entry->costs[node->offset]
+                        : 0;
+  }
+  astar_state state = entry->state;
+  pthread_mutex_unlock(&cache->lock);
+  return state;
+}
+
+void astar_cache_store(astar_cache cache, const astar_context astar) {
+  if (astar->state != ASTAR_SUCCEEDED && astar->state != ASTAR_FAILED) {
+    return;
+  }
+  astar_cache_entry *entry = astar_cache_entry_new(astar);
+  if (entry->size > cache->capacity) {
+    debugf("astar cache skip path of %zu points\n", entry->length);
+    free(entry);
+    return;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  if (astar_cache_find(cache, entry->map, entry->version, entry->factor,
+                       entry->start, entry->end)) {
+    // another thread stored the same query meanwhile
+    pthread_mutex_unlock(&cache->lock);
+    free(entry);
+    return;
+  }
+  while (cache->tail &&
+         cache->stats.points + entry->size > cache->capacity) {
+    astar_cache_evict(cache, cache->tail);
+    cache->stats.evictions++;
+  }
+  for (size_t i = 0; i < entry->node_count; i++) {
+    astar_cache_node *node = entry->nodes + i;
+    point pt = entry->length ? entry->points[i] : entry->start;
+    size_t bucket = astar_cache_hash(entry->map, entry->version, entry->factor,
+                                     pt, entry->end) &
+                    cache->bucket_mask;
+    node->next = cache->buckets[bucket];
+    cache->buckets[bucket] = node;
+  }
+  entry->prev = NULL;
+  entry->next = NULL;
+  astar_cache_touch(cache, entry);
+  cache->stats.entries++;
+  cache->stats.points += entry->size;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+astar_state astar_cache_resolve(astar_cache cache, astar_context astar) {
+  if (astar->state != ASTAR_INIT) {
+    return astar->state;
+  }
+  pthread_mutex_lock(&cache->lock);
+  astar_cache_node *node = astar_cache_find(
+      cache, astar->map->id, astar->map->version,
+      astar->estimate_cost_factor, astar->start_point, astar->end_point);
+  if (!node) {
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+    astar_resolve(astar);
+    astar_cache_store(cache, astar);
+    return astar->state;
+  }
+  astar_cache_hit(cache, node);
+
+  astar_cache_entry *entry = node->entry;
+  astar->state = entry->state;
+  astar->optimal = entry->optimal;
+  if (entry->state == ASTAR_SUCCEEDED) {
+    aster_cost_t base_cost = entry->costs[node->offset];
+    for (size_t i = node->offset; i < entry->length; i++) {
+      point pt = entry->points[i];
+      // every written state is of a point once queued, see astar_reset
+      *astar->queue_end++ = pt;
+      astar_point_state *pt_state =
+          astar->states + tile_map_pos(astar->map, pt.row, pt.col);
+      pt_state->marked = true;
+      pt_state->is_path = true;
+      pt_state->paid_cost = entry->costs[i] - base_cost;
+      pt_state->predict_cost = pt_state->paid_cost;
+      if (i > node->offset) {
+        pt_state->direction = point_move_direction(entry->points[i - 1], pt);
+      }
+    }
+    astar->path_length = entry->length - node->offset;
+    astar->path_cost = entry->costs[entry->length - 1] - base_cost;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return astar->state;
+}
+
+astar_cache_stats astar_cache_get_stats(astar_cache cache) {
+  pthread_mutex_lock(&cache->lock);
+  astar_cache_stats stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+  return stats;
+}
+
+double astar_cache_hit_rate(astar_cache cache) {
+  astar_cache_stats stats = astar_cache_get_stats(cache);
+  size_t hits = stats.hits + stats.suffix_hits;
+  size_t total = hits + stats.misses;
+  return total ? (double)hits / total : 0;
+}
+
+static inline uint64_t astar_cache_mix(uint64_t h, uint64_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h;
+}
+
+static size_t astar_cache_hash(uint64_t map, size_t version, double factor,
+                               point pt, point end) {
+  uint64_t factor_bits;
+  memcpy(&factor_bits, &factor, sizeof(factor_bits));
+  uint64_t h = map;
+  h = astar_cache_mix(h, version);
+  h = astar_cache_mix(h, factor_bits);
+  h = astar_cache_mix(h, pt.row);
+  h = astar_cache_mix(h, pt.col);
+  h = astar_cache_mix(h, end.row);
+  h = astar_cache_mix(h, end.col);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (size_t)h;
+}
+
+/// Finds a node answering the query, the caller holds the lock.
+static astar_cache_node *astar_cache_find(astar_cache cache, uint64_t map,
+                                          size_t version, double factor,
+                                          point start, point end) {
+  size_t bucket =
+      astar_cache_hash(map, version, factor, start, end) & cache->bucket_mask;
+  for (astar_cache_node *node = cache->buckets[bucket]; node;
+       node = node->next) {
+    astar_cache_entry *entry = node->entry;
+    if (entry->map != map || entry->version != version ||
+        entry->factor != factor || !point_equal(entry->end, end)) {
+      continue;
+    }
+    point pt = entry->length ? entry->points[node->offset] : entry->start;
+    if (point_equal(pt, start)) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+static void astar_cache_hit(astar_cache cache, astar_cache_node *node) {
+  if (node->offset == 0) {
+    cache->stats.hits++;
+  } else {
+    cache->stats.suffix_hits++;
+  }
+  astar_cache_touch(cache, node->entry);
+}
+
+static void astar_cache_touch(astar_cache cache, astar_cache_entry *entry) {
+  if (cache->head == entry) {
+    return;
+  }
+  if (entry->prev || entry->next || cache->tail == entry) {
+    astar_cache_unlink(cache, entry);
+  }
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head) {
+    cache->head->prev = entry;
+  }
+  cache->head = entry;
+  if (!cache->tail) {
+    cache->tail = entry;
+  }
+}
+
+static void astar_cache_unlink(astar_cache cache, astar_cache_entry *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+static void astar_cache_evict(astar_cache cache, astar_cache_entry *entry) {
+  for (size_t i = 0; i < entry->node_count; i++) {
+    astar_cache_node *node = entry->nodes + i;
+    point pt = entry->length ? entry->points[i] : entry->start;
+    size_t bucket = astar_cache_hash(entry->map, entry->version, entry->factor,
+                                     pt, entry->end) &
+                    cache->bucket_mask;
+    astar_cache_node **link = cache->buckets + bucket;
+    while (*link && *link != node) {
+      link = &(*link)->next;
+    }
+    if (*link) {
+      *link = node->next;
+    }
+  }
+  astar_cache_unlink(cache, entry);
+  cache->stats.entries--;
+  cache->stats.points -= entry->size;
+  free(entry);
+}
+
+/// Copies the path of a resolved context into a single allocation.
+static astar_cache_entry *astar_cache_entry_new(const astar_context astar) {
+  size_t length =
+      astar->state == ASTAR_SUCCEEDED ? astar->path_length : (size_t)0;
+  // only suffixes of shortest paths are shortest paths themselves, the
+  // others answer their own start only
+  size_t node_count = length && astar->optimal ? length : 1;
+  astar_cache_entry *entry = (astar_cache_entry *)malloc(
+      sizeof(*entry) + sizeof(point) * length + sizeof(aster_cost_t) * length +
+      sizeof(astar_cache_node) * node_count);
+  entry->prev = NULL;
+  entry->next = NULL;
+  entry->map = astar->map->id;
+  entry->version = astar->map->version;
+  entry->factor = astar->estimate_cost_factor;
+  entry->start = astar->start_point;
+  entry->end = astar->end_point;
+  entry->state = astar->state;
+  entry->optimal = astar->optimal;
+  entry->length = length;
+  entry->points = (point *)(entry + 1);
+  entry->costs = (aster_cost_t *)(entry->points + length);
+  entry->nodes = (astar_cache_node *)(entry->costs + length);
+  entry->node_count = node_count;
+  entry->size = length ? length : 1;
+
+  astar_path_points(astar, entry->points, length);
+  for (size_t i = 0; i < length; i++) {
+    entry->costs[i] =
+        i ? entry->costs[i - 1] + direction_cost(point_move_direction(
+                                      entry->points[i - 1], entry->points[i]))
+          : 0;
+  }
+  for (size_t i = 0; i < node_count; i++) {
+    entry->nodes[i].next = NULL;
+    entry->nodes[i].entry = entry;
+    entry->nodes[i].offset = i;
+  }
+  return entry;
+}
@@ -0,0 +1,493 @@
+#include "algorithm/astar_cpd.h"
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/debug.h"
+#include "util/parallel.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Dijkstra runs on integer costs, ASTAR_PARALLEL_COST and
+/// ASTAR_DIAGONAL_COST in units of 1e-4, so that ties between paths are
+/// exact.
+#define ASTAR_CPD_PARALLEL_COST 10000
+#define ASTAR_CPD_DIAGONAL_COST 14142
+#define ASTAR_CPD_INFINITY UINT64_MAX
+#define ASTAR_CPD_MAX_TILES ((size_t)1 << (32 - ASTAR_CPD_DIRECTION_BITS))
+
+typedef struct __astar_cpd_heap_item {
+  uint64_t distance;
+  uint32_t pos;
+} astar_cpd_heap_item;
+
+/// Buffers of one build task, which takes a contiguous range of sources.
+typedef struct __astar_cpd_worker {
+  uint64_t *distances; /// by position
+  uint8_t *first;      /// first move towards each position
+  astar_cpd_heap_item *heap;
+  size_t heap_capacity;
+  uint32_t *runs;
+  size_t run_count;
+  size_t run_capacity;
+} astar_cpd_worker;
+
+/// An empty tile and its position along the Hilbert curve.
+typedef struct __astar_cpd_rank_key {
+  uint64_t key;
+  uint32_t pos;
+} astar_cpd_rank_key;
+
+typedef struct __astar_cpd_builder {
+  const tile_map map;
+  size_t tile_count;
+  const uint32_t *cells; /// position of each rank
+  const uint8_t *empty;  /// by position
+  uint64_t *source_runs; /// runs of each source rank
+  size_t slots;
+  astar_cpd_worker *workers;
+} astar_cpd_builder;
+
+/// Position along the Hilbert curve filling a `side` x `side` square.
+static uint64_t astar_cpd_hilbert(uint64_t side, uint64_t x, uint64_t y) {
+  uint64_t d = 0;
+  for (uint64_t s = side / 2; s > 0; s /= 2) {
+    uint64_t rx = (x & s) > 0;
+    uint64_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = s - 1 - x;
+        y = s - 1 - y;
+      }
+      uint64_t t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+static int astar_cpd_compare_keys(const void *left, const void *right) {
+  const astar_cpd_rank_key *a = (const astar_cpd_rank_key *)left;
+  const astar_cpd_rank_key *b = (const astar_cpd_rank_key *)right;
+  if (a->key != b->key) {
+    return a->key < b->key ? -1 : 1;
+  }
+  return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+static uint64_t astar_cpd_hash_tiles(const tile_map map) {
+  uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+  for (size_t pos = 0; pos < map->rows * map->cols; pos++) {
+    hash = (hash ^ (uint64_t)tile_map_pos_get(map, pos)) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static void astar_cpd_heap_push(astar_cpd_worker *worker, size_t *size,
+                                uint64_t distance, size_t pos) {
+  if (*size == worker->heap_capacity) {
+    worker->heap_capacity *= 2;
+    worker->heap = (astar_cpd_heap_item *)realloc(
+        worker->heap, sizeof(astar_cpd_heap_item) * worker->heap_capacity);
+  }
+  astar_cpd_heap_item *heap = worker->heap;
+  size_t i = (*size)++;
+  while (i > 0 && heap[(i - 1) / 2].distance > distance) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = (astar_cpd_heap_item){distance, (uint32_t)pos};
+}
+
+static astar_cpd_heap_item astar_cpd_heap_pop(astar_cpd_worker *worker,
+                                              size_t *size) {
+  astar_cpd_heap_item *heap = worker->heap;
+  astar_cpd_heap_item top = heap[0];
+  astar_cpd_heap_item last = heap[--*size];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= *size) {
+      break;
+    }
+    if (child + 1 < *size && heap[child + 1].distance < heap[child].distance) {
+      child++;
+    }
+    if (heap[child].distance >= last.distance) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+/// Shortest paths from `source`, keeping the first move towards every tile.
+static void astar_cpd_dijkstra(const astar_cpd_builder *build,
+                               astar_cpd_worker *worker, size_t source) {
+  size_t rows = build->map->rows, cols = build->map->cols;
+  for (size_t pos = 0; pos < rows * cols; pos++) {
+    worker->distances[pos] = ASTAR_CPD_INFINITY;
+  }
+  size_t size = 0;
+  worker->distances[source] = 0;
+  worker->first[source] = DIRECTION_NONE;
+  astar_cpd_heap_push(worker, &size, 0, source);
+  while (size) {
+    astar_cpd_heap_item item = astar_cpd_heap_pop(worker, &size);
+    if (item.distance > worker->distances[item.pos]) {
+      continue; // already settled closer
+    }
+    size_t row = item.pos / cols, col = item.pos % cols;
+    for (direction_t *d = direction_start(); d != direction_end();
+         d = direction_next(d)) {
+      size_t r = row + *d / 3 - 1, c = col + *d % 3 - 1;
+      size_t next = r * cols + c;
+      // wraps around past 0 as well
+      if (r >= rows || c >= cols || !build->empty[next]) {
+        continue;
+      }
+      uint64_t distance =
+          item.distance + (*d % 2 == 1 ? ASTAR_CPD_PARALLEL_COST
+                                       : ASTAR_CPD_DIAGONAL_COST);
+      if (distance < worker->distances[next]) {
+        worker->distances[next] = distance;
+        worker->first[next] =
+            item.pos == source ? *d : worker->first[item.pos];
+        astar_cpd_heap_push(worker, &size, distance, next);
+      }
+    }
+  }
+}
+
+static void astar_cpd_add_run(astar_cpd_worker *worker, size_t target,
+                              direction_t direction) {
+  if (worker->run_count == worker->run_capacity) {
+    worker->run_capacity =
+        worker->run_capacity ? worker->run_capacity * 2 : 64;
+    worker->runs = (uint32_t *)realloc(
+        worker->runs, sizeof(uint32_t) * worker->run_capacity);
+  }
+  worker->runs[worker->run_count++] =
+      (uint32_t)(target << ASTAR_CPD_DIRECTION_BITS | direction);
+}
+
+/// Builds the rows of a share of the sources.
+static void astar_cpd_build_rows(void *context, size_t begin, size_t end) {
+  astar_cpd_builder *build = (astar_cpd_builder *)context;
+  size_t size = build->map->rows * build->map->cols;
+  for (size_t slot = begin; slot < end; slot++) {
+    astar_cpd_worker *worker = build->workers + slot;
+    worker->distances = (uint64_t *)malloc(sizeof(uint64_t) * size);
+    worker->first = (uint8_t *)malloc(size);
+    worker->heap_capacity = 64;
+    worker->heap = (astar_cpd_heap_item *)malloc(
+        sizeof(astar_cpd_heap_item) * worker->heap_capacity);
+    size_t first = build->tile_count * slot / build->slots;
+    size_t last = build->tile_count * (slot + 1) / build->slots;
+    for (size_t source = first; source < last; source++) {
+      astar_cpd_dijkstra(build, worker, build->cells[source]);
+      size_t before = worker->run_count;
+      direction_t current = ASTAR_CPD_UNREACHABLE + 1;
+      for (size_t target = 0; target < build->tile_count; target++) {
+        if (target == source) {
+          continue; // any move will do, extend the run around it
+        }
+        size_t pos = build->cells[target];
+        direction_t direction = worker->distances[pos] == ASTAR_CPD_INFINITY
+                                    ? ASTAR_CPD_UNREACHABLE
+                                    : worker->first[pos];
+        if (direction != current) {
+          astar_cpd_add_run(worker, worker->run_count == before ? 0 : target,
+                            direction);
+          current = direction;
+        }
+      }
+      build->source_runs[source] = worker->run_count - before;
+    }
+    free(worker->distances);
+    free(worker->first);
+    free(worker->heap);
+  }
+}
+
+/// Points the arrays of `cpd` into its image.
+static void astar_cpd_attach(astar_cpd cpd) {
+  const astar_cpd_header *header = (const astar_cpd_header *)cpd->image;
+  size_t ranks_size = sizeof(uint32_t) * header->rows * header->cols;
+  cpd->header = header;
+  cpd->ranks = (const uint32_t *)(header + 1);
+  cpd->rows = (const uint64_t *)((const char *)cpd->ranks +
+                                 (ranks_size + 7) / 8 * 8);
+  cpd->runs = (const uint32_t *)(cpd->rows + header->tile_count + 1);
+}
+
+static size_t astar_cpd_image_size(size_t positions, size_t tile_count,
+                                   size_t run_count) {
+  return sizeof(astar_cpd_header) +
+         (sizeof(uint32_t) * positions + 7) / 8 * 8 +
+         sizeof(uint64_t) * (tile_count + 1) + sizeof(uint32_t) * run_count;
+}
+
+astar_cpd astar_cpd_build(const tile_map map) {
+  size_t size = map->rows * map->cols;
+  if (size >= UINT32_MAX) {
+    return NULL;
+  }
+  uint8_t *empty = (uint8_t *)malloc(size + 1);
+  size_t tile_count = 0;
+  for (size_t pos = 0; pos < size; pos++) {
+    empty[pos] = tile_map_pos_get(map, pos) == TILE_EMPTY;
+    tile_count += empty[pos];
+  }
+  if (tile_count >= ASTAR_CPD_MAX_TILES) {
+    free(empty);
+    return NULL;
+  }
+
+  // rank the empty tiles along the curve, whose keys take up to 64 bits
+  uint64_t side = 1;
+  while (side < map->rows || side < map->cols) {
+    side *= 2;
+  }
+  astar_cpd_rank_key *keys = (astar_cpd_rank_key *)malloc(
+      sizeof(astar_cpd_rank_key) * (tile_count + 1));
+  size_t count = 0;
+  for (size_t pos = 0; pos < size; pos++) {
+    if (empty[pos]) {
+      keys[count].key =
+          astar_cpd_hilbert(side, pos % map->cols, pos / map->cols);
+      keys[count++].pos = (uint32_t)pos;
+    }
+  }
+  qsort(keys, tile_count, sizeof(astar_cpd_rank_key), astar_cpd_compare_keys);
+  uint32_t *cells = (uint32_t *)malloc(sizeof(uint32_t) * (tile_count + 1));
+  for (size_t rank = 0; rank < tile_count; rank++) {
+    cells[rank] = keys[rank].pos;
+  }
+  free(keys);
+
+  size_t slots = parallel_threads();
+  astar_cpd_builder build = {
+      .map = map,
+      .tile_count = tile_count,
+      .cells = cells,
+      .empty = empty,
+      .source_runs = (uint64_t *)malloc(sizeof(uint64_t) * (tile_count + 1)),
+      .slots = slots,
+      .workers = (astar_cpd_worker *)calloc(slots, sizeof(astar_cpd_worker)),
+  };
+  parallel_for(0, build.slots, astar_cpd_build_rows, &build);
+
+  size_t run_count = 0;
+  for (size_t slot = 0; slot < build.slots; slot++) {
+    run_count += build.workers[slot].run_count;
+  }
+  astar_cpd cpd = (astar_cpd)malloc(sizeof(*cpd));
+  cpd->image_size = astar_cpd_image_size(size, tile_count, run_count);
+  cpd->image = calloc(1, cpd->image_size);
+  cpd->mapped = false;
+  astar_cpd_header *header = (astar_cpd_header *)cpd->image;
+  memcpy(header->magic, ASTAR_CPD_MAGIC, sizeof(header->magic));
+  header->rows = map->rows;
+  header->cols = map->cols;
+  header->tiles_hash = astar_cpd_hash_tiles(map);
+  header->tile_count = tile_count;
+  header->run_count = run_count;
+  astar_cpd_attach(cpd);
+
+  uint32_t *ranks = (uint32_t *)cpd->ranks;
+  for (size_t pos = 0; pos < size; pos++) {
+    ranks[pos] = UINT32_MAX;
+  }
+  for (size_t rank = 0; rank < tile_count; rank++) {
+    ranks[cells[rank]] = (uint32_t)rank;
+  }
+  // slots hold consecutive sources in order
+  uint64_t *rows = (uint64_t *)cpd->rows;
+  rows[0] = 0;
+  for (size_t source = 0; source < tile_count; source++) {
+    rows[source + 1] = rows[source] + build.source_runs[source];
+  }
+  uint32_t *runs = (uint32_t *)cpd->runs;
+  for (size_t slot = 0; slot < build.slots; slot++) {
+    astar_cpd_worker *worker = build.workers + slot;
+    memcpy(runs, worker->runs, sizeof(uint32_t) * worker->run_count);
+    runs += worker->run_count;
+    free(worker->runs);
+  }
+  free(build.workers);
+  free(build.source_runs);
+  free(cells);
+  free(empty);
+  return cpd;
+}
+
+/// Whether the ranks and row offsets stay within the image, so that queries
+/// on a damaged file cannot read past it.
+static bool astar_cpd_valid(const astar_cpd cpd) {
+  const astar_cpd_header *header = cpd->header;
+  for (size_t pos = 0; pos < header->rows * header->cols; pos++) {
+    uint32_t rank = cpd->ranks[pos];
+    if (rank != UINT32_MAX && rank >= header->tile_count) {
+      return false;
+    }
+  }
+  if (cpd->rows[0] != 0 || cpd->rows[header->tile_count] != header->run_count) {
+    return false;
+  }
+  for (size_t source = 0; source < header->tile_count; source++) {
+    if (cpd->rows[source] > cpd->rows[source + 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+astar_cpd astar_cpd_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    debugf("astar_cpd_open cannot open %s\n", path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(astar_cpd_header)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    debugf("astar_cpd_open cannot map %s\n", path);
+    return NULL;
+  }
+  const astar_cpd_header *header = (const astar_cpd_header *)mapping;
+  bool ok =
+      memcmp(header->magic, ASTAR_CPD_MAGIC, sizeof(header->magic)) == 0 &&
+      header->rows && header->cols && header->rows < UINT32_MAX &&
+      header->cols < UINT32_MAX && header->rows * header->cols < UINT32_MAX &&
+      header->tile_count < ASTAR_CPD_MAX_TILES &&
+      header->run_count < SIZE_MAX / 8 &&
+      astar_cpd_image_size(header->rows * header->cols, header->tile_count,
+                           header->run_count) == size;
+  if (!ok) {
+    debugf("astar_cpd_open %s is not a path database\n", path);
+    munmap(mapping, size);
+    return NULL;
+  }
+  astar_cpd cpd = (astar_cpd)malloc(sizeof(*cpd));
+  cpd->image = mapping;
+  cpd->image_size = size;
+  cpd->mapped = true;
+  astar_cpd_attach(cpd);
+  if (!astar_cpd_valid(cpd)) {
+    debugf("astar_cpd_open %s is damaged\n", path);
+    astar_cpd_free(&cpd);
+    return NULL;
+  }
+  // rows are read one query step at a time, anywhere in the file
+  madvise(mapping, size, MADV_RANDOM);
+  return cpd;
+}
+
+void astar_cpd_free(astar_cpd *cpd_ptr) {
+  if (cpd_ptr && *cpd_ptr) {
+    astar_cpd cpd = *cpd_ptr;
+    if (cpd->mapped) {
+      munmap(cpd->image, cpd->image_size);
+    } else {
+      free(cpd->image);
+    }
+    free(cpd);
+    *cpd_ptr = NULL;
+  }
+}
+
+bool astar_cpd_write(const astar_cpd cpd, FILE *file) {
+  return fwrite(cpd->image, 1, cpd->image_size, file) == cpd->image_size;
+}
+
+bool astar_cpd_matches(const astar_cpd cpd, const tile_map map) {
+  return cpd && map && cpd->header->rows == map->rows &&
+         cpd->header->cols == map->cols &&
+         cpd->header->tiles_hash == astar_cpd_hash_tiles(map);
+}
+
+direction_t astar_cpd_first_move(const astar_cpd cpd, point from, point to) {
+  const astar_cpd_header *header = cpd->header;
+  if (from.row >= header->rows || from.col >= header->cols ||
+      to.row >= header->rows || to.col >= header->cols) {
+    return ASTAR_CPD_UNREACHABLE;
+  }
+  uint32_t source = cpd->ranks[from.row * header->cols + from.col];
+  uint32_t target = cpd->ranks[to.row * header->cols + to.col];
+  if (source == UINT32_MAX || target == UINT32_MAX) {
+    return ASTAR_CPD_UNREACHABLE;
+  }
+  if (source == target) {
+    return DIRECTION_NONE;
+  }
+  // last run starting at or before the target, the first starts at 0
+  const uint32_t *runs = cpd->runs + cpd->rows[source];
+  size_t low = 0, high = cpd->rows[source + 1] - cpd->rows[source];
+  if (!high) {
+    return ASTAR_CPD_UNREACHABLE;
+  }
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if (runs[middle] >> ASTAR_CPD_DIRECTION_BITS <= target) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return (direction_t)(runs[low] & ((1u << ASTAR_CPD_DIRECTION_BITS) - 1));
+}
+
+astar_state astar_cpd_path(const astar_cpd cpd, point start, point end,
+                           point *buffer, size_t capacity, size_t *length,
+                           aster_cost_t *cost) {
+  size_t path_length = 0;
+  aster_cost_t path_cost = 0;
+  astar_state state = ASTAR_FAILED;
+  point current = start;
+  // a path visits every tile at most once
+  for (size_t step = 0; step <= cpd->header->tile_count; step++) {
+    direction_t direction = astar_cpd_first_move(cpd, current, end);
+    if (direction == ASTAR_CPD_UNREACHABLE) {
+      break;
+    }
+    if (buffer && path_length < capacity) {
+      buffer[path_length] = current;
+    }
+    path_length++;
+    if (direction == DIRECTION_NONE) {
+      state = ASTAR_SUCCEEDED;
+      break;
+    }
+    path_cost += direction_cost(direction);
+    current = point_move(current, direction);
+  }
+  if (state != ASTAR_SUCCEEDED) {
+    path_length = 0;
+    path_cost = 0;
+  }
+  if (length) {
+    *length = path_length;
+  }
+  if (cost) {
+    *cost = path_cost;
+  }
+  return state;
+}
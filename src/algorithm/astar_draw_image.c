@@ -1,159 +1,286 @@
 #include "algorithm/astar_draw_image.h"
 #include "algorithm/astar.h"
+#include "algorithm/astar_stats.h"
 #include "image/bitmap.h"
 #include "struct/tile.h"
 #include "util/debug.h"
+#include "util/parallel.h"
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define BORDER_SIZE 5
 #define TILE_SIZE 3
 #define BORDER_COLOR BITMAP_BLACK
 
-static void tile_map_draw_line(bitmap_image image, size_t y, const tile_map map,
-                               size_t row);
-static void tile_map_draw_border(bitmap_image image, size_t x, size_t y,
-                                 size_t width, size_t height);
-static void tile_map_draw_tile(bitmap_image image, size_t x, size_t y,
-                               tile_t tile);
+/// Cells are drawn by palette code: tile values first, then astar point
+/// types, so runs of equal cells can be filled as a single span.
+#define DRAW_ASTAR (TILE_INVALID + 1)
+#define DRAW_CODES (DRAW_ASTAR + ASTAR_VISITED + 1)
+#define DRAW_PATTERN_PIXELS 16 /// 48 bytes, three 16-byte vector stores
 
-bitmap_image tile_map_draw_image(const tile_map map) {
-  debugf("tile_map_draw_image start\n");
+static const bitmap_color draw_palette[DRAW_CODES] = {
+    BITMAP_WHITE,              /// TILE_EMPTY
+    bitmap_rgb(127, 127, 127), /// TILE_WALL
+    BITMAP_MAGENTA,            /// TILE_INVALID
+    BITMAP_WHITE,              /// ASTAR_ORIGINAL
+    bitmap_rgb(255, 127, 127), /// ASTAR_START_POINT
+    bitmap_rgb(127, 0, 0),     /// ASTAR_END_POINT
+    BITMAP_RED,                /// ASTAR_PATH
+    BITMAP_YELLOW,             /// ASTAR_MARKED
+    bitmap_rgb(255, 192, 0),   /// ASTAR_VISITED
+};
 
-  size_t width = map->cols * TILE_SIZE + 2 * BORDER_SIZE;
-  size_t height = map->rows * TILE_SIZE + 2 * BORDER_SIZE;
-  bitmap_image image = bitmap_new(width, height);
-  debugf("tile_map_draw_image image created\n");
-
-  /// top border
-  tile_map_draw_border(image, 0, 0, width, BORDER_SIZE);
-  debugf("tile_map_draw_image top border done\n");
-
-  for (size_t row = 0; row < map->rows; row++) {
-    tile_map_draw_line(image, BORDER_SIZE + row * TILE_SIZE, map, row);
-  }
+typedef struct __draw_context {
+  tile_map map;
+  astar_context astar; /// NULL when only drawing the map
+  bool with_path;      /// draw path and endpoints in the same pass
+  bitmap_image image;
+  size_t last_row;        /// map row held by last_line when streaming
+  bitmap_byte *last_line; /// previous streamed line, or NULL
+  bitmap_byte patterns[DRAW_CODES][DRAW_PATTERN_PIXELS * BYTES_PER_PIXEL];
+} draw_context;
 
-  /// bottom border
-  tile_map_draw_border(image, 0, BORDER_SIZE + map->rows * TILE_SIZE, width,
-                       BORDER_SIZE);
-  debugf("tile_map_draw_image bottom border done\n");
+static void draw_context_init(draw_context *ctx, tile_map map,
+                              astar_context astar, bool with_path);
+static size_t astar_cell_code(const astar_context astar, size_t pos,
+                              bool with_path);
+static bitmap_image draw_image(draw_context *ctx);
+static void draw_tile(bitmap_image image, point pt, bitmap_color color);
 
+bitmap_image tile_map_draw_image(const tile_map map) {
+  debugf("tile_map_draw_image start\n");
+  draw_context ctx;
+  draw_context_init(&ctx, map, NULL, false);
+  bitmap_image image = draw_image(&ctx);
   debugf("tile_map_draw_image end\n");
   return image;
 }
 
-static void astar_draw_line(bitmap_image image, size_t y,
-                            const astar_context astar, size_t row);
-static void astar_draw_tile(bitmap_image image, size_t x, size_t y,
-                            const astar_context astar, size_t row, size_t col);
-
 bitmap_image astar_draw_image(const astar_context astar) {
   debugf("astar_draw_image start\n");
-  tile_map map = astar->map;
-
-  size_t width = map->cols * TILE_SIZE + 2 * BORDER_SIZE;
-  size_t height = map->rows * TILE_SIZE + 2 * BORDER_SIZE;
-  bitmap_image image = bitmap_new(width, height);
-  debugf("astar_draw_image image created\n");
+  astar_stats_begin(started);
+  draw_context ctx;
+  draw_context_init(&ctx, astar->map, astar, false);
+  bitmap_image image = draw_image(&ctx);
+  debugf("astar_draw_image states done\n");
 
-  /// top border
-  tile_map_draw_border(image, 0, 0, width, BORDER_SIZE);
-  debugf("astar_draw_image top border done\n");
+  astar_draw_path(image, astar);
+  astar_stats_end(astar, ASTAR_PHASE_RENDER, started);
+  debugf("astar_draw_image end\n");
+  return image;
+}
 
-  for (size_t row = 0; row < map->rows; row++) {
-    astar_draw_line(image, BORDER_SIZE + row * TILE_SIZE, astar, row);
+void astar_draw_path(bitmap_image image, const astar_context astar) {
+  size_t length = astar_path_points(astar, NULL, 0);
+  point *path = length ? (point *)malloc(sizeof(point) * length) : NULL;
+  astar_path_points(astar, path, length);
+  for (size_t i = 0; i < length; i++) {
+    draw_tile(image, path[i], draw_palette[DRAW_ASTAR + ASTAR_PATH]);
   }
+  free(path);
 
-  /// bottom border
-  tile_map_draw_border(image, 0, BORDER_SIZE + map->rows * TILE_SIZE, width,
-                       BORDER_SIZE);
-  debugf("astar_draw_image bottom border done\n");
+  if (tile_map_contains(astar->map, astar->start_point)) {
+    draw_tile(image, astar->start_point,
+              draw_palette[DRAW_ASTAR + ASTAR_START_POINT]);
+  }
+  if (tile_map_contains(astar->map, astar->end_point)) {
+    draw_tile(image, astar->end_point,
+              draw_palette[DRAW_ASTAR + ASTAR_END_POINT]);
+  }
+}
 
-  debugf("astar_draw_image end\n");
-  return image;
+static void draw_context_init(draw_context *ctx, tile_map map,
+                              astar_context astar, bool with_path) {
+  ctx->map = map;
+  ctx->astar = astar;
+  ctx->with_path = with_path;
+  ctx->image = NULL;
+  ctx->last_row = 0;
+  ctx->last_line = NULL;
+  for (size_t code = 0; code < DRAW_CODES; code++) {
+    bitmap_fill_span(ctx->patterns[code], draw_palette[code],
+                     DRAW_PATTERN_PIXELS);
+  }
 }
 
-static void tile_map_draw_line(bitmap_image image, size_t y, const tile_map map,
-                               size_t row) {
+/// Fills `count` pixels with a fixed-size pattern copy while the line has
+/// room for it; the overshoot is overwritten by the spans drawn after.
+static inline void draw_span(bitmap_byte *ptr, const bitmap_byte *line_end,
+                             const bitmap_byte *pattern, size_t count) {
+  const size_t pattern_bytes = DRAW_PATTERN_PIXELS * BYTES_PER_PIXEL;
+  bitmap_byte *end = ptr + count * BYTES_PER_PIXEL;
+  while (ptr < end && ptr + pattern_bytes <= line_end) {
+    memcpy(ptr, pattern, pattern_bytes);
+    ptr += pattern_bytes;
+  }
+  if (ptr < end) {
+    memcpy(ptr, pattern, end - ptr);
+  }
+}
 
-  /// left border
-  tile_map_draw_border(image, 0, y, BORDER_SIZE, TILE_SIZE);
-  size_t x = BORDER_SIZE;
+void astar_draw_cell(bitmap_image image, const astar_context astar,
+                     size_t row, size_t col) {
+  point pt = {row, col};
+  size_t code;
+  if (point_equal(pt, astar->end_point)) {
+    code = DRAW_ASTAR + ASTAR_END_POINT;
+  } else if (point_equal(pt, astar->start_point)) {
+    code = DRAW_ASTAR + ASTAR_START_POINT;
+  } else {
+    code = astar_cell_code(astar, tile_map_pos(astar->map, row, col), true);
+  }
+  draw_tile(image, pt, draw_palette[code]);
+}
 
-  for (size_t col = 0; col < map->cols; col++, x += TILE_SIZE) {
-    tile_map_draw_tile(image, x, y, tile_map_get(map, row, col));
+static inline size_t astar_cell_code(const astar_context astar, size_t pos,
+                                     bool with_path) {
+  astar_point_state *pt_state = astar->states + pos;
+  if (with_path && pt_state->is_path) {
+    return DRAW_ASTAR + ASTAR_PATH;
+  }
+  if (pt_state->visited) {
+    return DRAW_ASTAR + ASTAR_VISITED;
+  }
+  if (pt_state->marked) {
+    return DRAW_ASTAR + ASTAR_MARKED;
   }
+  return tile_map_pos_get(astar->map, pos);
+}
 
-  /// right border
-  tile_map_draw_border(image, x, y, BORDER_SIZE, TILE_SIZE);
-  x += BORDER_SIZE;
+static inline size_t draw_cell_code(const draw_context *ctx, size_t pos) {
+  if (ctx->astar) {
+    return astar_cell_code(ctx->astar, pos, ctx->with_path);
+  }
+  return tile_map_pos_get(ctx->map, pos);
 }
 
-static void astar_draw_line(bitmap_image image, size_t y,
-                            const astar_context astar, size_t row) {
-  tile_map map = astar->map;
+static inline void draw_endpoint(const draw_context *ctx, bitmap_byte *line,
+                                 point pt, size_t row, bitmap_color color) {
+  if (pt.row == row && tile_map_contains(ctx->map, pt)) {
+    bitmap_fill_span(line + (BORDER_SIZE + pt.col * TILE_SIZE) *
+                                BYTES_PER_PIXEL,
+                     color, TILE_SIZE);
+  }
+}
 
-  /// left border
-  tile_map_draw_border(image, 0, y, BORDER_SIZE, TILE_SIZE);
-  size_t x = BORDER_SIZE;
+/// Draws one pixel line of map row `row`, filling runs of equal cells as
+/// single spans.
+static void draw_line(const draw_context *ctx, size_t row, bitmap_byte *line) {
+  tile_map map = ctx->map;
+  bitmap_byte *ptr = line + BORDER_SIZE * BYTES_PER_PIXEL;
+  // keep the right border out of reach of the overshoot
+  const bitmap_byte *line_end =
+      ptr + map->cols * TILE_SIZE * BYTES_PER_PIXEL;
+  bitmap_fill_span(line, BORDER_COLOR, BORDER_SIZE);
 
-  for (size_t col = 0; col < map->cols; col++, x += TILE_SIZE) {
-    astar_draw_tile(image, x, y, astar, row, col);
+  size_t pos = tile_map_pos(map, row, 0);
+  for (size_t col = 0; col < map->cols;) {
+    size_t code = draw_cell_code(ctx, pos + col);
+    size_t run = 1;
+    while (col + run < map->cols &&
+           draw_cell_code(ctx, pos + col + run) == code) {
+      run++;
+    }
+    draw_span(ptr, line_end, ctx->patterns[code], run * TILE_SIZE);
+    ptr += run * TILE_SIZE * BYTES_PER_PIXEL;
+    col += run;
   }
+  bitmap_fill_span(ptr, BORDER_COLOR, BORDER_SIZE);
 
-  /// right border
-  tile_map_draw_border(image, x, y, BORDER_SIZE, TILE_SIZE);
-  x += BORDER_SIZE;
+  if (ctx->with_path) {
+    draw_endpoint(ctx, line, ctx->astar->start_point, row,
+                  draw_palette[DRAW_ASTAR + ASTAR_START_POINT]);
+    draw_endpoint(ctx, line, ctx->astar->end_point, row,
+                  draw_palette[DRAW_ASTAR + ASTAR_END_POINT]);
+  }
 }
 
-static void tile_map_draw_border(bitmap_image image, size_t x, size_t y,
-                                 size_t width, size_t height) {
-  for (size_t dx = 0; dx < width; dx++) {
-    for (size_t dy = 0; dy < height; dy++) {
-      bitmap_set_color(image, x + dx, y + dy, BORDER_COLOR);
+static void draw_rows(void *context, size_t begin, size_t end) {
+  draw_context *ctx = (draw_context *)context;
+  size_t line_bytes = ctx->image->width * BYTES_PER_PIXEL;
+  for (size_t row = begin; row < end; row++) {
+    size_t y = BORDER_SIZE + row * TILE_SIZE;
+    bitmap_byte *line = bitmap_row(ctx->image, y);
+    draw_line(ctx, row, line);
+    for (size_t dy = 1; dy < TILE_SIZE; dy++) {
+      memcpy(bitmap_row(ctx->image, y + dy), line, line_bytes);
     }
   }
 }
 
-static inline void draw_tile(bitmap_image image, size_t x, size_t y,
-                             bitmap_color color);
-static inline void tile_map_draw_tile(bitmap_image image, size_t x, size_t y,
-                                      tile_t tile) {
-  static bitmap_color tile_colors[TILE_INVALID + 1] = {
-      BITMAP_WHITE,              /// EMPTY
-      bitmap_rgb(127, 127, 127), /// WALL
-      BITMAP_MAGENTA             /// INVALID
-  };
-  draw_tile(image, x, y, tile_colors[tile]);
+static void draw_border_rows(bitmap_image image, size_t y, size_t height) {
+  bitmap_byte *line = bitmap_row(image, y);
+  bitmap_fill_span(line, BORDER_COLOR, image->width);
+  for (size_t dy = 1; dy < height; dy++) {
+    memcpy(bitmap_row(image, y + dy), line, image->width * BYTES_PER_PIXEL);
+  }
 }
 
-static inline void draw_tile(bitmap_image image, size_t x, size_t y,
-                             bitmap_color color) {
-  for (size_t dx = 0; dx < TILE_SIZE; dx++) {
-    for (size_t dy = 0; dy < TILE_SIZE; dy++) {
-      bitmap_set_color(image, x + dx, y + dy, color);
-    }
+static bitmap_image draw_image(draw_context *ctx) {
+  tile_map map = ctx->map;
+  size_t width = map->cols * TILE_SIZE + 2 * BORDER_SIZE;
+  size_t height = map->rows * TILE_SIZE + 2 * BORDER_SIZE;
+  // every pixel gets drawn, skip clearing them first
+  ctx->image = bitmap_alloc(width, height);
+
+  draw_border_rows(ctx->image, 0, BORDER_SIZE);
+  parallel_for(0, map->rows, draw_rows, ctx);
+  draw_border_rows(ctx->image, BORDER_SIZE + map->rows * TILE_SIZE,
+                   BORDER_SIZE);
+  return ctx->image;
+}
+
+static void draw_tile(bitmap_image image, point pt, bitmap_color color) {
+  size_t x = BORDER_SIZE + pt.col * TILE_SIZE;
+  size_t y = BORDER_SIZE + pt.row * TILE_SIZE;
+  for (size_t dy = 0; dy < TILE_SIZE; dy++) {
+    bitmap_fill_span(bitmap_row(image, y + dy) + x * BYTES_PER_PIXEL, color,
+                     TILE_SIZE);
   }
 }
 
-static inline void astar_draw_tile(bitmap_image image, size_t x, size_t y,
-                                   const astar_context astar, size_t row,
-                                   size_t col) {
-  static bitmap_color tile_colors[ASTAR_VISITED + 1] = {
-      BITMAP_WHITE,              /// ASTAR_ORIGINAL
-      bitmap_rgb(255, 127, 127), /// ASTAR_START_POINT
-      bitmap_rgb(127, 0, 0),     /// ASTAR_END_POINT
-      BITMAP_RED,                /// ASTAR_PATH
-      BITMAP_YELLOW,             /// ASTAR_MARKED
-      bitmap_rgb(255, 192, 0),   /// ASTAR_VISITED
-  };
-  astar_point_type point_type = astar_get_point_type(astar, row, col);
-  switch (point_type) {
-  case ASTAR_ORIGINAL:
-    tile_map_draw_tile(image, x, y, tile_map_get(astar->map, row, col));
-    break;
-  default:
-    draw_tile(image, x, y, tile_colors[point_type]);
-    break;
+static bool draw_stream_row(void *context, size_t y, bitmap_byte *line) {
+  draw_context *ctx = (draw_context *)context;
+  tile_map map = ctx->map;
+  size_t width = map->cols * TILE_SIZE + 2 * BORDER_SIZE;
+  if (y < BORDER_SIZE || y >= BORDER_SIZE + map->rows * TILE_SIZE) {
+    bitmap_fill_span(line, BORDER_COLOR, width);
+    ctx->last_line = NULL;
+    return true;
   }
+  size_t row = (y - BORDER_SIZE) / TILE_SIZE;
+  if (ctx->last_line && ctx->last_row == row) {
+    // the writer keeps the previous line intact, and hands out the very same
+    // buffer when it holds a single line
+    if (ctx->last_line != line) {
+      memcpy(line, ctx->last_line, width * BYTES_PER_PIXEL);
+    }
+  } else {
+    draw_line(ctx, row, line);
+  }
+  ctx->last_row = row;
+  ctx->last_line = line;
+  return true;
+}
+
+bool tile_map_write_image(const tile_map map, FILE *file) {
+  draw_context ctx;
+  draw_context_init(&ctx, map, NULL, false);
+  return bitmap_stream_write(map->cols * TILE_SIZE + 2 * BORDER_SIZE,
+                             map->rows * TILE_SIZE + 2 * BORDER_SIZE,
+                             draw_stream_row, &ctx, file);
+}
+
+bool astar_write_image(const astar_context astar, FILE *file) {
+  tile_map map = astar->map;
+  draw_context ctx;
+  draw_context_init(&ctx, map, astar, true);
+  astar_stats_begin(started);
+  bool ok = bitmap_stream_write(map->cols * TILE_SIZE + 2 * BORDER_SIZE,
+                                map->rows * TILE_SIZE + 2 * BORDER_SIZE,
+                                draw_stream_row, &ctx, file);
+  astar_stats_end(astar, ASTAR_PHASE_RENDER, started);
+  return ok;
 }
@@ -0,0 +1,299 @@
+#include "algorithm/astar_expand.h"
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <immintrin.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned (*astar_expand_kernel)(const astar_context astar, point pt,
+                                        astar_expansion *out);
+
+const direction_t astar_expand_directions[ASTAR_EXPAND_NEIGHBOURS] = {
+    DIRECTION_EAST,       DIRECTION_SOUTH,      DIRECTION_WEST,
+    DIRECTION_NORTH,      DIRECTION_NORTH_EAST, DIRECTION_SOUTH_EAST,
+    DIRECTION_SOUTH_WEST, DIRECTION_NORTH_WEST,
+};
+
+/// Straight moves first, then diagonal ones, so each half of the lanes has
+/// one move cost.
+static const int astar_expand_rows[ASTAR_EXPAND_NEIGHBOURS] = {0,  1, 0,  -1,
+                                                               -1, 1, 1,  -1};
+static const int astar_expand_cols[ASTAR_EXPAND_NEIGHBOURS] = {1, 0, -1, 0,
+                                                               1, 1, -1, -1};
+
+static _Atomic(astar_expand_kernel) astar_expand_selected = NULL;
+static astar_expand_isa astar_expand_selected_isa = ASTAR_EXPAND_SCALAR;
+static uint32_t astar_expand_marked_bits;  /// flag bits in a state's first
+static uint32_t astar_expand_visited_bits; /// 32 bits, 0 when not there
+
+static unsigned astar_expand_scalar(const astar_context astar, point pt,
+                                    astar_expansion *out) {
+  tile_map map = astar->map;
+  size_t pos = tile_map_pos(map, pt.row, pt.col);
+  aster_cost_t paid = astar->states[pos].paid_cost;
+  unsigned improved = 0;
+  for (size_t i = 0; i < ASTAR_EXPAND_NEIGHBOURS; i++) {
+    direction_t direction = astar_expand_directions[i];
+    point next = point_move(pt, direction);
+    if (!tile_map_contains(map, next) ||
+        tile_map_get(map, next.row, next.col) != TILE_EMPTY) {
+      continue;
+    }
+    const astar_point_state *state =
+        astar->states + tile_map_pos(map, next.row, next.col);
+    aster_cost_t cost = paid + direction_cost(direction);
+    if (state->visited || (state->marked && !(cost < state->paid_cost))) {
+      continue;
+    }
+    out->paid_cost[i] = cost;
+    out->predict_cost[i] =
+        cost + (aster_cost_t)(astar_estimate_cost(&next, &astar->end_point) *
+                              astar->estimate_cost_factor);
+    improved |= 1u << i;
+  }
+  return improved;
+}
+
+/// Whether all neighbours of `pt` can be read from the flat arrays.
+static inline bool astar_expand_inside(const astar_context astar, point pt) {
+  tile_map map = astar->map;
+  return !map->chunks && pt.row > 0 && pt.col > 0 && pt.row + 1 < map->rows &&
+         pt.col + 1 < map->cols &&
+         map->cols < INT32_MAX / (sizeof(astar_point_state) / 4) - 1;
+}
+
+__attribute__((target("avx2"))) static unsigned
+astar_expand_avx2(const astar_context astar, point pt, astar_expansion *out) {
+  if (!astar_expand_inside(astar, pt)) {
+    return astar_expand_scalar(astar, pt, out);
+  }
+  tile_map map = astar->map;
+  int cols = (int)map->cols;
+  size_t pos = pt.row * map->cols + pt.col;
+  const astar_point_state *state = astar->states + pos;
+  __m256i offsets = _mm256_setr_epi32(1, cols, -1, -cols, 1 - cols, cols + 1,
+                                      cols - 1, -cols - 1);
+
+  __m256i tiles = _mm256_i32gather_epi32((const int *)(map->tiles + pos),
+                                         offsets, sizeof(tile_t));
+  __m256i words = _mm256_i32gather_epi32(
+      (const int *)state,
+      _mm256_mullo_epi32(offsets,
+                         _mm256_set1_epi32(sizeof(astar_point_state) / 4)),
+      4);
+  __m256i zero = _mm256_setzero_si256();
+  __m256i open = _mm256_and_si256(
+      _mm256_cmpeq_epi32(tiles, _mm256_set1_epi32(TILE_EMPTY)),
+      _mm256_cmpeq_epi32(
+          _mm256_and_si256(words, _mm256_set1_epi32(astar_expand_visited_bits)),
+          zero));
+  __m256i unmarked = _mm256_cmpeq_epi32(
+      _mm256_and_si256(words, _mm256_set1_epi32(astar_expand_marked_bits)),
+      zero);
+
+  // paid costs sit 3 doubles apart
+  const double *paid_base = &state->paid_cost;
+  __m256i paid_index = _mm256_mullo_epi32(
+      offsets, _mm256_set1_epi32(sizeof(astar_point_state) / sizeof(double)));
+  __m256d old_straight = _mm256_i32gather_pd(
+      paid_base, _mm256_castsi256_si128(paid_index), sizeof(double));
+  __m256d old_diagonal = _mm256_i32gather_pd(
+      paid_base, _mm256_extracti128_si256(paid_index, 1), sizeof(double));
+  __m256d paid = _mm256_set1_pd(state->paid_cost);
+  __m256d straight =
+      _mm256_add_pd(paid, _mm256_set1_pd(direction_cost(DIRECTION_EAST)));
+  __m256d diagonal =
+      _mm256_add_pd(paid, _mm256_set1_pd(direction_cost(DIRECTION_NORTH_EAST)));
+  unsigned cheaper =
+      _mm256_movemask_pd(_mm256_cmp_pd(straight, old_straight, _CMP_LT_OQ)) |
+      _mm256_movemask_pd(_mm256_cmp_pd(diagonal, old_diagonal, _CMP_LT_OQ))
+          << 4;
+  unsigned improved =
+      _mm256_movemask_ps(_mm256_castsi256_ps(open)) &
+      (_mm256_movemask_ps(_mm256_castsi256_ps(unmarked)) | cheaper);
+  if (!improved) {
+    return 0;
+  }
+
+  // same operations as astar_estimate_cost: straight steps times the
+  // straight cost plus diagonal steps times the diagonal cost, truncated
+  __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+  __m256d end_row = _mm256_set1_pd((double)astar->end_point.row);
+  __m256d end_col = _mm256_set1_pd((double)astar->end_point.col);
+  __m256d factor = _mm256_set1_pd(astar->estimate_cost_factor);
+  __m256d costs[2] = {straight, diagonal};
+  for (size_t half = 0; half < 2; half++) {
+    __m256d rows = _mm256_add_pd(
+        _mm256_set1_pd((double)pt.row),
+        _mm256_cvtepi32_pd(_mm_loadu_si128(
+            (const __m128i *)(astar_expand_rows + 4 * half))));
+    __m256d columns = _mm256_add_pd(
+        _mm256_set1_pd((double)pt.col),
+        _mm256_cvtepi32_pd(_mm_loadu_si128(
+            (const __m128i *)(astar_expand_cols + 4 * half))));
+    __m256d row_diff = _mm256_and_pd(_mm256_sub_pd(rows, end_row), abs_mask);
+    __m256d col_diff = _mm256_and_pd(_mm256_sub_pd(columns, end_col), abs_mask);
+    __m256d diagonal_diff = _mm256_min_pd(row_diff, col_diff);
+    __m256d parallel_diff =
+        _mm256_sub_pd(_mm256_max_pd(row_diff, col_diff), diagonal_diff);
+    __m256d estimate = _mm256_floor_pd(_mm256_add_pd(
+        _mm256_mul_pd(parallel_diff, _mm256_set1_pd(ASTAR_PARALLEL_COST)),
+        _mm256_mul_pd(diagonal_diff, _mm256_set1_pd(ASTAR_DIAGONAL_COST))));
+    _mm256_storeu_pd(out->paid_cost + 4 * half, costs[half]);
+    _mm256_storeu_pd(
+        out->predict_cost + 4 * half,
+        _mm256_add_pd(costs[half], _mm256_mul_pd(estimate, factor)));
+  }
+  return improved;
+}
+
+__attribute__((target("sse4.1"))) static unsigned
+astar_expand_sse41(const astar_context astar, point pt, astar_expansion *out) {
+  if (!astar_expand_inside(astar, pt)) {
+    return astar_expand_scalar(astar, pt, out);
+  }
+  tile_map map = astar->map;
+  ptrdiff_t cols = (ptrdiff_t)map->cols;
+  size_t pos = pt.row * map->cols + pt.col;
+  const ptrdiff_t offsets[ASTAR_EXPAND_NEIGHBOURS] = {
+      1, cols, -1, -cols, 1 - cols, cols + 1, cols - 1, -cols - 1};
+  // no gathers before AVX2, load the lanes one by one
+  int32_t tiles[ASTAR_EXPAND_NEIGHBOURS];
+  uint32_t words[ASTAR_EXPAND_NEIGHBOURS];
+  double old_paid[ASTAR_EXPAND_NEIGHBOURS];
+  for (size_t i = 0; i < ASTAR_EXPAND_NEIGHBOURS; i++) {
+    const astar_point_state *state = astar->states + pos + offsets[i];
+    tiles[i] = (int32_t)map->tiles[pos + offsets[i]];
+    memcpy(words + i, state, sizeof(uint32_t));
+    old_paid[i] = state->paid_cost;
+  }
+
+  __m128i zero = _mm_setzero_si128();
+  __m128i empty = _mm_set1_epi32(TILE_EMPTY);
+  __m128i visited_bits = _mm_set1_epi32(astar_expand_visited_bits);
+  __m128i marked_bits = _mm_set1_epi32(astar_expand_marked_bits);
+  unsigned open = 0;
+  unsigned unmarked = 0;
+  for (size_t half = 0; half < 2; half++) {
+    __m128i tile = _mm_loadu_si128((const __m128i *)(tiles + 4 * half));
+    __m128i word = _mm_loadu_si128((const __m128i *)(words + 4 * half));
+    __m128i lanes = _mm_and_si128(
+        _mm_cmpeq_epi32(tile, empty),
+        _mm_cmpeq_epi32(_mm_and_si128(word, visited_bits), zero));
+    open |= _mm_movemask_ps(_mm_castsi128_ps(lanes)) << (4 * half);
+    unmarked |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+                    _mm_and_si128(word, marked_bits), zero)))
+                << (4 * half);
+  }
+
+  aster_cost_t paid = astar->states[pos].paid_cost;
+  __m128d moves[2] = {
+      _mm_set1_pd(paid + direction_cost(DIRECTION_EAST)),
+      _mm_set1_pd(paid + direction_cost(DIRECTION_NORTH_EAST))};
+  unsigned cheaper = 0;
+  for (size_t pair = 0; pair < 4; pair++) {
+    __m128d old = _mm_loadu_pd(old_paid + 2 * pair);
+    cheaper |= _mm_movemask_pd(_mm_cmplt_pd(moves[pair / 2], old))
+               << (2 * pair);
+  }
+  unsigned improved = open & (unmarked | cheaper);
+  if (!improved) {
+    return 0;
+  }
+
+  __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(INT64_MAX));
+  __m128d end_row = _mm_set1_pd((double)astar->end_point.row);
+  __m128d end_col = _mm_set1_pd((double)astar->end_point.col);
+  __m128d factor = _mm_set1_pd(astar->estimate_cost_factor);
+  for (size_t pair = 0; pair < 4; pair++) {
+    __m128d rows = _mm_add_pd(
+        _mm_set1_pd((double)pt.row),
+        _mm_setr_pd(astar_expand_rows[2 * pair],
+                    astar_expand_rows[2 * pair + 1]));
+    __m128d columns = _mm_add_pd(
+        _mm_set1_pd((double)pt.col),
+        _mm_setr_pd(astar_expand_cols[2 * pair],
+                    astar_expand_cols[2 * pair + 1]));
+    __m128d row_diff = _mm_and_pd(_mm_sub_pd(rows, end_row), abs_mask);
+    __m128d col_diff = _mm_and_pd(_mm_sub_pd(columns, end_col), abs_mask);
+    __m128d diagonal_diff = _mm_min_pd(row_diff, col_diff);
+    __m128d parallel_diff =
+        _mm_sub_pd(_mm_max_pd(row_diff, col_diff), diagonal_diff);
+    __m128d estimate = _mm_floor_pd(_mm_add_pd(
+        _mm_mul_pd(parallel_diff, _mm_set1_pd(ASTAR_PARALLEL_COST)),
+        _mm_mul_pd(diagonal_diff, _mm_set1_pd(ASTAR_DIAGONAL_COST))));
+    _mm_storeu_pd(out->paid_cost + 2 * pair, moves[pair / 2]);
+    _mm_storeu_pd(out->predict_cost + 2 * pair,
+                  _mm_add_pd(moves[pair / 2], _mm_mul_pd(estimate, factor)));
+  }
+  return improved;
+}
+
+static const astar_expand_kernel astar_expand_kernels[ASTAR_EXPAND_ISA_LENGTH] =
+    {astar_expand_scalar, astar_expand_sse41, astar_expand_avx2};
+
+/// Finds where the compiler put the marked and visited bit-fields. The SIMD
+/// kernels need both in the first 32 bits of a state.
+static bool astar_expand_probe() {
+  astar_point_state state;
+  memset(&state, 0, sizeof(state));
+  state.marked = true;
+  memcpy(&astar_expand_marked_bits, &state, sizeof(uint32_t));
+  memset(&state, 0, sizeof(state));
+  state.visited = true;
+  memcpy(&astar_expand_visited_bits, &state, sizeof(uint32_t));
+  return astar_expand_marked_bits && astar_expand_visited_bits &&
+         sizeof(tile_t) == sizeof(int32_t) &&
+         sizeof(astar_point_state) % sizeof(double) == 0;
+}
+
+char *astar_expand_isa_str(astar_expand_isa isa) {
+  static char *strs[ASTAR_EXPAND_ISA_LENGTH] = {"scalar", "sse4.1", "avx2"};
+  return strs[isa % ASTAR_EXPAND_ISA_LENGTH];
+}
+
+astar_expand_isa astar_expand_best_isa() {
+  if (!astar_expand_probe()) {
+    return ASTAR_EXPAND_SCALAR;
+  }
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return ASTAR_EXPAND_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return ASTAR_EXPAND_SSE41;
+  }
+  return ASTAR_EXPAND_SCALAR;
+}
+
+astar_expand_isa astar_expand_get_isa() {
+  if (!atomic_load_explicit(&astar_expand_selected, memory_order_acquire)) {
+    astar_expand_set_isa(astar_expand_best_isa());
+  }
+  return astar_expand_selected_isa;
+}
+
+bool astar_expand_set_isa(astar_expand_isa isa) {
+  if (isa >= ASTAR_EXPAND_ISA_LENGTH || isa > astar_expand_best_isa()) {
+    return false;
+  }
+  astar_expand_selected_isa = isa;
+  atomic_store_explicit(&astar_expand_selected, astar_expand_kernels[isa],
+                        memory_order_release);
+  return true;
+}
+
+unsigned astar_expand(const astar_context astar, point pt,
+                      astar_expansion *out) {
+  astar_expand_kernel kernel =
+      atomic_load_explicit(&astar_expand_selected, memory_order_acquire);
+  if (!kernel) {
+    astar_expand_get_isa();
+    kernel = atomic_load_explicit(&astar_expand_selected, memory_order_acquire);
+  }
+  return kernel(astar, pt, out);
+}
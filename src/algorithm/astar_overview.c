@@ -0,0 +1,228 @@
+#include "algorithm/astar_overview.h"
+#include "algorithm/astar.h"
+#include "image/bitmap.h"
+#include "struct/bool.h"
+#include "struct/tile.h"
+#include "util/debug.h"
+#include "util/parallel.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OVERVIEW_MAX_LEVELS 64
+#define OVERVIEW_SEARCHED_COLOR bitmap_rgb(255, 192, 0)
+#define OVERVIEW_PATH_COLOR BITMAP_RED
+
+typedef struct __overview_build {
+  tile_map map;
+  astar_context astar;
+  const astar_mip_level *src;
+  astar_mip_level *dst;
+} overview_build;
+
+typedef struct __overview_render {
+  const astar_mip_level *level;
+  size_t shift; /// log2 of the cells per level sample
+  size_t row;
+  size_t col;
+  size_t rows;
+  size_t cols;
+  bitmap_image image;
+} overview_render;
+
+static void overview_level_alloc(astar_mip_level *level, size_t rows,
+                                 size_t cols) {
+  size_t size = rows * cols;
+  level->rows = rows;
+  level->cols = cols;
+  level->walls = (bitmap_byte *)malloc(size * 3);
+  level->searched = level->walls + size;
+  level->path = level->searched + size;
+}
+
+static void overview_build_base(void *context, size_t begin, size_t end) {
+  overview_build *build = (overview_build *)context;
+  astar_mip_level *dst = build->dst;
+  for (size_t row = begin; row < end; row++) {
+    size_t pos = row * dst->cols;
+    bitmap_byte *walls = dst->walls + pos;
+    if (!build->map->chunks) {
+      // flat maps convert a whole row in one vectorisable loop
+      const tile_t *tiles = build->map->tiles + pos;
+      for (size_t col = 0; col < dst->cols; col++) {
+        walls[col] = tiles[col] == TILE_WALL ? 255 : 0;
+      }
+    } else {
+      for (size_t col = 0; col < dst->cols; col++) {
+        tile_t tile = tile_map_pos_get(build->map, pos + col);
+        walls[col] = tile == TILE_WALL ? 255 : 0;
+      }
+    }
+    if (!build->astar) {
+      memset(dst->searched + row * dst->cols, 0, dst->cols);
+      memset(dst->path + row * dst->cols, 0, dst->cols);
+      continue;
+    }
+    pos = row * dst->cols;
+    const astar_point_state *states = build->astar->states;
+    for (size_t col = 0; col < dst->cols; col++, pos++) {
+      dst->searched[pos] =
+          states[pos].marked || states[pos].visited ? 255 : 0;
+      dst->path[pos] = states[pos].is_path ? 255 : 0;
+    }
+  }
+}
+
+static inline bitmap_byte overview_max(bitmap_byte a, bitmap_byte b) {
+  return a > b ? a : b;
+}
+
+/// Averages (or, for the path, takes the max of) 2x2 blocks of one plane.
+static inline void overview_reduce_row(const bitmap_byte *top,
+                                       const bitmap_byte *bottom,
+                                       size_t src_cols, bitmap_byte *dst,
+                                       size_t dst_cols, bool is_max) {
+  size_t pairs = src_cols / 2;
+  if (is_max) {
+    for (size_t c = 0; c < pairs; c++) {
+      dst[c] = overview_max(overview_max(top[2 * c], top[2 * c + 1]),
+                            overview_max(bottom[2 * c], bottom[2 * c + 1]));
+    }
+  } else {
+    for (size_t c = 0; c < pairs; c++) {
+      unsigned sum = (unsigned)top[2 * c] + top[2 * c + 1] + bottom[2 * c] +
+                     bottom[2 * c + 1];
+      dst[c] = (bitmap_byte)((sum + 2) >> 2);
+    }
+  }
+  if (pairs < dst_cols) {
+    // odd width, the last sample only covers one column
+    bitmap_byte a = top[src_cols - 1];
+    bitmap_byte b = bottom[src_cols - 1];
+    dst[pairs] = is_max ? overview_max(a, b) : (bitmap_byte)((a + b + 1) >> 1);
+  }
+}
+
+static void overview_build_level(void *context, size_t begin, size_t end) {
+  overview_build *build = (overview_build *)context;
+  const astar_mip_level *src = build->src;
+  astar_mip_level *dst = build->dst;
+  for (size_t row = begin; row < end; row++) {
+    size_t top = 2 * row * src->cols;
+    size_t bottom =
+        (2 * row + 1 < src->rows ? 2 * row + 1 : 2 * row) * src->cols;
+    size_t out = row * dst->cols;
+    overview_reduce_row(src->walls + top, src->walls + bottom, src->cols,
+                        dst->walls + out, dst->cols, false);
+    overview_reduce_row(src->searched + top, src->searched + bottom,
+                        src->cols, dst->searched + out, dst->cols, false);
+    overview_reduce_row(src->path + top, src->path + bottom, src->cols,
+                        dst->path + out, dst->cols, true);
+  }
+}
+
+astar_mip astar_mip_build(const tile_map map, const astar_context astar) {
+  debugf("astar_mip_build start\n");
+  astar_mip_level levels[OVERVIEW_MAX_LEVELS];
+  size_t count = 0;
+  size_t rows = map->rows;
+  size_t cols = map->cols;
+  overview_build build = {map, astar, NULL, NULL};
+
+  overview_level_alloc(levels + count, rows, cols);
+  build.dst = levels + count++;
+  parallel_for(0, rows, overview_build_base, &build);
+
+  while ((rows > 1 || cols > 1) && count < OVERVIEW_MAX_LEVELS) {
+    rows = (rows + 1) / 2;
+    cols = (cols + 1) / 2;
+    overview_level_alloc(levels + count, rows, cols);
+    build.src = levels + count - 1;
+    build.dst = levels + count++;
+    parallel_for(0, rows, overview_build_level, &build);
+  }
+
+  astar_mip mip =
+      (astar_mip)malloc(sizeof(*mip) + sizeof(astar_mip_level) * count);
+  mip->level_count = count;
+  memcpy(mip->levels, levels, sizeof(astar_mip_level) * count);
+  debugf("astar_mip_build end, %zu levels\n", count);
+  return mip;
+}
+
+void astar_mip_free(astar_mip *mip_ptr) {
+  if (mip_ptr && *mip_ptr) {
+    astar_mip mip = *mip_ptr;
+    for (size_t i = 0; i < mip->level_count; i++) {
+      free(mip->levels[i].walls);
+    }
+    free(mip);
+    *mip_ptr = NULL;
+  }
+}
+
+static inline bitmap_byte overview_blend(bitmap_byte from, bitmap_byte to,
+                                         unsigned weight) {
+  return (bitmap_byte)((from * (255 - weight) + to * weight + 127) / 255);
+}
+
+static void overview_render_rows(void *context, size_t begin, size_t end) {
+  overview_render *render = (overview_render *)context;
+  const astar_mip_level *level = render->level;
+  bitmap_image image = render->image;
+  bitmap_color searched = OVERVIEW_SEARCHED_COLOR;
+  bitmap_color path = OVERVIEW_PATH_COLOR;
+  for (size_t y = begin; y < end; y++) {
+    size_t row = render->row + y * render->rows / image->height;
+    size_t level_row = row >> render->shift;
+    bitmap_byte *ptr = bitmap_row(image, y);
+    if (level_row >= level->rows) {
+      bitmap_fill_span(ptr, BITMAP_BLACK, image->width);
+      continue;
+    }
+    size_t offset = level_row * level->cols;
+    const bitmap_byte *walls = level->walls + offset;
+    const bitmap_byte *searched_row = level->searched + offset;
+    const bitmap_byte *path_row = level->path + offset;
+    for (size_t x = 0; x < image->width; x++, ptr += BYTES_PER_PIXEL) {
+      size_t level_col =
+          (render->col + x * render->cols / image->width) >> render->shift;
+      if (level_col >= level->cols) {
+        ptr[0] = ptr[1] = ptr[2] = 0;
+        continue;
+      }
+      if (path_row[level_col]) {
+        ptr[2] = path.red;
+        ptr[1] = path.green;
+        ptr[0] = path.blue;
+        continue;
+      }
+      // white for empty down to grey for walls, then tinted by the search
+      bitmap_byte base = (bitmap_byte)(255 - (walls[level_col] + 1) / 2);
+      unsigned weight = searched_row[level_col] / 2;
+      ptr[2] = overview_blend(base, searched.red, weight);
+      ptr[1] = overview_blend(base, searched.green, weight);
+      ptr[0] = overview_blend(base, searched.blue, weight);
+    }
+  }
+}
+
+bitmap_image astar_mip_render(const astar_mip mip, size_t row, size_t col,
+                              size_t rows, size_t cols, size_t width,
+                              size_t height) {
+  if (!width || !height || !rows || !cols) {
+    return bitmap_new(width, height);
+  }
+  // the coarsest level whose samples are still no larger than a pixel
+  size_t cells_per_pixel = rows / height > cols / width ? rows / height
+                                                        : cols / width;
+  size_t shift = 0;
+  while (shift + 1 < mip->level_count &&
+         ((size_t)2 << shift) <= cells_per_pixel) {
+    shift++;
+  }
+  overview_render render = {mip->levels + shift, shift, row, col, rows, cols,
+                            bitmap_alloc(width, height)};
+  parallel_for(0, height, overview_render_rows, &render);
+  return render.image;
+}
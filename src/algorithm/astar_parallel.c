@@ -0,0 +1,451 @@
+#include "algorithm/astar_parallel.h"
+#include "algorithm/astar.h"
+#include "algorithm/astar_prune.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/debug.h"
+#include "util/parallel.h"
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Open cell of a worker, ordered by predict_cost then deepest first.
+typedef struct __astar_parallel_node {
+  aster_cost_t predict_cost;
+  aster_cost_t paid_cost; /// stale when the state has become cheaper
+  size_t pos;
+} astar_parallel_node;
+
+/// A cell reached through another thread's cell.
+typedef struct __astar_parallel_item {
+  size_t pos;
+  aster_cost_t paid_cost;
+  direction_t direction;
+} astar_parallel_item;
+
+typedef struct __astar_parallel_batch {
+  struct __astar_parallel_batch *next;
+  size_t count;
+  astar_parallel_item items[ASTAR_PARALLEL_BATCH];
+} astar_parallel_batch;
+
+struct __astar_parallel_shared;
+
+/// One thread: the owner of the cells of its blocks. Both members written
+/// by other threads or by this one sit on their own cache lines.
+typedef struct __astar_parallel_worker {
+  _Alignas(64) _Atomic(astar_parallel_batch *) inbox;
+  _Alignas(64) struct __astar_parallel_shared *shared;
+  size_t index;
+  pthread_t thread;
+  astar_parallel_node *heap;
+  size_t heap_size;
+  size_t heap_capacity;
+  astar_parallel_batch **outboxes; /// batch being filled for each thread
+  point *touched;                  /// cells this thread marked
+  size_t touched_count;
+  size_t touched_capacity;
+  size_t expansions;
+  size_t reexpansions;
+  size_t messages;
+  size_t batches;
+} astar_parallel_worker;
+
+typedef struct __astar_parallel_shared {
+  astar_context astar;
+  size_t threads;
+  size_t block_cols; /// blocks in a row of the map
+  size_t end_pos;    /// SIZE_MAX when the end is off the map
+  double factor;     /// of the estimate, at most 1
+  bool oversubscribed; /// more threads than processors
+  _Alignas(64) _Atomic size_t active; /// busy workers and batches in flight
+  _Alignas(64) _Atomic uint64_t incumbent; /// bits of the best path cost
+  _Atomic bool started;
+  astar_parallel_worker *workers;
+} astar_parallel_shared;
+
+static inline aster_cost_t astar_parallel_incumbent(
+    astar_parallel_shared *shared) {
+  uint64_t bits =
+      atomic_load_explicit(&shared->incumbent, memory_order_relaxed);
+  aster_cost_t cost;
+  memcpy(&cost, &bits, sizeof(cost));
+  return cost;
+}
+
+static void astar_parallel_lower_incumbent(astar_parallel_shared *shared,
+                                           aster_cost_t cost) {
+  uint64_t bits;
+  memcpy(&bits, &cost, sizeof(bits));
+  uint64_t current =
+      atomic_load_explicit(&shared->incumbent, memory_order_relaxed);
+  for (;;) {
+    aster_cost_t current_cost;
+    memcpy(&current_cost, &current, sizeof(current_cost));
+    if (current_cost <= cost ||
+        atomic_compare_exchange_weak_explicit(&shared->incumbent, &current,
+                                              bits, memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+/// Thread owning the block of (row, col).
+static inline size_t astar_parallel_owner(const astar_parallel_shared *shared,
+                                          size_t row, size_t col) {
+  uint64_t block = (uint64_t)(row >> ASTAR_PARALLEL_BLOCK_BITS) *
+                       shared->block_cols +
+                   (col >> ASTAR_PARALLEL_BLOCK_BITS);
+  return (size_t)((block * 0x9e3779b97f4a7c15ull) >> 32) % shared->threads;
+}
+
+static inline bool astar_parallel_before(const astar_parallel_node *left,
+                                         const astar_parallel_node *right) {
+  if (left->predict_cost != right->predict_cost) {
+    return left->predict_cost < right->predict_cost;
+  }
+  return left->paid_cost > right->paid_cost;
+}
+
+static void astar_parallel_heap_push(astar_parallel_worker *worker,
+                                     astar_parallel_node node) {
+  if (worker->heap_size == worker->heap_capacity) {
+    worker->heap_capacity *= 2;
+    worker->heap = (astar_parallel_node *)realloc(
+        worker->heap, sizeof(astar_parallel_node) * worker->heap_capacity);
+  }
+  astar_parallel_node *heap = worker->heap;
+  size_t i = worker->heap_size++;
+  while (i > 0 && astar_parallel_before(&node, heap + (i - 1) / 2)) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = node;
+}
+
+static astar_parallel_node astar_parallel_heap_pop(
+    astar_parallel_worker *worker) {
+  astar_parallel_node *heap = worker->heap;
+  astar_parallel_node top = heap[0];
+  astar_parallel_node last = heap[--worker->heap_size];
+  size_t size = worker->heap_size, i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && astar_parallel_before(heap + child + 1,
+                                                  heap + child)) {
+      child++;
+    }
+    if (!astar_parallel_before(heap + child, &last)) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+/// Offers the owned cell at `pos` the cost `paid_cost` from `direction`.
+static void astar_parallel_relax(astar_parallel_worker *worker, size_t pos,
+                                 aster_cost_t paid_cost,
+                                 direction_t direction) {
+  astar_parallel_shared *shared = worker->shared;
+  astar_context astar = shared->astar;
+  astar_point_state *state = astar->states + pos;
+  if (state->marked && state->paid_cost <= paid_cost) {
+    return;
+  }
+  point pt = {pos / astar->map->cols, pos % astar->map->cols};
+  if (!state->marked) {
+    state->marked = true;
+    if (worker->touched_count == worker->touched_capacity) {
+      worker->touched_capacity *= 2;
+      worker->touched = (point *)realloc(
+          worker->touched, sizeof(point) * worker->touched_capacity);
+    }
+    worker->touched[worker->touched_count++] = pt;
+  }
+  state->paid_cost = paid_cost;
+  state->direction = direction;
+  state->predict_cost =
+      paid_cost + astar_estimate_cost(&pt, &astar->end_point) * shared->factor;
+  if (pos == shared->end_pos) {
+    // the end is never expanded, its cost bounds every other cell
+    astar_parallel_lower_incumbent(shared, paid_cost);
+  } else if (state->predict_cost < astar_parallel_incumbent(shared)) {
+    astar_parallel_heap_push(
+        worker, (astar_parallel_node){state->predict_cost, paid_cost, pos});
+  }
+}
+
+/// Hands the batch for `owner` over to it.
+static void astar_parallel_send_batch(astar_parallel_worker *worker,
+                                      size_t owner) {
+  astar_parallel_batch *batch = worker->outboxes[owner];
+  astar_parallel_worker *receiver = worker->shared->workers + owner;
+  worker->outboxes[owner] = NULL;
+  worker->batches++;
+  // in flight from here until the receiver has relaxed its cells
+  atomic_fetch_add(&worker->shared->active, 1);
+  batch->next = atomic_load_explicit(&receiver->inbox, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+      &receiver->inbox, &batch->next, batch, memory_order_release,
+      memory_order_relaxed)) {
+  }
+}
+
+static void astar_parallel_send(astar_parallel_worker *worker, size_t owner,
+                                astar_parallel_item item) {
+  astar_parallel_batch *batch = worker->outboxes[owner];
+  if (!batch) {
+    batch = (astar_parallel_batch *)malloc(sizeof(*batch));
+    batch->count = 0;
+    worker->outboxes[owner] = batch;
+  }
+  batch->items[batch->count++] = item;
+  worker->messages++;
+  if (batch->count == ASTAR_PARALLEL_BATCH) {
+    astar_parallel_send_batch(worker, owner);
+  }
+}
+
+static void astar_parallel_flush(astar_parallel_worker *worker) {
+  for (size_t owner = 0; owner < worker->shared->threads; owner++) {
+    if (worker->outboxes[owner]) {
+      astar_parallel_send_batch(worker, owner);
+    }
+  }
+}
+
+/// Relaxes the cells of every batch received so far.
+static void astar_parallel_receive(astar_parallel_worker *worker) {
+  astar_parallel_batch *batch = atomic_exchange_explicit(
+      &worker->inbox, NULL, memory_order_acquire);
+  size_t received = 0;
+  while (batch) {
+    for (size_t i = 0; i < batch->count; i++) {
+      astar_parallel_item *item = batch->items + i;
+      astar_parallel_relax(worker, item->pos, item->paid_cost,
+                           item->direction);
+    }
+    astar_parallel_batch *next = batch->next;
+    free(batch);
+    batch = next;
+    received++;
+  }
+  if (received) {
+    atomic_fetch_sub(&worker->shared->active, received);
+  }
+}
+
+static void astar_parallel_expand(astar_parallel_worker *worker, size_t pos,
+                                  aster_cost_t paid_cost) {
+  astar_parallel_shared *shared = worker->shared;
+  astar_context astar = shared->astar;
+  tile_map map = astar->map;
+  astar_point_state *state = astar->states + pos;
+  worker->expansions++;
+  worker->reexpansions += state->visited;
+  state->visited = true;
+  aster_cost_t incumbent = astar_parallel_incumbent(shared);
+  size_t row = pos / map->cols, col = pos % map->cols;
+  for (direction_t *d = direction_start(); d != direction_end();
+       d = direction_next(d)) {
+    size_t r = row + *d / 3 - 1, c = col + *d % 3 - 1;
+    size_t next = r * map->cols + c;
+    // wraps around past 0 as well
+    if (r >= map->rows || c >= map->cols ||
+        tile_map_pos_get(map, next) != TILE_EMPTY ||
+        (astar->pruning &&
+         astar_prune_skip(astar->prune, &astar->prune_query, next))) {
+      continue;
+    }
+    aster_cost_t next_cost = paid_cost + direction_cost(*d);
+    point next_pt = {r, c};
+    if (next_cost + astar_estimate_cost(&next_pt, &astar->end_point) *
+                        shared->factor >=
+        incumbent) {
+      continue;
+    }
+    size_t owner = astar_parallel_owner(shared, r, c);
+    if (owner == worker->index) {
+      astar_parallel_relax(worker, next, next_cost, *d);
+    } else {
+      astar_parallel_send(worker, owner,
+                          (astar_parallel_item){next, next_cost, *d});
+    }
+  }
+}
+
+/// Expands the best open cell cheaper than the incumbent, false when there
+/// is none.
+static bool astar_parallel_expand_next(astar_parallel_worker *worker) {
+  astar_context astar = worker->shared->astar;
+  while (worker->heap_size) {
+    if (worker->heap[0].predict_cost >=
+        astar_parallel_incumbent(worker->shared)) {
+      worker->heap_size = 0; // the incumbent only gets lower
+      return false;
+    }
+    astar_parallel_node node = astar_parallel_heap_pop(worker);
+    if (node.paid_cost == astar->states[node.pos].paid_cost) {
+      astar_parallel_expand(worker, node.pos, node.paid_cost);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *astar_parallel_work(void *arg) {
+  astar_parallel_worker *worker = (astar_parallel_worker *)arg;
+  astar_parallel_shared *shared = worker->shared;
+  while (!atomic_load_explicit(&shared->started, memory_order_acquire)) {
+    sched_yield();
+  }
+  size_t since_flush = 0;
+  for (;;) {
+    if (atomic_load_explicit(&worker->inbox, memory_order_relaxed)) {
+      astar_parallel_receive(worker);
+    }
+    if (astar_parallel_expand_next(worker)) {
+      if (++since_flush == ASTAR_PARALLEL_FLUSH_INTERVAL) {
+        astar_parallel_flush(worker);
+        since_flush = 0;
+        if (shared->oversubscribed) {
+          sched_yield();
+        }
+      }
+      continue;
+    }
+    astar_parallel_flush(worker);
+    since_flush = 0;
+    if (atomic_load_explicit(&worker->inbox, memory_order_relaxed)) {
+      continue;
+    }
+    // idle: a batch for this thread keeps the counter above zero until it
+    // is relaxed, so the counter reaches zero only once all work is done
+    atomic_fetch_sub(&shared->active, 1);
+    for (;;) {
+      if (atomic_load_explicit(&worker->inbox, memory_order_relaxed)) {
+        atomic_fetch_add(&shared->active, 1);
+        break;
+      }
+      if (atomic_load(&shared->active) == 0) {
+        return NULL;
+      }
+      sched_yield();
+    }
+  }
+}
+
+void astar_parallel_search(astar_context astar, size_t threads,
+                           astar_parallel_stats *stats) {
+  tile_map map = astar->map;
+  threads = threads ? threads : parallel_threads();
+  astar_parallel_shared shared;
+  shared.astar = astar;
+  shared.threads = threads;
+  shared.block_cols =
+      (map->cols + ASTAR_PARALLEL_BLOCK - 1) >> ASTAR_PARALLEL_BLOCK_BITS;
+  shared.end_pos = tile_map_contains(map, astar->end_point)
+                       ? tile_map_pos(map, astar->end_point.row,
+                                      astar->end_point.col)
+                       : SIZE_MAX;
+  shared.factor =
+      astar->estimate_cost_factor < 1 ? astar->estimate_cost_factor : 1;
+  aster_cost_t unreached = HUGE_VAL;
+  uint64_t unreached_bits;
+  memcpy(&unreached_bits, &unreached, sizeof(unreached_bits));
+  atomic_init(&shared.incumbent, unreached_bits);
+  atomic_init(&shared.started, false);
+  size_t workers_size = sizeof(astar_parallel_worker) * threads;
+  shared.workers = (astar_parallel_worker *)aligned_alloc(
+      64, (workers_size + 63) / 64 * 64);
+  for (size_t i = 0; i < threads; i++) {
+    astar_parallel_worker *worker = shared.workers + i;
+    atomic_init(&worker->inbox, NULL);
+    worker->shared = &shared;
+    worker->index = i;
+    worker->heap_size = 0;
+    worker->heap_capacity = 1024;
+    worker->heap = (astar_parallel_node *)malloc(sizeof(astar_parallel_node) *
+                                                 worker->heap_capacity);
+    worker->outboxes = (astar_parallel_batch **)calloc(
+        threads, sizeof(astar_parallel_batch *));
+    worker->touched_count = 0;
+    worker->touched_capacity = 1024;
+    worker->touched =
+        (point *)malloc(sizeof(point) * worker->touched_capacity);
+    worker->expansions = 0;
+    worker->reexpansions = 0;
+    worker->messages = 0;
+    worker->batches = 0;
+  }
+
+  // workers wait for the final thread count, which owns the cells
+  size_t started = 1;
+  while (started < threads &&
+         !pthread_create(&shared.workers[started].thread, NULL,
+                         astar_parallel_work, shared.workers + started)) {
+    started++;
+  }
+  if (started < threads) {
+    debugf("astar_parallel_search started %zu of %zu threads\n", started,
+           threads);
+    shared.threads = started;
+  }
+  atomic_init(&shared.active, shared.threads);
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  shared.oversubscribed = processors > 0 && shared.threads > (size_t)processors;
+  if (tile_map_contains(map, astar->start_point)) {
+    point *start = &astar->start_point;
+    astar_parallel_relax(
+        shared.workers + astar_parallel_owner(&shared, start->row, start->col),
+        tile_map_pos(map, start->row, start->col), 0, DIRECTION_NONE);
+  }
+  atomic_store_explicit(&shared.started, true, memory_order_release);
+  astar_parallel_work(shared.workers);
+  for (size_t i = 1; i < started; i++) {
+    pthread_join(shared.workers[i].thread, NULL);
+  }
+
+  // every touched state is of a point once queued, see astar_reset
+  astar->queue_start = astar->queue;
+  astar->queue_end = astar->queue;
+  astar_parallel_stats totals = {shared.threads, 0, 0, 0, 0, 0};
+  for (size_t i = 0; i < threads; i++) {
+    astar_parallel_worker *worker = shared.workers + i;
+    memcpy(astar->queue_end, worker->touched,
+           sizeof(point) * worker->touched_count);
+    astar->queue_end += worker->touched_count;
+    totals.expansions += worker->expansions;
+    totals.reexpansions += worker->reexpansions;
+    totals.messages += worker->messages;
+    totals.batches += worker->batches;
+    if (worker->expansions > totals.busiest) {
+      totals.busiest = worker->expansions;
+    }
+    free(worker->heap);
+    free(worker->outboxes);
+    free(worker->touched);
+  }
+  free(shared.workers);
+  astar->iteration = totals.expansions;
+  astar->state = astar_parallel_incumbent(&shared) < unreached
+                     ? ASTAR_SUCCEEDED
+                     : ASTAR_FAILED;
+  if (stats) {
+    *stats = totals;
+  }
+}
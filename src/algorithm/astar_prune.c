@@ -0,0 +1,468 @@
+#include "algorithm/astar_prune.h"
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/parallel.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASTAR_PRUNE_RING 8
+/// Swamp rounds stop here even if tiles could still be removed, any prefix
+/// of the removals keeps the distances.
+#define ASTAR_PRUNE_MAX_ROUNDS 4096
+#define ASTAR_PRUNE_EPSILON 1e-9
+#define ASTAR_PRUNE_COUNT_BLOCK 4096
+
+/// Directions of the 8 neighbours, bit i of a ring mask is direction i.
+static const direction_t astar_prune_directions[ASTAR_PRUNE_RING] = {
+    DIRECTION_NORTH_WEST, DIRECTION_NORTH,      DIRECTION_NORTH_EAST,
+    DIRECTION_WEST,       DIRECTION_EAST,       DIRECTION_SOUTH_WEST,
+    DIRECTION_SOUTH,      DIRECTION_SOUTH_EAST};
+
+static inline int astar_prune_row_offset(direction_t d) { return d / 3 - 1; }
+static inline int astar_prune_col_offset(direction_t d) { return d % 3 - 1; }
+
+typedef struct __astar_prune_counter {
+  astar_prune prune;
+  const astar_prune_query *query;
+  size_t *counts; /// one per block of ASTAR_PRUNE_COUNT_BLOCK tiles
+} astar_prune_counter;
+
+#define ASTAR_PRUNE_CLASSES 9
+
+/// Growable list of tile positions.
+typedef struct __astar_prune_list {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} astar_prune_list;
+
+typedef struct __astar_prune_build {
+  astar_prune prune;
+  const tile_map map;
+  uint8_t *alive;   /// empty and not removed as swamp
+  uint8_t *pending; /// queued in `classes` or `found`
+  /// tiles to test by class 3 * (row % 3) + col % 3
+  astar_prune_list classes[ASTAR_PRUNE_CLASSES];
+  size_t slots;            /// tasks of a pass
+  astar_prune_list *found; /// tiles queued by each task
+  size_t *removed;         /// removals of each task this round
+  size_t pass;             /// class tested by the running pass
+  bool redundant[1 << ASTAR_PRUNE_RING];
+} astar_prune_build;
+
+/// redundant[mask]: with the neighbours in `mask` left, any two of them are
+/// as close through the others as through the center tile.
+static void astar_prune_redundant_table(bool *redundant) {
+  for (unsigned mask = 0; mask < 1u << ASTAR_PRUNE_RING; mask++) {
+    aster_cost_t distance[ASTAR_PRUNE_RING][ASTAR_PRUNE_RING];
+    for (size_t a = 0; a < ASTAR_PRUNE_RING; a++) {
+      for (size_t b = 0; b < ASTAR_PRUNE_RING; b++) {
+        direction_t da = astar_prune_directions[a];
+        direction_t db = astar_prune_directions[b];
+        int rows = abs(astar_prune_row_offset(da) - astar_prune_row_offset(db));
+        int cols = abs(astar_prune_col_offset(da) - astar_prune_col_offset(db));
+        distance[a][b] = a == b ? 0 : 1e30;
+        if (a != b && (mask >> a & 1) && (mask >> b & 1) && rows <= 1 &&
+            cols <= 1) {
+          distance[a][b] =
+              rows && cols ? ASTAR_DIAGONAL_COST : ASTAR_PARALLEL_COST;
+        }
+      }
+    }
+    for (size_t k = 0; k < ASTAR_PRUNE_RING; k++) {
+      for (size_t a = 0; a < ASTAR_PRUNE_RING; a++) {
+        for (size_t b = 0; b < ASTAR_PRUNE_RING; b++) {
+          if (distance[a][k] + distance[k][b] < distance[a][b]) {
+            distance[a][b] = distance[a][k] + distance[k][b];
+          }
+        }
+      }
+    }
+    bool keeps = true;
+    for (size_t a = 0; a < ASTAR_PRUNE_RING && keeps; a++) {
+      for (size_t b = a + 1; b < ASTAR_PRUNE_RING && keeps; b++) {
+        if ((mask >> a & 1) && (mask >> b & 1)) {
+          aster_cost_t through =
+              direction_cost(astar_prune_directions[a]) +
+              direction_cost(astar_prune_directions[b]);
+          keeps = distance[a][b] <= through + ASTAR_PRUNE_EPSILON;
+        }
+      }
+    }
+    redundant[mask] = keeps;
+  }
+}
+
+static void astar_prune_fill(void *context, size_t begin, size_t end) {
+  astar_prune_build *build = (astar_prune_build *)context;
+  for (size_t pos = begin; pos < end; pos++) {
+    bool empty = tile_map_pos_get(build->map, pos) == TILE_EMPTY;
+    build->alive[pos] = empty;
+    build->prune->tiles[pos] = (astar_prune_tile){ASTAR_PRUNE_NONE, 0, 0};
+  }
+}
+
+static unsigned astar_prune_ring(const astar_prune_build *build, size_t row,
+                                 size_t col) {
+  size_t rows = build->prune->rows, cols = build->prune->cols;
+  unsigned mask = 0;
+  for (size_t i = 0; i < ASTAR_PRUNE_RING; i++) {
+    direction_t d = astar_prune_directions[i];
+    size_t r = row + astar_prune_row_offset(d);
+    size_t c = col + astar_prune_col_offset(d);
+    // wraps around past 0 as well
+    if (r < rows && c < cols && build->alive[r * cols + c]) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+}
+
+static void astar_prune_push(astar_prune_list *list, size_t pos) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 64;
+    list->items =
+        (uint32_t *)realloc(list->items, sizeof(uint32_t) * list->capacity);
+  }
+  list->items[list->count++] = (uint32_t)pos;
+}
+
+static size_t astar_prune_class(const astar_prune prune, size_t pos) {
+  return pos / prune->cols % 3 * 3 + pos % prune->cols % 3;
+}
+
+/// Tests a share of the tiles of the class of the pass. Tiles of one class
+/// are at least 3 apart, so no two of them see the same neighbour and the
+/// tasks never write the same tile.
+static void astar_prune_pass(void *context, size_t begin, size_t end) {
+  astar_prune_build *build = (astar_prune_build *)context;
+  size_t rows = build->prune->rows, cols = build->prune->cols;
+  const astar_prune_list *tested = build->classes + build->pass;
+  for (size_t slot = begin; slot < end; slot++) {
+    size_t first = tested->count * slot / build->slots;
+    size_t last = tested->count * (slot + 1) / build->slots;
+    for (size_t i = first; i < last; i++) {
+      size_t pos = tested->items[i];
+      size_t row = pos / cols, col = pos % cols;
+      build->pending[pos] = 0;
+      if (!build->redundant[astar_prune_ring(build, row, col)]) {
+        continue;
+      }
+      build->alive[pos] = 0;
+      build->removed[slot]++;
+      // the neighbours left may have become redundant
+      for (size_t k = 0; k < ASTAR_PRUNE_RING; k++) {
+        direction_t d = astar_prune_directions[k];
+        size_t r = row + astar_prune_row_offset(d);
+        size_t c = col + astar_prune_col_offset(d);
+        size_t next = r * cols + c;
+        if (r < rows && c < cols && build->alive[next] &&
+            !build->pending[next]) {
+          build->pending[next] = 1;
+          astar_prune_push(build->found + slot, next);
+        }
+      }
+    }
+  }
+}
+
+/// Removes swamp tiles until a round removes none. A round tests the queued
+/// tiles class after class, and every removal queues its neighbours.
+static void astar_prune_swamps(astar_prune_build *build) {
+  astar_prune prune = build->prune;
+  size_t size = prune->rows * prune->cols;
+  build->pending = (uint8_t *)malloc(size + 1);
+  memcpy(build->pending, build->alive, size);
+  memset(build->classes, 0, sizeof(build->classes));
+  for (size_t pos = 0; pos < size; pos++) {
+    if (build->alive[pos]) {
+      astar_prune_push(build->classes + astar_prune_class(prune, pos), pos);
+    }
+  }
+  build->slots = parallel_threads();
+  build->found =
+      (astar_prune_list *)calloc(build->slots, sizeof(astar_prune_list));
+  build->removed = (size_t *)calloc(build->slots, sizeof(size_t));
+  bool removed = true;
+  while (removed && prune->rounds < ASTAR_PRUNE_MAX_ROUNDS) {
+    for (build->pass = 0; build->pass < ASTAR_PRUNE_CLASSES; build->pass++) {
+      parallel_for(0, build->slots, astar_prune_pass, build);
+      build->classes[build->pass].count = 0;
+      for (size_t slot = 0; slot < build->slots; slot++) {
+        astar_prune_list *found = build->found + slot;
+        for (size_t i = 0; i < found->count; i++) {
+          size_t pos = found->items[i];
+          astar_prune_push(build->classes + astar_prune_class(prune, pos),
+                           pos);
+        }
+        found->count = 0;
+      }
+    }
+    removed = false;
+    for (size_t slot = 0; slot < build->slots; slot++) {
+      removed = removed || build->removed[slot];
+      build->removed[slot] = 0;
+    }
+    prune->rounds += removed;
+  }
+  for (size_t k = 0; k < ASTAR_PRUNE_CLASSES; k++) {
+    free(build->classes[k].items);
+  }
+  for (size_t slot = 0; slot < build->slots; slot++) {
+    free(build->found[slot].items);
+  }
+  free(build->found);
+  free(build->removed);
+  free(build->pending);
+}
+
+/// Labels the 8-connected regions of removed empty tiles.
+static void astar_prune_label_swamps(astar_prune_build *build,
+                                     uint32_t *stack) {
+  astar_prune prune = build->prune;
+  size_t rows = prune->rows, cols = prune->cols;
+  for (size_t seed = 0; seed < rows * cols; seed++) {
+    if (build->alive[seed] || prune->tiles[seed].order == ASTAR_PRUNE_NONE ||
+        prune->tiles[seed].swamp) {
+      continue;
+    }
+    uint32_t region = (uint32_t)++prune->swamp_count;
+    size_t top = 0;
+    stack[top++] = (uint32_t)seed;
+    prune->tiles[seed].swamp = region;
+    while (top) {
+      size_t pos = stack[--top];
+      size_t row = pos / cols, col = pos % cols;
+      prune->swamp_tiles++;
+      for (size_t i = 0; i < ASTAR_PRUNE_RING; i++) {
+        direction_t d = astar_prune_directions[i];
+        size_t r = row + astar_prune_row_offset(d);
+        size_t c = col + astar_prune_col_offset(d);
+        size_t next = r * cols + c;
+        if (r < rows && c < cols && !build->alive[next] &&
+            prune->tiles[next].order != ASTAR_PRUNE_NONE &&
+            !prune->tiles[next].swamp) {
+          prune->tiles[next].swamp = region;
+          stack[top++] = (uint32_t)next;
+        }
+      }
+    }
+  }
+}
+
+static void astar_prune_add_pocket(astar_prune prune, size_t *capacity,
+                                   uint32_t first, uint32_t end) {
+  if (prune->pocket_count + 1 == *capacity) {
+    *capacity *= 2;
+    prune->pockets = (astar_prune_pocket *)realloc(
+        prune->pockets, sizeof(astar_prune_pocket) * *capacity);
+  }
+  prune->pockets[++prune->pocket_count] = (astar_prune_pocket){first, end};
+}
+
+/// Numbers the empty tiles in depth-first preorder and records the pockets,
+/// with Tarjan's articulation points on an explicit stack. The tiles of a
+/// child subtree form a pocket when no tile in it reaches above the parent.
+static void astar_prune_pockets(astar_prune_build *build, uint32_t *low,
+                                uint32_t *stack, uint8_t *next) {
+  astar_prune prune = build->prune;
+  size_t rows = prune->rows, cols = prune->cols;
+  size_t capacity = 64;
+  prune->pockets =
+      (astar_prune_pocket *)malloc(sizeof(astar_prune_pocket) * capacity);
+  prune->pockets[0] = (astar_prune_pocket){0, 0};
+  uint32_t counter = 0;
+  for (size_t root = 0; root < rows * cols; root++) {
+    if (!build->alive[root] || prune->tiles[root].order != ASTAR_PRUNE_NONE) {
+      continue;
+    }
+    size_t root_children = 0;
+    size_t top = 0;
+    stack[top++] = (uint32_t)root;
+    prune->tiles[root].order = low[root] = counter++;
+    next[root] = 0;
+    while (top) {
+      size_t pos = stack[top - 1];
+      if (next[pos] < ASTAR_PRUNE_RING) {
+        direction_t d = astar_prune_directions[next[pos]++];
+        size_t r = pos / cols + astar_prune_row_offset(d);
+        size_t c = pos % cols + astar_prune_col_offset(d);
+        size_t child = r * cols + c;
+        if (r >= rows || c >= cols || !build->alive[child]) {
+          continue;
+        }
+        uint32_t order = prune->tiles[child].order;
+        if (order == ASTAR_PRUNE_NONE) {
+          prune->tiles[child].order = low[child] = counter++;
+          next[child] = 0;
+          stack[top++] = (uint32_t)child;
+        } else if (order < low[pos]) {
+          low[pos] = order;
+        }
+        continue;
+      }
+      top--;
+      if (!top) {
+        break;
+      }
+      size_t parent = stack[top - 1];
+      if (low[pos] < low[parent]) {
+        low[parent] = low[pos];
+      }
+      if (low[pos] >= prune->tiles[parent].order) {
+        astar_prune_add_pocket(prune, &capacity, prune->tiles[pos].order,
+                               counter);
+      }
+      root_children += parent == root;
+    }
+    // the only subtree of a root is not cut off by it
+    if (root_children == 1) {
+      prune->pocket_count--;
+    }
+  }
+  prune->empty_count = counter;
+}
+
+/// Gives every tile its innermost pocket, sweeping the preorder with the
+/// pockets open at each position.
+static void astar_prune_innermost(astar_prune prune, uint32_t *tile_at,
+                                  uint32_t *pocket_at) {
+  size_t size = prune->rows * prune->cols;
+  for (size_t pos = 0; pos < size; pos++) {
+    if (prune->tiles[pos].order != ASTAR_PRUNE_NONE) {
+      tile_at[prune->tiles[pos].order] = (uint32_t)pos;
+    }
+  }
+  memset(pocket_at, 0, sizeof(uint32_t) * prune->empty_count);
+  for (size_t p = 1; p <= prune->pocket_count; p++) {
+    pocket_at[prune->pockets[p].first] = (uint32_t)p;
+  }
+  uint32_t *open =
+      (uint32_t *)malloc(sizeof(uint32_t) * (prune->pocket_count + 1));
+  size_t depth = 0;
+  for (uint32_t order = 0; order < prune->empty_count; order++) {
+    while (depth && prune->pockets[open[depth - 1]].end <= order) {
+      depth--;
+    }
+    if (pocket_at[order]) {
+      open[depth++] = pocket_at[order];
+    }
+    if (depth) {
+      prune->tiles[tile_at[order]].pocket = open[depth - 1];
+    }
+  }
+  free(open);
+}
+
+astar_prune astar_prune_new(const tile_map map) {
+  size_t size = map->rows * map->cols;
+  if (size >= UINT32_MAX) {
+    return NULL;
+  }
+  astar_prune prune = (astar_prune)malloc(sizeof(*prune) +
+                                          sizeof(astar_prune_tile) * size);
+  prune->rows = map->rows;
+  prune->cols = map->cols;
+  prune->map_id = map->id;
+  prune->version = map->version;
+  prune->empty_count = 0;
+  prune->pocket_count = 0;
+  prune->swamp_count = 0;
+  prune->swamp_tiles = 0;
+  prune->rounds = 0;
+
+  astar_prune_build build = {
+      .prune = prune,
+      .map = map,
+      .alive = (uint8_t *)malloc(size + 1),
+      .pending = NULL,
+      .classes = {{NULL, 0, 0}},
+      .slots = 0,
+      .found = NULL,
+      .removed = NULL,
+      .pass = 0,
+      .redundant = {false},
+  };
+  astar_prune_redundant_table(build.redundant);
+  parallel_for(0, size, astar_prune_fill, &build);
+  uint32_t *low = (uint32_t *)malloc(sizeof(uint32_t) * (size + 1));
+  uint32_t *stack = (uint32_t *)malloc(sizeof(uint32_t) * (size + 1));
+  uint8_t *next = (uint8_t *)malloc(size + 1);
+  astar_prune_pockets(&build, low, stack, next);
+  free(next);
+  astar_prune_innermost(prune, low, stack);
+  free(low);
+
+  astar_prune_swamps(&build);
+  astar_prune_label_swamps(&build, stack);
+  free(stack);
+  free(build.alive);
+  return prune;
+}
+
+void astar_prune_free(astar_prune *prune_ptr) {
+  if (prune_ptr && *prune_ptr) {
+    free((*prune_ptr)->pockets);
+    free(*prune_ptr);
+    *prune_ptr = NULL;
+  }
+}
+
+bool astar_prune_matches(const astar_prune prune, const tile_map map) {
+  return prune && map && prune->map_id == map->id &&
+         prune->version == map->version && prune->rows == map->rows &&
+         prune->cols == map->cols;
+}
+
+astar_prune_query astar_prune_query_new(const astar_prune prune, point start,
+                                        point end) {
+  astar_prune_query query;
+  point ends[2] = {start, end};
+  for (size_t i = 0; i < 2; i++) {
+    query.order[i] = ASTAR_PRUNE_NONE;
+    query.swamp[i] = 0;
+    if (ends[i].row < prune->rows && ends[i].col < prune->cols) {
+      const astar_prune_tile *tile =
+          prune->tiles + ends[i].row * prune->cols + ends[i].col;
+      query.order[i] = tile->order;
+      query.swamp[i] = tile->swamp;
+    }
+  }
+  return query;
+}
+
+static void astar_prune_count_blocks(void *context, size_t begin, size_t end) {
+  astar_prune_counter *counter = (astar_prune_counter *)context;
+  astar_prune prune = counter->prune;
+  size_t size = prune->rows * prune->cols;
+  for (size_t b = begin; b < end; b++) {
+    size_t last = (b + 1) * ASTAR_PRUNE_COUNT_BLOCK;
+    size_t count = 0;
+    for (size_t pos = b * ASTAR_PRUNE_COUNT_BLOCK; pos < last && pos < size;
+         pos++) {
+      count += prune->tiles[pos].order != ASTAR_PRUNE_NONE &&
+               astar_prune_skip(prune, counter->query, pos);
+    }
+    counter->counts[b] = count;
+  }
+}
+
+size_t astar_prune_count(const astar_prune prune,
+                         const astar_prune_query *query) {
+  size_t size = prune->rows * prune->cols;
+  size_t blocks =
+      (size + ASTAR_PRUNE_COUNT_BLOCK - 1) / ASTAR_PRUNE_COUNT_BLOCK;
+  astar_prune_counter counter = {prune, query,
+                                 (size_t *)malloc(sizeof(size_t) * blocks)};
+  parallel_for(0, blocks, astar_prune_count_blocks, &counter);
+  size_t count = 0;
+  for (size_t b = 0; b < blocks; b++) {
+    count += counter.counts[b];
+  }
+  free(counter.counts);
+  return count;
+}
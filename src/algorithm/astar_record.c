@@ -0,0 +1,165 @@
+#include "algorithm/astar_record.h"
+#include "algorithm/astar.h"
+#include "algorithm/astar_draw_image.h"
+#include "image/bitmap.h"
+#include "struct/bool.h"
+#include "util/debug.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASTAR_RECORD_PATH_SIZE 4096
+#define ASTAR_RECORD_DIRTY_INITIAL 1024
+
+struct __astar_recorder_struct {
+  astar_context astar; /// detached again when the recorder is freed
+  bitmap_image image;  /// persistent frame, patched cell by cell
+  astar_record_format format;
+  char path[ASTAR_RECORD_PATH_SIZE];
+  FILE *raw_file;
+  size_t frame_interval;
+  size_t iteration;   /// frames recorded, written or not
+  size_t frame_count; /// frames written
+  bool pending;       /// changes drawn but not written yet
+  size_t *dirty;      /// positions changed since the last frame
+  size_t dirty_count;
+  size_t dirty_capacity;
+  bool is_dirty[]; /// one flag per cell, dedupes dirty
+};
+
+static void astar_recorder_draw(astar_recorder recorder,
+                                const astar_context astar);
+static bool astar_recorder_write(astar_recorder recorder);
+
+astar_recorder astar_recorder_new(astar_context astar, const char *path,
+                                  astar_record_format format,
+                                  size_t frame_interval) {
+  size_t cells = astar->map->rows * astar->map->cols;
+  astar_recorder recorder =
+      (astar_recorder)malloc(sizeof(*recorder) + sizeof(bool) * cells);
+  memset(recorder->is_dirty, 0, sizeof(bool) * cells);
+  recorder->astar = astar;
+  recorder->image = astar_draw_image(astar);
+  recorder->format = format;
+  snprintf(recorder->path, sizeof(recorder->path), "%s", path);
+  recorder->raw_file = NULL;
+  if (format == ASTAR_RECORD_RAW) {
+    recorder->raw_file = fopen(path, "wb");
+    if (!recorder->raw_file) {
+      debugf("astar_recorder_new cannot open %s\n", path);
+    }
+  }
+  recorder->frame_interval = frame_interval ? frame_interval : 1;
+  recorder->iteration = 0;
+  recorder->frame_count = 0;
+  recorder->pending = true;
+  recorder->dirty_capacity = ASTAR_RECORD_DIRTY_INITIAL;
+  recorder->dirty =
+      (size_t *)malloc(sizeof(size_t) * recorder->dirty_capacity);
+  recorder->dirty_count = 0;
+  astar->recorder = recorder;
+  return recorder;
+}
+
+void astar_recorder_free(astar_recorder *recorder_ptr) {
+  if (recorder_ptr && *recorder_ptr) {
+    astar_recorder recorder = *recorder_ptr;
+    if (recorder->astar && recorder->astar->recorder == recorder) {
+      recorder->astar->recorder = NULL;
+    }
+    if (recorder->raw_file) {
+      fclose(recorder->raw_file);
+    }
+    bitmap_free(&recorder->image);
+    free(recorder->dirty);
+    free(recorder);
+    *recorder_ptr = NULL;
+  }
+}
+
+void astar_recorder_touch(astar_recorder recorder, size_t pos) {
+  if (recorder->is_dirty[pos]) {
+    return;
+  }
+  if (recorder->dirty_count == recorder->dirty_capacity) {
+    recorder->dirty_capacity *= 2;
+    recorder->dirty = (size_t *)realloc(
+        recorder->dirty, sizeof(size_t) * recorder->dirty_capacity);
+  }
+  recorder->is_dirty[pos] = true;
+  recorder->dirty[recorder->dirty_count++] = pos;
+}
+
+bool astar_recorder_frame(astar_recorder recorder, const astar_context astar) {
+  astar_recorder_draw(recorder, astar);
+  if (++recorder->iteration % recorder->frame_interval != 0) {
+    return true;
+  }
+  return astar_recorder_write(recorder);
+}
+
+bool astar_recorder_flush(astar_recorder recorder, const astar_context astar) {
+  astar_recorder_draw(recorder, astar);
+  bool ok = astar_recorder_write(recorder);
+  if (recorder->raw_file) {
+    fflush(recorder->raw_file);
+  }
+  return ok;
+}
+
+size_t astar_recorder_frames(astar_recorder recorder) {
+  return recorder->frame_count;
+}
+
+void astar_recorder_size(astar_recorder recorder, size_t *width,
+                         size_t *height) {
+  *width = recorder->image->width;
+  *height = recorder->image->height;
+}
+
+/// Redraws the cells changed since the last call.
+static void astar_recorder_draw(astar_recorder recorder,
+                                const astar_context astar) {
+  size_t cols = astar->map->cols;
+  for (size_t i = 0; i < recorder->dirty_count; i++) {
+    size_t pos = recorder->dirty[i];
+    astar_draw_cell(recorder->image, astar, pos / cols, pos % cols);
+    recorder->is_dirty[pos] = false;
+  }
+  recorder->pending = recorder->pending || recorder->dirty_count > 0;
+  recorder->dirty_count = 0;
+}
+
+static bool astar_recorder_write(astar_recorder recorder) {
+  if (!recorder->pending) {
+    return true;
+  }
+  recorder->pending = false;
+  bitmap_image image = recorder->image;
+  if (recorder->format == ASTAR_RECORD_RAW) {
+    if (!recorder->raw_file) {
+      return false;
+    }
+    size_t size = image->width * image->height * BYTES_PER_PIXEL;
+    if (fwrite(image->data, 1, size, recorder->raw_file) != size) {
+      return false;
+    }
+  } else {
+    char name[ASTAR_RECORD_PATH_SIZE + 16];
+    snprintf(name, sizeof(name), "%s%06zu.bmp", recorder->path,
+             recorder->frame_count);
+    FILE *file = fopen(name, "wb");
+    if (!file) {
+      debugf("astar_recorder cannot open %s\n", name);
+      return false;
+    }
+    bool ok = bitmap_image_write(image, file);
+    fclose(file);
+    if (!ok) {
+      return false;
+    }
+  }
+  recorder->frame_count++;
+  return true;
+}
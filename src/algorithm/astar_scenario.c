@@ -0,0 +1,110 @@
+#include "algorithm/astar_scenario.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include "util/debug.h"
+#include "util/random.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ASTAR_SCENARIO_INITIAL 256
+#define ASTAR_SCENARIO_NEAR_TRIES 64
+
+static astar_scenario astar_scenario_alloc(size_t capacity) {
+  astar_scenario scenario = (astar_scenario)malloc(
+      sizeof(*scenario) + sizeof(astar_query) * capacity);
+  scenario->count = 0;
+  return scenario;
+}
+
+astar_scenario astar_scenario_random(const tile_map map, size_t count,
+                                     uint64_t seed) {
+  astar_scenario scenario = astar_scenario_alloc(count);
+  tile_empty_index index = tile_empty_index_new(map);
+  for (size_t i = 0; i < count; i++) {
+    astar_query *query = scenario->queries + scenario->count;
+    query->start = tile_empty_index_sample(index, map, seed, 2 * i, NULL);
+    query->end =
+        tile_empty_index_sample(index, map, seed, 2 * i + 1, &query->start);
+    query->optimal_cost = 0;
+    if (tile_map_contains(map, query->start) &&
+        tile_map_contains(map, query->end)) {
+      scenario->count++;
+    }
+  }
+  tile_empty_index_free(&index);
+  return scenario;
+}
+
+astar_scenario astar_scenario_random_near(const tile_map map, size_t count,
+                                          size_t radius, uint64_t seed) {
+  astar_scenario scenario = astar_scenario_alloc(count);
+  tile_empty_index index = tile_empty_index_new(map);
+  uint64_t near_seed = random_split(seed, 1);
+  for (size_t i = 0; i < count; i++) {
+    point start = tile_empty_index_sample(index, map, seed, i, NULL);
+    if (!tile_map_contains(map, start)) {
+      break;
+    }
+    // offsets in [-radius, radius] drawn from their own stream
+    for (size_t t = 0; t < ASTAR_SCENARIO_NEAR_TRIES; t++) {
+      uint64_t counter = (i * ASTAR_SCENARIO_NEAR_TRIES + t) * 2;
+      point end = {
+          start.row + random_below(near_seed, counter, 2 * radius + 1) - radius,
+          start.col + random_below(near_seed, counter + 1, 2 * radius + 1) -
+              radius};
+      if (tile_map_contains(map, end) && !point_equal(start, end) &&
+          tile_map_get(map, end.row, end.col) == TILE_EMPTY) {
+        scenario->queries[scenario->count++] = (astar_query){start, end, 0};
+        break;
+      }
+    }
+  }
+  tile_empty_index_free(&index);
+  return scenario;
+}
+
+astar_scenario astar_scenario_read_movingai(const char *path, size_t limit) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    debugf("astar_scenario_read_movingai cannot open %s\n", path);
+    return NULL;
+  }
+  double version;
+  if (fscanf(file, " version %lf", &version) != 1) {
+    debugf("astar_scenario_read_movingai no version in %s\n", path);
+    fclose(file);
+    return NULL;
+  }
+  size_t capacity = ASTAR_SCENARIO_INITIAL;
+  astar_scenario scenario = astar_scenario_alloc(capacity);
+  size_t bucket, width, height, start_x, start_y, end_x, end_y;
+  double optimal;
+  // bucket, map name, map size, start x y, goal x y, optimal length
+  while (!limit || scenario->count < limit) {
+    if (fscanf(file, "%zu %*s %zu %zu %zu %zu %zu %zu %lf", &bucket, &width,
+               &height, &start_x, &start_y, &end_x, &end_y, &optimal) != 8) {
+      break;
+    }
+    if (scenario->count == capacity) {
+      capacity *= 2;
+      scenario = (astar_scenario)realloc(
+          scenario, sizeof(*scenario) + sizeof(astar_query) * capacity);
+    }
+    astar_query *query = scenario->queries + scenario->count++;
+    query->start = (point){start_y, start_x};
+    query->end = (point){end_y, end_x};
+    query->optimal_cost = optimal;
+  }
+  fclose(file);
+  return scenario;
+}
+
+void astar_scenario_free(astar_scenario *scenario_ptr) {
+  if (scenario_ptr && *scenario_ptr) {
+    free(*scenario_ptr);
+    *scenario_ptr = NULL;
+  }
+}
@@ -0,0 +1,512 @@
+#include "algorithm/astar_service.h"
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/debug.h"
+#include "util/trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ASTAR_SERVICE_READ_SIZE (4 * ASTAR_SERVICE_MAX_MESSAGE)
+// the requests of one read, at most 10922, fit ASTAR_SERVICE_MAX_PENDING
+#define ASTAR_SERVICE_INITIAL_JOBS 1024
+#define ASTAR_SERVICE_INITIAL_STEPS 256
+#define ASTAR_SERVICE_MAX_RUN ((uint32_t)-1 >> ASTAR_SERVICE_STEP_BITS)
+
+void astar_latency_clear(astar_latency *latency) {
+  memset(latency, 0, sizeof(*latency));
+}
+
+/// 0-3 as themselves, then 4 buckets per power of two.
+static size_t astar_latency_bucket(uint64_t ns) {
+  if (ns < 4) {
+    return ns;
+  }
+  size_t exponent = 63 - __builtin_clzll(ns);
+  return 4 * (exponent - 1) + ((ns >> (exponent - 2)) & 3);
+}
+
+static uint64_t astar_latency_lower(size_t bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  size_t exponent = bucket / 4 + 1;
+  return (uint64_t)(4 + bucket % 4) << (exponent - 2);
+}
+
+void astar_latency_add(astar_latency *latency, uint64_t ns) {
+  latency->count++;
+  latency->total_ns += ns;
+  latency->max_ns = ns > latency->max_ns ? ns : latency->max_ns;
+  latency->buckets[astar_latency_bucket(ns)]++;
+}
+
+void astar_latency_merge(astar_latency *into, const astar_latency *from) {
+  into->count += from->count;
+  into->total_ns += from->total_ns;
+  into->max_ns = from->max_ns > into->max_ns ? from->max_ns : into->max_ns;
+  for (size_t i = 0; i < ASTAR_LATENCY_BUCKETS; i++) {
+    into->buckets[i] += from->buckets[i];
+  }
+}
+
+uint64_t astar_latency_percentile(const astar_latency *latency,
+                                  double percent) {
+  uint64_t rank = (uint64_t)(latency->count * percent / 100);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < ASTAR_LATENCY_BUCKETS; i++) {
+    seen += latency->buckets[i];
+    if (seen > rank) {
+      uint64_t upper = astar_latency_lower(i + 1);
+      return upper < latency->max_ns ? upper : latency->max_ns;
+    }
+  }
+  return latency->max_ns;
+}
+
+void astar_latency_write_json(const astar_latency *latency, FILE *file) {
+  fprintf(file,
+          "{\"count\": %llu, \"mean_ns\": %.0f, \"p50_ns\": %llu, "
+          "\"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, "
+          "\"buckets\": [",
+          (unsigned long long)latency->count,
+          latency->count ? (double)latency->total_ns / latency->count : 0.0,
+          (unsigned long long)astar_latency_percentile(latency, 50),
+          (unsigned long long)astar_latency_percentile(latency, 90),
+          (unsigned long long)astar_latency_percentile(latency, 99),
+          (unsigned long long)latency->max_ns);
+  bool first = true;
+  for (size_t i = 0; i < ASTAR_LATENCY_BUCKETS; i++) {
+    if (latency->buckets[i]) {
+      fprintf(file, "%s[%llu, %llu]", first ? "" : ", ",
+              (unsigned long long)astar_latency_lower(i + 1),
+              (unsigned long long)latency->buckets[i]);
+      first = false;
+    }
+  }
+  fprintf(file, "]}");
+}
+
+bool astar_service_read_all(int fd, void *buffer, size_t size) {
+  char *bytes = (char *)buffer;
+  while (size) {
+    ssize_t done = read(fd, bytes, size);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      return false;
+    }
+    bytes += done;
+    size -= done;
+  }
+  return true;
+}
+
+bool astar_service_write_all(int fd, const void *buffer, size_t size) {
+  const char *bytes = (const char *)buffer;
+  while (size) {
+    ssize_t done = write(fd, bytes, size);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      return false;
+    }
+    bytes += done;
+    size -= done;
+  }
+  return true;
+}
+
+typedef struct __astar_service_connection {
+  int out;
+  pthread_mutex_t write_lock; /// serializes writes to `out`
+  bool broken;
+  // apart from the write lock, so that the reader goes on queueing while a
+  // worker waits for the peer to read responses
+  pthread_mutex_t lock;
+  pthread_cond_t retired; /// signalled whenever requests are answered
+  size_t pending;         /// requests queued or being solved
+} astar_service_connection;
+
+typedef struct __astar_service_job {
+  astar_service_connection *connection;
+  astar_service_request request;
+  uint64_t received_ns;
+} astar_service_job;
+
+typedef struct __astar_service_worker {
+  astar_service service;
+  pthread_t thread;
+  astar_context astar;
+  astar_path_step *steps;
+  size_t step_capacity;
+  char *output; /// responses of the current batch to one connection
+  size_t output_size;
+  size_t output_capacity;
+  pthread_mutex_t stats_lock;
+  astar_latency latency;
+  size_t solved;
+  size_t failed;
+  size_t rejected; /// endpoints off the map or not empty
+} astar_service_worker;
+
+struct __astar_service_struct {
+  tile_map map; /// read by every worker
+  size_t batch;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  astar_service_job *jobs; /// ring of queued requests
+  size_t job_capacity;
+  size_t job_head;
+  size_t job_count;
+  bool stopping;
+  size_t malformed; /// connections closed on a bad message
+  size_t worker_count;
+  astar_service_worker workers[];
+};
+
+/// Appends `size` bytes to the output of a worker.
+static void astar_service_output(astar_service_worker *worker,
+                                 const void *bytes, size_t size) {
+  if (worker->output_size + size > worker->output_capacity) {
+    while (worker->output_size + size > worker->output_capacity) {
+      worker->output_capacity *= 2;
+    }
+    worker->output = (char *)realloc(worker->output, worker->output_capacity);
+  }
+  memcpy(worker->output + worker->output_size, bytes, size);
+  worker->output_size += size;
+}
+
+static bool astar_service_endpoint(const tile_map map, point pt) {
+  return tile_map_contains(map, pt) &&
+         tile_map_get(map, pt.row, pt.col) == TILE_EMPTY;
+}
+
+static void astar_service_solve(astar_service_worker *worker,
+                                const astar_service_job *job) {
+  astar_context astar = worker->astar;
+  const astar_service_request *request = &job->request;
+  point start = {request->start_row, request->start_col};
+  point end = {request->end_row, request->end_col};
+  astar_service_response response = {request->id, ASTAR_FAILED, 0, 0, 0, 0};
+  size_t steps = 0;
+  bool valid = astar_service_endpoint(astar->map, start) &&
+               astar_service_endpoint(astar->map, end);
+  if (valid) {
+    astar_reset(astar, start, end);
+    response.state = astar_resolve(astar);
+    steps = astar_path_steps(astar, worker->steps, worker->step_capacity);
+    if (steps > worker->step_capacity) {
+      worker->step_capacity = steps;
+      worker->steps = (astar_path_step *)realloc(
+          worker->steps, sizeof(astar_path_step) * steps);
+      astar_path_steps(astar, worker->steps, worker->step_capacity);
+    }
+    if (response.state == ASTAR_SUCCEEDED) {
+      response.path_length = astar->path_length;
+      response.cost = astar->path_cost;
+    }
+  }
+
+  // runs longer than a step can hold are split
+  for (size_t i = 0; i < steps; i++) {
+    response.step_count += (worker->steps[i].count + ASTAR_SERVICE_MAX_RUN -
+                            1) / ASTAR_SERVICE_MAX_RUN;
+  }
+  uint64_t latency = trace_clock_ns() - job->received_ns;
+  response.latency_ns = latency;
+  uint32_t length = sizeof(response) + sizeof(uint32_t) * response.step_count;
+  astar_service_output(worker, &length, sizeof(length));
+  astar_service_output(worker, &response, sizeof(response));
+  for (size_t i = 0; i < steps; i++) {
+    for (size_t left = worker->steps[i].count; left;) {
+      uint32_t count = left < ASTAR_SERVICE_MAX_RUN ? (uint32_t)left
+                                                    : ASTAR_SERVICE_MAX_RUN;
+      uint32_t run = count << ASTAR_SERVICE_STEP_BITS |
+                     worker->steps[i].direction;
+      astar_service_output(worker, &run, sizeof(run));
+      left -= count;
+    }
+  }
+
+  pthread_mutex_lock(&worker->stats_lock);
+  astar_latency_add(&worker->latency, latency);
+  if (response.state == ASTAR_SUCCEEDED) {
+    worker->solved++;
+  } else if (valid) {
+    worker->failed++;
+  } else {
+    worker->rejected++;
+  }
+  pthread_mutex_unlock(&worker->stats_lock);
+}
+
+/// Sends the output of a worker and retires its `count` requests.
+static void astar_service_flush(astar_service_worker *worker,
+                                astar_service_connection *connection,
+                                size_t count) {
+  pthread_mutex_lock(&connection->write_lock);
+  if (!connection->broken &&
+      !astar_service_write_all(connection->out, worker->output,
+                               worker->output_size)) {
+    connection->broken = true;
+  }
+  pthread_mutex_unlock(&connection->write_lock);
+  worker->output_size = 0;
+  pthread_mutex_lock(&connection->lock);
+  connection->pending -= count;
+  pthread_cond_signal(&connection->retired);
+  // the connection may be gone once unlocked
+  pthread_mutex_unlock(&connection->lock);
+}
+
+static void *astar_service_work(void *arg) {
+  astar_service_worker *worker = (astar_service_worker *)arg;
+  astar_service service = worker->service;
+  astar_service_job *batch =
+      (astar_service_job *)malloc(sizeof(astar_service_job) * service->batch);
+  while (true) {
+    pthread_mutex_lock(&service->lock);
+    while (!service->job_count && !service->stopping) {
+      pthread_cond_wait(&service->ready, &service->lock);
+    }
+    if (!service->job_count) {
+      pthread_mutex_unlock(&service->lock);
+      break;
+    }
+    size_t count = service->job_count < service->batch ? service->job_count
+                                                       : service->batch;
+    for (size_t i = 0; i < count; i++) {
+      batch[i] = service->jobs[service->job_head];
+      service->job_head = (service->job_head + 1) % service->job_capacity;
+    }
+    service->job_count -= count;
+    pthread_mutex_unlock(&service->lock);
+
+    size_t first = 0;
+    for (size_t i = 0; i < count; i++) {
+      astar_service_solve(worker, batch + i);
+      if (i + 1 == count || batch[i + 1].connection != batch[i].connection) {
+        astar_service_flush(worker, batch[i].connection, i + 1 - first);
+        first = i + 1;
+      }
+    }
+  }
+  free(batch);
+  return NULL;
+}
+
+astar_service astar_service_new(const tile_map map, size_t workers,
+                                size_t batch, bool expand_kernel) {
+  workers = workers ? workers : 1;
+  astar_service service = (astar_service)malloc(
+      sizeof(*service) + sizeof(astar_service_worker) * workers);
+  service->map = tile_map_new(map->rows, map->cols);
+  for (size_t pos = 0; pos < map->rows * map->cols; pos++) {
+    tile_map_pos_set(service->map, pos, tile_map_pos_get(map, pos));
+  }
+  service->batch = batch ? batch : 1;
+  pthread_mutex_init(&service->lock, NULL);
+  pthread_cond_init(&service->ready, NULL);
+  service->job_capacity = ASTAR_SERVICE_INITIAL_JOBS;
+  service->jobs = (astar_service_job *)malloc(sizeof(astar_service_job) *
+                                              service->job_capacity);
+  service->job_head = 0;
+  service->job_count = 0;
+  service->stopping = false;
+  service->malformed = 0;
+  service->worker_count = workers;
+  for (size_t i = 0; i < workers; i++) {
+    astar_service_worker *worker = service->workers + i;
+    worker->service = service;
+    worker->astar = astar_init(service->map, (point){0, 0}, (point){0, 0});
+    astar_set_owns_map(worker->astar, false);
+    astar_set_expand_kernel(worker->astar, expand_kernel);
+    worker->step_capacity = ASTAR_SERVICE_INITIAL_STEPS;
+    worker->steps = (astar_path_step *)malloc(sizeof(astar_path_step) *
+                                              worker->step_capacity);
+    worker->output_capacity = ASTAR_SERVICE_MAX_MESSAGE;
+    worker->output = (char *)malloc(worker->output_capacity);
+    worker->output_size = 0;
+    pthread_mutex_init(&worker->stats_lock, NULL);
+    astar_latency_clear(&worker->latency);
+    worker->solved = 0;
+    worker->failed = 0;
+    worker->rejected = 0;
+    pthread_create(&worker->thread, NULL, astar_service_work, worker);
+  }
+  return service;
+}
+
+void astar_service_free(astar_service *service_ptr) {
+  if (service_ptr && *service_ptr) {
+    astar_service service = *service_ptr;
+    pthread_mutex_lock(&service->lock);
+    service->stopping = true;
+    pthread_cond_broadcast(&service->ready);
+    pthread_mutex_unlock(&service->lock);
+    for (size_t i = 0; i < service->worker_count; i++) {
+      astar_service_worker *worker = service->workers + i;
+      pthread_join(worker->thread, NULL);
+      astar_free(&worker->astar);
+      free(worker->steps);
+      free(worker->output);
+      pthread_mutex_destroy(&worker->stats_lock);
+    }
+    tile_map_free(&service->map);
+    free(service->jobs);
+    pthread_cond_destroy(&service->ready);
+    pthread_mutex_destroy(&service->lock);
+    free(service);
+    *service_ptr = NULL;
+  }
+}
+
+static void astar_service_queue(astar_service service,
+                                const astar_service_job *jobs, size_t count) {
+  pthread_mutex_lock(&service->lock);
+  if (service->job_count + count > service->job_capacity) {
+    size_t capacity = service->job_capacity;
+    while (service->job_count + count > capacity) {
+      capacity *= 2;
+    }
+    astar_service_job *ring =
+        (astar_service_job *)malloc(sizeof(astar_service_job) * capacity);
+    for (size_t i = 0; i < service->job_count; i++) {
+      ring[i] =
+          service->jobs[(service->job_head + i) % service->job_capacity];
+    }
+    free(service->jobs);
+    service->jobs = ring;
+    service->job_capacity = capacity;
+    service->job_head = 0;
+  }
+  for (size_t i = 0; i < count; i++) {
+    size_t slot = (service->job_head + service->job_count + i) %
+                  service->job_capacity;
+    service->jobs[slot] = jobs[i];
+  }
+  service->job_count += count;
+  if (count > 1) {
+    pthread_cond_broadcast(&service->ready);
+  } else {
+    pthread_cond_signal(&service->ready);
+  }
+  pthread_mutex_unlock(&service->lock);
+}
+
+bool astar_service_serve(astar_service service, int in, int out) {
+  astar_service_connection connection;
+  connection.out = out;
+  pthread_mutex_init(&connection.write_lock, NULL);
+  connection.broken = false;
+  pthread_mutex_init(&connection.lock, NULL);
+  pthread_cond_init(&connection.retired, NULL);
+  connection.pending = 0;
+
+  char *buffer = (char *)malloc(ASTAR_SERVICE_READ_SIZE);
+  // a read holds at most one request per length and request
+  size_t job_capacity = ASTAR_SERVICE_READ_SIZE /
+                        (sizeof(uint32_t) + sizeof(astar_service_request));
+  astar_service_job *jobs =
+      (astar_service_job *)malloc(sizeof(astar_service_job) * job_capacity);
+  size_t size = 0;
+  bool malformed = false;
+  while (!malformed) {
+    ssize_t done = read(in, buffer + size, ASTAR_SERVICE_READ_SIZE - size);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      break;
+    }
+    size += done;
+    uint64_t now = trace_clock_ns();
+    size_t offset = 0, count = 0;
+    while (size - offset >= sizeof(uint32_t)) {
+      uint32_t length;
+      memcpy(&length, buffer + offset, sizeof(length));
+      if (length != sizeof(astar_service_request)) {
+        debugf("astar_service_serve bad message of %u bytes\n", length);
+        malformed = true;
+        break;
+      }
+      if (size - offset < sizeof(length) + length) {
+        break;
+      }
+      astar_service_job *job = jobs + count++;
+      job->connection = &connection;
+      memcpy(&job->request, buffer + offset + sizeof(length), length);
+      job->received_ns = now;
+      offset += sizeof(length) + length;
+    }
+    memmove(buffer, buffer + offset, size - offset);
+    size -= offset;
+    if (count) {
+      // stop reading while the connection has too many requests in flight,
+      // which holds back a client sending faster than the workers solve
+      pthread_mutex_lock(&connection.lock);
+      while (connection.pending + count > ASTAR_SERVICE_MAX_PENDING) {
+        pthread_cond_wait(&connection.retired, &connection.lock);
+      }
+      connection.pending += count;
+      pthread_mutex_unlock(&connection.lock);
+      astar_service_queue(service, jobs, count);
+    }
+  }
+  free(jobs);
+  free(buffer);
+
+  pthread_mutex_lock(&connection.lock);
+  while (connection.pending) {
+    pthread_cond_wait(&connection.retired, &connection.lock);
+  }
+  pthread_mutex_unlock(&connection.lock);
+  bool ok = !connection.broken && !malformed;
+  pthread_cond_destroy(&connection.retired);
+  pthread_mutex_destroy(&connection.lock);
+  pthread_mutex_destroy(&connection.write_lock);
+  if (malformed) {
+    pthread_mutex_lock(&service->lock);
+    service->malformed++;
+    pthread_mutex_unlock(&service->lock);
+  }
+  return ok;
+}
+
+void astar_service_write_stats(astar_service service, FILE *file) {
+  astar_latency latency;
+  astar_latency_clear(&latency);
+  size_t solved = 0, failed = 0, rejected = 0;
+  for (size_t i = 0; i < service->worker_count; i++) {
+    astar_service_worker *worker = service->workers + i;
+    pthread_mutex_lock(&worker->stats_lock);
+    astar_latency_merge(&latency, &worker->latency);
+    solved += worker->solved;
+    failed += worker->failed;
+    rejected += worker->rejected;
+    pthread_mutex_unlock(&worker->stats_lock);
+  }
+  pthread_mutex_lock(&service->lock);
+  size_t malformed = service->malformed;
+  pthread_mutex_unlock(&service->lock);
+  fprintf(file,
+          "{\"workers\": %zu, \"batch\": %zu, \"requests\": %llu, "
+          "\"solved\": %zu, \"failed\": %zu, \"rejected\": %zu, "
+          "\"malformed\": %zu, \"latency\": ",
+          service->worker_count, service->batch,
+          (unsigned long long)latency.count, solved, failed, rejected,
+          malformed);
+  astar_latency_write_json(&latency, file);
+  fprintf(file, "}\n");
+}
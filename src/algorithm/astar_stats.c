@@ -0,0 +1,57 @@
+#include "algorithm/astar_stats.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+char *astar_phase_str(astar_phase phase) {
+  static char *strs[ASTAR_PHASE_LENGTH] = {"init", "expand", "path",
+                                           "render"};
+  return strs[phase % ASTAR_PHASE_LENGTH];
+}
+
+double astar_stats_clock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+long astar_stats_peak_rss_kb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+void astar_stats_clear(astar_stats *stats) { memset(stats, 0, sizeof(*stats)); }
+
+void astar_stats_write_json(const astar_stats *stats, FILE *f) {
+  if (!f) {
+    f = stdout;
+  }
+  if (!stats) {
+    fprintf(f, "null\n");
+    return;
+  }
+  fprintf(f,
+          "{\"pushes\": %zu, \"pops\": %zu, \"decrease_keys\": %zu, "
+          "\"reexpansions\": %zu, \"open_peak\": %zu, \"open_histogram\": [",
+          stats->pushes, stats->pops, stats->decrease_keys,
+          stats->reexpansions, stats->open_peak);
+  // trailing empty buckets carry no information
+  size_t buckets = ASTAR_STATS_BUCKETS;
+  while (buckets > 1 && !stats->open_histogram[buckets - 1]) {
+    buckets--;
+  }
+  for (size_t i = 0; i < buckets; i++) {
+    fprintf(f, "%s%zu", i ? ", " : "", stats->open_histogram[i]);
+  }
+  fprintf(f, "], \"phase_ms\": {");
+  for (size_t p = 0; p < ASTAR_PHASE_LENGTH; p++) {
+    fprintf(f, "%s\"%s\": %.3f", p ? ", " : "",
+            astar_phase_str((astar_phase)p), stats->phase_ms[p]);
+  }
+  fprintf(f, "}, \"peak_rss_kb\": %ld}\n", stats->peak_rss_kb);
+}
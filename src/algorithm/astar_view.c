@@ -0,0 +1,338 @@
+#include "algorithm/astar_view.h"
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/// Background colour of each astar_view_cell, from the 256 colour palette.
+static const char *const astar_view_colors[ASTAR_VIEW_CELL_COUNT] = {
+    "\x1b[49m",       "\x1b[48;5;245m", "\x1b[48;5;24m",  "\x1b[48;5;67m",
+    "\x1b[48;5;220m", "\x1b[48;5;46m",  "\x1b[48;5;196m", "\x1b[48;5;235m",
+};
+
+/// Every screen cell is two columns wide, to look about square.
+#define ASTAR_VIEW_CELL "  "
+#define ASTAR_VIEW_CELL_WIDTH 2
+
+static void astar_view_append(astar_view view, const char *data,
+                              size_t size) {
+  if (view->out_size + size > view->out_capacity) {
+    while (view->out_size + size > view->out_capacity) {
+      view->out_capacity *= 2;
+    }
+    view->out = (char *)realloc(view->out, view->out_capacity);
+  }
+  memcpy(view->out + view->out_size, data, size);
+  view->out_size += size;
+}
+
+static void astar_view_printf(astar_view view, const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length > 0) {
+    astar_view_append(view, buffer,
+                      (size_t)length < sizeof(buffer) ? (size_t)length
+                                                      : sizeof(buffer) - 1);
+  }
+}
+
+/// Marks the whole screen as undrawn, so the next draw repaints it.
+static void astar_view_invalidate(astar_view view) {
+  memset(view->screen, ASTAR_VIEW_UNDRAWN, view->rows * view->cols);
+  view->tiles_valid = false;
+}
+
+astar_view astar_view_new(FILE *file, size_t rows, size_t cols) {
+  astar_view view = (astar_view)malloc(sizeof(*view));
+  view->file = file;
+  view->rows = 0;
+  view->cols = 0;
+  view->row = 0;
+  view->col = 0;
+  view->zoom = 1;
+  view->frame_interval = 1;
+  view->frames = 0;
+  view->bytes = 0;
+  view->screen = NULL;
+  view->frame = NULL;
+  view->tiles = NULL;
+  view->out_size = 0;
+  view->out_capacity = 4096;
+  view->out = (char *)malloc(view->out_capacity);
+  astar_view_resize(view, rows, cols);
+  return view;
+}
+
+void astar_view_free(astar_view *view_ptr) {
+  if (view_ptr && *view_ptr) {
+    astar_view view = *view_ptr;
+    if (view->frames) {
+      // below the status line, cursor shown again
+      fprintf(view->file, "\x1b[%zu;1H\x1b[0m\x1b[?25h", view->rows + 2);
+      fflush(view->file);
+    }
+    free(view->screen);
+    free(view->frame);
+    free(view->tiles);
+    free(view->out);
+    free(view);
+    *view_ptr = NULL;
+  }
+}
+
+bool astar_view_terminal_size(FILE *file, size_t *rows, size_t *cols) {
+  struct winsize size;
+  int fd = fileno(file);
+  if (fd < 0 || !isatty(fd) || ioctl(fd, TIOCGWINSZ, &size) != 0 ||
+      size.ws_row < 2 || size.ws_col < ASTAR_VIEW_CELL_WIDTH) {
+    return false;
+  }
+  *rows = size.ws_row - 1;
+  *cols = size.ws_col / ASTAR_VIEW_CELL_WIDTH;
+  return true;
+}
+
+void astar_view_resize(astar_view view, size_t rows, size_t cols) {
+  view->rows = rows ? rows : 1;
+  view->cols = cols ? cols : 1;
+  size_t size = view->rows * view->cols;
+  view->screen = (uint8_t *)realloc(view->screen, size);
+  view->frame = (uint8_t *)realloc(view->frame, size);
+  view->tiles = (uint8_t *)realloc(view->tiles, size);
+  astar_view_invalidate(view);
+}
+
+void astar_view_move(astar_view view, size_t row, size_t col) {
+  view->row = row;
+  view->col = col;
+  astar_view_invalidate(view);
+}
+
+/// Keeps the viewport from scrolling past the bottom and right of the map.
+static void astar_view_clamp(astar_view view, const tile_map map) {
+  size_t rows = view->rows * view->zoom, cols = view->cols * view->zoom;
+  size_t last_row = map->rows > rows ? map->rows - rows : 0;
+  size_t last_col = map->cols > cols ? map->cols - cols : 0;
+  view->row = view->row < last_row ? view->row : last_row;
+  view->col = view->col < last_col ? view->col : last_col;
+}
+
+void astar_view_zoom(astar_view view, size_t zoom, const tile_map map) {
+  zoom = zoom ? zoom : 1;
+  size_t row = view->row + view->rows * view->zoom / 2;
+  size_t col = view->col + view->cols * view->zoom / 2;
+  size_t half_rows = view->rows * zoom / 2, half_cols = view->cols * zoom / 2;
+  view->zoom = zoom;
+  view->row = row > half_rows ? row - half_rows : 0;
+  view->col = col > half_cols ? col - half_cols : 0;
+  astar_view_clamp(view, map);
+  astar_view_invalidate(view);
+}
+
+void astar_view_fit(astar_view view, const tile_map map) {
+  size_t zoom = (map->rows + view->rows - 1) / view->rows;
+  size_t col_zoom = (map->cols + view->cols - 1) / view->cols;
+  view->zoom = zoom > col_zoom ? zoom : col_zoom;
+  view->zoom = view->zoom ? view->zoom : 1;
+  view->row = 0;
+  view->col = 0;
+  astar_view_invalidate(view);
+}
+
+void astar_view_center(astar_view view, const tile_map map, point pt) {
+  size_t half_rows = view->rows * view->zoom / 2;
+  size_t half_cols = view->cols * view->zoom / 2;
+  view->row = pt.row > half_rows ? pt.row - half_rows : 0;
+  view->col = pt.col > half_cols ? pt.col - half_cols : 0;
+  astar_view_clamp(view, map);
+  astar_view_invalidate(view);
+}
+
+/// Search cell of the state at `pos`, ASTAR_VIEW_EMPTY when untouched.
+static inline astar_view_cell astar_view_state_cell(const astar_context astar,
+                                                    size_t pos) {
+  const astar_point_state *state = astar->states + pos;
+  if (state->is_path) {
+    return ASTAR_VIEW_PATH;
+  }
+  if (state->visited) {
+    return ASTAR_VIEW_VISITED;
+  }
+  return state->marked ? ASTAR_VIEW_MARKED : ASTAR_VIEW_EMPTY;
+}
+
+/// Wall or empty for the block of `zoom` x `zoom` map cells from (row, col),
+/// by majority.
+static astar_view_cell astar_view_tile_block(const tile_map map, size_t row,
+                                             size_t col, size_t zoom) {
+  size_t last_row = row + zoom < map->rows ? row + zoom : map->rows;
+  size_t last_col = col + zoom < map->cols ? col + zoom : map->cols;
+  size_t walls = 0;
+  for (size_t r = row; r < last_row; r++) {
+    for (size_t c = col; c < last_col; c++) {
+      walls += tile_map_pos_get(map, r * map->cols + c) == TILE_WALL;
+    }
+  }
+  size_t cells = (last_row - row) * (last_col - col);
+  return walls * 2 > cells ? ASTAR_VIEW_WALL : ASTAR_VIEW_EMPTY;
+}
+
+/// Highest search cell of the block of `zoom` x `zoom` map cells from
+/// (row, col).
+static astar_view_cell astar_view_state_block(const astar_context astar,
+                                              size_t row, size_t col,
+                                              size_t zoom) {
+  const tile_map map = astar->map;
+  size_t last_row = row + zoom < map->rows ? row + zoom : map->rows;
+  size_t last_col = col + zoom < map->cols ? col + zoom : map->cols;
+  astar_view_cell best = ASTAR_VIEW_EMPTY;
+  for (size_t r = row; r < last_row; r++) {
+    for (size_t c = col; c < last_col; c++) {
+      astar_view_cell cell = astar_view_state_cell(astar, r * map->cols + c);
+      best = cell > best ? cell : best;
+    }
+  }
+  return best;
+}
+
+/// Raises the screen cell of the map cell `pt` to `cell`, when it is shown.
+static void astar_view_raise(astar_view view, point pt, astar_view_cell cell) {
+  if (pt.row < view->row || pt.col < view->col) {
+    return;
+  }
+  size_t r = (pt.row - view->row) / view->zoom;
+  size_t c = (pt.col - view->col) / view->zoom;
+  if (r < view->rows && c < view->cols) {
+    uint8_t *frame = view->frame + r * view->cols + c;
+    *frame = cell > *frame ? cell : *frame;
+  }
+}
+
+/// Walls and empty tiles of the viewport, read again only after moving,
+/// zooming or a change of the map.
+static void astar_view_build_tiles(astar_view view, const tile_map map) {
+  for (size_t r = 0; r < view->rows; r++) {
+    uint8_t *tiles = view->tiles + r * view->cols;
+    size_t row = view->row + r * view->zoom;
+    for (size_t c = 0; c < view->cols; c++) {
+      size_t col = view->col + c * view->zoom;
+      tiles[c] = row >= map->rows || col >= map->cols
+                     ? ASTAR_VIEW_OUTSIDE
+                     : astar_view_tile_block(map, row, col, view->zoom);
+    }
+  }
+  view->tiles_valid = true;
+  view->tiles_map_id = map->id;
+  view->tiles_version = map->version;
+}
+
+static void astar_view_build(astar_view view, const astar_context astar,
+                             const tile_map map) {
+  if (!view->tiles_valid || view->tiles_map_id != map->id ||
+      view->tiles_version != map->version) {
+    astar_view_build_tiles(view, map);
+  }
+  memcpy(view->frame, view->tiles, view->rows * view->cols);
+  if (!astar) {
+    return;
+  }
+  // search cells come after the others in astar_view_cell, by priority
+  size_t zoom = view->zoom;
+  size_t shown_rows = map->rows > view->row ? map->rows - view->row : 0;
+  size_t shown_cols = map->cols > view->col ? map->cols - view->col : 0;
+  shown_rows = shown_rows < view->rows * zoom ? shown_rows : view->rows * zoom;
+  shown_cols = shown_cols < view->cols * zoom ? shown_cols : view->cols * zoom;
+  size_t queued = astar->queue_end - astar->queue;
+  if (queued < shown_rows * shown_cols) {
+    // every touched state is of a point once queued, and only those in the
+    // viewport are read
+    for (const point *pt = astar->queue; pt < astar->queue_end; pt++) {
+      if (pt->row - view->row < shown_rows &&
+          pt->col - view->col < shown_cols) {
+        astar_view_raise(
+            view, *pt,
+            astar_view_state_cell(astar, pt->row * map->cols + pt->col));
+      }
+    }
+  } else {
+    for (size_t r = 0; r * zoom < shown_rows; r++) {
+      uint8_t *frame = view->frame + r * view->cols;
+      for (size_t c = 0; c * zoom < shown_cols; c++) {
+        astar_view_cell cell = astar_view_state_block(
+            astar, view->row + r * zoom, view->col + c * zoom, zoom);
+        frame[c] = cell > frame[c] ? cell : frame[c];
+      }
+    }
+  }
+  astar_view_raise(view, astar->start_point, ASTAR_VIEW_START);
+  astar_view_raise(view, astar->end_point, ASTAR_VIEW_END);
+}
+
+bool astar_view_draw(astar_view view, const astar_context astar,
+                     const tile_map tiles) {
+  tile_map map = astar ? astar->map : tiles;
+  if (!map) {
+    return false;
+  }
+  astar_view_build(view, astar, map);
+  view->out_size = 0;
+  if (!view->frames) {
+    astar_view_printf(view, "\x1b[?25l\x1b[H\x1b[2J");
+  }
+  // one cursor move per run of changed cells, colours only when they change
+  int color = -1;
+  for (size_t r = 0; r < view->rows; r++) {
+    uint8_t *screen = view->screen + r * view->cols;
+    const uint8_t *frame = view->frame + r * view->cols;
+    size_t c = 0;
+    while (c < view->cols) {
+      if (screen[c] == frame[c]) {
+        c++;
+        continue;
+      }
+      astar_view_printf(view, "\x1b[%zu;%zuH", r + 1,
+                        c * ASTAR_VIEW_CELL_WIDTH + 1);
+      for (; c < view->cols && screen[c] != frame[c]; c++) {
+        if (frame[c] != color) {
+          color = frame[c];
+          const char *sgr = astar_view_colors[color];
+          astar_view_append(view, sgr, strlen(sgr));
+        }
+        astar_view_append(view, ASTAR_VIEW_CELL, ASTAR_VIEW_CELL_WIDTH);
+        screen[c] = frame[c];
+      }
+    }
+  }
+  astar_view_printf(view, "\x1b[%zu;1H\x1b[0m\x1b[K", view->rows + 1);
+  if (astar) {
+    astar_view_printf(view, "iteration %zu %s  ", astar->iteration,
+                      astar_state_str(astar->state));
+  }
+  astar_view_printf(view, "map %zux%zu  view %zu,%zu  zoom %zu", map->rows,
+                    map->cols, view->row, view->col, view->zoom);
+  bool written =
+      fwrite(view->out, 1, view->out_size, view->file) == view->out_size;
+  written = fflush(view->file) == 0 && written;
+  view->frames++;
+  view->bytes += view->out_size;
+  return written;
+}
+
+void astar_view_observe(const astar_context astar, void *context) {
+  astar_view view = (astar_view)context;
+  size_t interval = view->frame_interval ? view->frame_interval : 1;
+  if (astar->state != ASTAR_RUNNING || astar->iteration % interval == 0) {
+    astar_view_draw(view, astar, astar->map);
+  }
+}
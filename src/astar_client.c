@@ -0,0 +1,281 @@
+#include "algorithm/astar.h"
+#include "algorithm/astar_service.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include "util/random.h"
+#include "util/trace.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Load generator for astar_server.
+///
+/// Opens `connections` connections to the server socket and keeps up to
+/// `window` requests in flight on each, between random empty points of the
+/// same map the server was started with. Prints throughput, the latency seen
+/// here and the latency reported by the server as JSON, and checks that the
+/// runs of every path add up to its length.
+
+#define CLIENT_DEFAULT_REQUESTS 10000
+#define CLIENT_DEFAULT_CONNECTIONS 4
+#define CLIENT_DEFAULT_WINDOW 16
+
+typedef struct __client_options {
+  const char *socket;
+  const char *map;
+  const char *generate; /// generator name, see tile_map_generate_named
+  size_t rows;
+  size_t cols;
+  unsigned long long map_seed;
+  size_t requests;
+  size_t connections;
+  size_t window;
+  unsigned long long seed;
+} client_options;
+
+typedef struct __client_connection {
+  const client_options *options;
+  tile_map map;
+  tile_empty_index index;
+  size_t number;
+  size_t requests;
+  bool failed; /// could not connect or the server hung up
+  astar_latency latency;        /// measured here
+  astar_latency server_latency; /// reported in the responses
+  size_t solved;
+  size_t unsolved;
+  size_t mismatched; /// paths whose runs do not add up to their length
+} client_connection;
+
+static int client_connect(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 &&
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/// Reads one response, false when the connection ended.
+static bool client_receive(client_connection *connection, int fd,
+                           const uint64_t *sent_ns, uint32_t **runs,
+                           size_t *run_capacity) {
+  uint32_t length;
+  astar_service_response response;
+  if (!astar_service_read_all(fd, &length, sizeof(length)) ||
+      length < sizeof(response) ||
+      !astar_service_read_all(fd, &response, sizeof(response))) {
+    return false;
+  }
+  size_t count = (length - sizeof(response)) / sizeof(uint32_t);
+  if (count > *run_capacity) {
+    *run_capacity = count;
+    *runs = (uint32_t *)realloc(*runs, sizeof(uint32_t) * count);
+  }
+  if (!astar_service_read_all(fd, *runs, sizeof(uint32_t) * count) ||
+      response.id >= connection->requests) {
+    return false;
+  }
+  astar_latency_add(&connection->latency,
+                    trace_clock_ns() - sent_ns[response.id]);
+  astar_latency_add(&connection->server_latency, response.latency_ns);
+  if (response.state != ASTAR_SUCCEEDED) {
+    connection->unsolved++;
+    return true;
+  }
+  connection->solved++;
+  size_t moves = 0;
+  for (size_t i = 0; i < count; i++) {
+    moves += (*runs)[i] >> ASTAR_SERVICE_STEP_BITS;
+  }
+  if (moves + 1 != response.path_length) {
+    connection->mismatched++;
+  }
+  return true;
+}
+
+static void *client_run(void *arg) {
+  client_connection *connection = (client_connection *)arg;
+  const client_options *options = connection->options;
+  int fd = client_connect(options->socket);
+  if (fd < 0) {
+    connection->failed = true;
+    return NULL;
+  }
+  uint64_t stream = random_split(options->seed, connection->number);
+  uint64_t *sent_ns =
+      (uint64_t *)malloc(sizeof(uint64_t) * (connection->requests + 1));
+  size_t run_capacity = 0;
+  uint32_t *runs = NULL;
+  size_t sent = 0, received = 0;
+  while (received < connection->requests) {
+    while (sent < connection->requests && sent - received < options->window) {
+      point start = tile_empty_index_sample(connection->index, connection->map,
+                                            stream, 2 * sent, NULL);
+      point end = tile_empty_index_sample(connection->index, connection->map,
+                                          stream, 2 * sent + 1, &start);
+      struct {
+        uint32_t length;
+        astar_service_request request;
+      } message = {sizeof(astar_service_request),
+                   {(uint32_t)sent, (uint32_t)start.row, (uint32_t)start.col,
+                    (uint32_t)end.row, (uint32_t)end.col}};
+      sent_ns[sent] = trace_clock_ns();
+      if (!astar_service_write_all(fd, &message, sizeof(message))) {
+        break;
+      }
+      sent++;
+    }
+    if (!client_receive(connection, fd, sent_ns, &runs, &run_capacity)) {
+      connection->failed = true;
+      break;
+    }
+    received++;
+  }
+  close(fd);
+  free(runs);
+  free(sent_ns);
+  return NULL;
+}
+
+static int client(const client_options *options) {
+  tile_map map = options->map
+                     ? tile_map_read(options->map)
+                     : tile_map_generate_named(options->generate,
+                                               options->rows, options->cols,
+                                               options->map_seed);
+  if (!map) {
+    fprintf(stderr, "cannot load the map\n");
+    return EXIT_FAILURE;
+  }
+  tile_empty_index index = tile_empty_index_new(map);
+  if (index->count < 2) {
+    fprintf(stderr, "the map has less than two empty tiles\n");
+    tile_empty_index_free(&index);
+    tile_map_free(&map);
+    return EXIT_FAILURE;
+  }
+  size_t count = options->connections;
+  client_connection *connections =
+      (client_connection *)calloc(count, sizeof(client_connection));
+  pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * count);
+  uint64_t started = trace_clock_ns();
+  for (size_t i = 0; i < count; i++) {
+    client_connection *connection = connections + i;
+    connection->options = options;
+    connection->map = map;
+    connection->index = index;
+    connection->number = i;
+    // the first connections take the remainder
+    connection->requests =
+        options->requests / count + (i < options->requests % count);
+    pthread_create(threads + i, NULL, client_run, connection);
+  }
+
+  astar_latency latency, server_latency;
+  astar_latency_clear(&latency);
+  astar_latency_clear(&server_latency);
+  size_t solved = 0, unsolved = 0, mismatched = 0, failed = 0;
+  for (size_t i = 0; i < count; i++) {
+    pthread_join(threads[i], NULL);
+    client_connection *connection = connections + i;
+    astar_latency_merge(&latency, &connection->latency);
+    astar_latency_merge(&server_latency, &connection->server_latency);
+    solved += connection->solved;
+    unsolved += connection->unsolved;
+    mismatched += connection->mismatched;
+    failed += connection->failed;
+  }
+  double seconds = (trace_clock_ns() - started) / 1e9;
+
+  printf("{\"connections\": %zu, \"window\": %zu, \"requests\": %llu, "
+         "\"seconds\": %.3f, \"requests_per_second\": %.1f, \"solved\": %zu, "
+         "\"unsolved\": %zu, \"mismatched\": %zu, \"failed_connections\": "
+         "%zu,\n \"latency\": ",
+         count, options->window, (unsigned long long)latency.count, seconds,
+         seconds > 0 ? latency.count / seconds : 0.0, solved, unsolved,
+         mismatched, failed);
+  astar_latency_write_json(&latency, stdout);
+  printf(",\n \"server_latency\": ");
+  astar_latency_write_json(&server_latency, stdout);
+  printf("}\n");
+
+  free(threads);
+  free(connections);
+  tile_empty_index_free(&index);
+  tile_map_free(&map);
+  return failed || mismatched ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void client_usage() {
+  fprintf(stderr,
+          "usage: astar_client --socket PATH\n"
+          "                    (--map MAP | --generate KIND ROWS COLS SEED)\n"
+          "                    [--requests N] [--connections N] [--window N]\n"
+          "                    [--seed N]\n"
+          "  the map options must match those of astar_server\n"
+          "  --requests N       requests over all connections (%d)\n"
+          "  --connections N    concurrent connections (%d)\n"
+          "  --window N         requests in flight per connection (%d),\n"
+          "                     at most %d\n"
+          "  --seed N           seed of the queries (1)\n",
+          CLIENT_DEFAULT_REQUESTS, CLIENT_DEFAULT_CONNECTIONS,
+          CLIENT_DEFAULT_WINDOW, ASTAR_SERVICE_MAX_PENDING);
+}
+
+int main(int argc, char **argv) {
+  client_options options;
+  memset(&options, 0, sizeof(options));
+  options.requests = CLIENT_DEFAULT_REQUESTS;
+  options.connections = CLIENT_DEFAULT_CONNECTIONS;
+  options.window = CLIENT_DEFAULT_WINDOW;
+  options.seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--socket") == 0 && has_value) {
+      options.socket = argv[++i];
+    } else if (strcmp(arg, "--map") == 0 && has_value) {
+      options.map = argv[++i];
+    } else if (strcmp(arg, "--generate") == 0 && i + 4 < argc) {
+      options.generate = argv[++i];
+      options.rows = strtoul(argv[++i], NULL, 10);
+      options.cols = strtoul(argv[++i], NULL, 10);
+      options.map_seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--requests") == 0 && has_value) {
+      options.requests = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--connections") == 0 && has_value) {
+      options.connections = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--window") == 0 && has_value) {
+      options.window = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && has_value) {
+      options.seed = strtoull(argv[++i], NULL, 10);
+    } else {
+      client_usage();
+      return 2;
+    }
+  }
+  if (!options.socket || (!options.map && !options.generate) ||
+      !options.connections || !options.window ||
+      options.window > ASTAR_SERVICE_MAX_PENDING) {
+    client_usage();
+    return 2;
+  }
+  return client(&options);
+}
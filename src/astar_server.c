@@ -0,0 +1,244 @@
+#include "algorithm/astar_service.h"
+#include "struct/bool.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include "util/parallel.h"
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Path service, see algorithm/astar_service.h.
+///
+/// Loads or generates one map, then answers the requests read from stdin on
+/// stdout, or the requests of every connection to a Unix domain socket until
+/// SIGINT or SIGTERM. Request counters and latencies go to stderr, or to the
+/// `--stats` file, on exit.
+
+#define SERVER_MAX_CONNECTIONS 1024
+#define SERVER_DEFAULT_BATCH 16
+#define SERVER_POLL_MS 200
+
+typedef struct __server_options {
+  const char *map;
+  const char *generate; /// generator name, see tile_map_generate_named
+  size_t rows;
+  size_t cols;
+  unsigned long long seed;
+  const char *socket; /// NULL for stdin and stdout
+  size_t workers;
+  size_t batch;
+  bool expand_kernel;
+  const char *stats;
+} server_options;
+
+typedef struct __server_state {
+  astar_service service;
+  pthread_mutex_t lock;
+  pthread_cond_t idle;
+  int connections[SERVER_MAX_CONNECTIONS]; /// -1 for free slots
+  size_t active;
+} server_state;
+
+typedef struct __server_connection {
+  server_state *server;
+  size_t slot;
+} server_connection;
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void server_stop(int signal) {
+  (void)signal;
+  server_stopping = 1;
+}
+
+static void *server_connection_run(void *arg) {
+  server_connection *connection = (server_connection *)arg;
+  server_state *server = connection->server;
+  int fd = server->connections[connection->slot];
+  astar_service_serve(server->service, fd, fd);
+  pthread_mutex_lock(&server->lock);
+  close(fd);
+  server->connections[connection->slot] = -1;
+  server->active--;
+  pthread_cond_signal(&server->idle);
+  pthread_mutex_unlock(&server->lock);
+  free(connection);
+  return NULL;
+}
+
+static bool server_accept(server_state *server, int fd) {
+  pthread_mutex_lock(&server->lock);
+  size_t slot = 0;
+  while (slot < SERVER_MAX_CONNECTIONS && server->connections[slot] >= 0) {
+    slot++;
+  }
+  if (slot == SERVER_MAX_CONNECTIONS) {
+    pthread_mutex_unlock(&server->lock);
+    return false;
+  }
+  server->connections[slot] = fd;
+  server->active++;
+  pthread_mutex_unlock(&server->lock);
+
+  server_connection *connection =
+      (server_connection *)malloc(sizeof(*connection));
+  connection->server = server;
+  connection->slot = slot;
+  pthread_t thread;
+  pthread_create(&thread, NULL, server_connection_run, connection);
+  pthread_detach(thread);
+  return true;
+}
+
+static int server_listen(server_state *server, const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "socket path %s is too long\n", path);
+    return EXIT_FAILURE;
+  }
+  strcpy(address.sun_path, path);
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (listener < 0 ||
+      bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, SERVER_MAX_CONNECTIONS) != 0) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  fprintf(stderr, "listening on %s\n", path);
+
+  struct pollfd poll_fd = {listener, POLLIN, 0};
+  while (!server_stopping) {
+    if (poll(&poll_fd, 1, SERVER_POLL_MS) <= 0) {
+      continue;
+    }
+    int fd = accept(listener, NULL, NULL);
+    if (fd >= 0 && !server_accept(server, fd)) {
+      fprintf(stderr, "too many connections\n");
+      close(fd);
+    }
+  }
+  close(listener);
+  unlink(path);
+
+  // let the open connections answer what they have read and finish
+  pthread_mutex_lock(&server->lock);
+  for (size_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+    if (server->connections[i] >= 0) {
+      shutdown(server->connections[i], SHUT_RD);
+    }
+  }
+  while (server->active) {
+    pthread_cond_wait(&server->idle, &server->lock);
+  }
+  pthread_mutex_unlock(&server->lock);
+  return EXIT_SUCCESS;
+}
+
+static tile_map server_load_map(const server_options *options) {
+  if (options->map) {
+    return tile_map_read(options->map);
+  }
+  return tile_map_generate_named(options->generate, options->rows,
+                                 options->cols, options->seed);
+}
+
+static void server_usage() {
+  fprintf(stderr,
+          "usage: astar_server (--map MAP | --generate KIND ROWS COLS SEED)\n"
+          "                    [--socket PATH] [--workers N] [--batch N]\n"
+          "                    [--expand] [--stats FILE]\n"
+          "  --map MAP          bitmap or MovingAI .map file\n"
+          "  --generate KIND    random, cave, maze or rooms map\n"
+          "  --socket PATH      serve a Unix domain socket instead of\n"
+          "                     stdin and stdout\n"
+          "  --workers N        search threads (one per CPU)\n"
+          "  --batch N          requests taken per wakeup (%d)\n"
+          "  --expand           relax neighbours with astar_expand\n"
+          "  --stats FILE       write counters and latencies to FILE\n",
+          SERVER_DEFAULT_BATCH);
+}
+
+int main(int argc, char **argv) {
+  server_options options;
+  memset(&options, 0, sizeof(options));
+  options.workers = parallel_threads();
+  options.batch = SERVER_DEFAULT_BATCH;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--map") == 0 && has_value) {
+      options.map = argv[++i];
+    } else if (strcmp(arg, "--generate") == 0 && i + 4 < argc) {
+      options.generate = argv[++i];
+      options.rows = strtoul(argv[++i], NULL, 10);
+      options.cols = strtoul(argv[++i], NULL, 10);
+      options.seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--socket") == 0 && has_value) {
+      options.socket = argv[++i];
+    } else if (strcmp(arg, "--workers") == 0 && has_value) {
+      options.workers = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--batch") == 0 && has_value) {
+      options.batch = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--expand") == 0) {
+      options.expand_kernel = true;
+    } else if (strcmp(arg, "--stats") == 0 && has_value) {
+      options.stats = argv[++i];
+    } else {
+      server_usage();
+      return 2;
+    }
+  }
+  if (!options.map && !options.generate) {
+    server_usage();
+    return 2;
+  }
+  tile_map map = server_load_map(&options);
+  if (!map) {
+    fprintf(stderr, "cannot load the map\n");
+    return EXIT_FAILURE;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, server_stop);
+  signal(SIGTERM, server_stop);
+  server_state server;
+  server.service = astar_service_new(map, options.workers, options.batch,
+                                     options.expand_kernel);
+  tile_map_free(&map);
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_cond_init(&server.idle, NULL);
+  for (size_t i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+    server.connections[i] = -1;
+  }
+  server.active = 0;
+
+  int status = EXIT_SUCCESS;
+  if (options.socket) {
+    status = server_listen(&server, options.socket);
+  } else if (!astar_service_serve(server.service, STDIN_FILENO,
+                                  STDOUT_FILENO)) {
+    status = EXIT_FAILURE;
+  }
+
+  FILE *stats = options.stats ? fopen(options.stats, "w") : stderr;
+  if (stats) {
+    astar_service_write_stats(server.service, stats);
+    if (stats != stderr) {
+      fclose(stats);
+    }
+  }
+  astar_service_free(&server.service);
+  pthread_cond_destroy(&server.idle);
+  pthread_mutex_destroy(&server.lock);
+  return status;
+}
@@ -0,0 +1,680 @@
+#include "algorithm/astar.h"
+#include "algorithm/astar_expand.h"
+#include "algorithm/astar_prune.h"
+#include "algorithm/astar_scenario.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include "util/random.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/// Repeatable A* measurements.
+///
+/// Every scenario is a map with a fixed list of queries: seeded random maps
+/// at several sizes and wall ratios, caves, mazes and rooms at the same
+/// sizes, plus any MovingAI `.map`/`.scen` pairs given on the command line.
+/// Each scenario runs `warmup` unmeasured passes and then `runs` measured
+/// passes over all of its queries, reusing one context. Latency covers
+/// astar_reset and astar_resolve of one query. Counters are totals of one
+/// pass, expansion_ns is the measured time over the expanded cells, and
+/// peak_rss_kb is the process high-water mark after the scenario.
+/// `--expand ISA` runs the searches with the neighbour kernel of
+/// astar_expand.h. `--interleave N` resolves N queries at a time with
+/// astar_resolve_interleaved; a query is then charged an equal share of the
+/// time of its group. `--large` adds maps whose search states (24 bytes a
+/// tile) outgrow the last level cache, with local queries. `--prune` builds
+/// an astar_prune per map before measuring and reports to stderr the build
+/// time and the share of empty tiles the queries skip; compare the expanded
+/// column with a run without it. `--parallel N` resolves every query with
+/// astar_resolve_parallel on N threads; its paths are optimal as its
+/// estimate is not weighted, so it expands more cells than astar_resolve.
+/// It resolves one query at a time and does not combine with --interleave.
+///
+/// `bench --compare BASE NEW` reads two result files (CSV or JSON) and exits
+/// with 1 when a scenario of NEW is slower or does more work than in BASE by
+/// more than the threshold.
+
+#define BENCH_NAME_SIZE 256
+#define BENCH_LINE_SIZE 4096
+#define BENCH_MAX_MOVINGAI 64
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_DEFAULT_WARMUP 2
+#define BENCH_DEFAULT_QUERIES 32
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+typedef struct __bench_map_size {
+  size_t rows;
+  size_t cols;
+} bench_map_size;
+
+static const bench_map_size BENCH_SIZES[] = {{64, 64}, {270, 480}, {512, 512}};
+static const double BENCH_WALL_RATIOS[] = {0, 0.2, 0.35, 0.45};
+static const bench_map_size BENCH_QUICK_SIZES[] = {{64, 64}, {270, 480}};
+static const double BENCH_QUICK_WALL_RATIOS[] = {0, 0.2, 0.45};
+/// 4096x4096 tiles take 400 MB of states per context
+static const bench_map_size BENCH_LARGE_SIZE = {4096, 4096};
+static const double BENCH_LARGE_WALL_RATIO = 0.2;
+#define BENCH_LARGE_RADIUS 128
+
+/// generators of tile_map_generate_named
+static const char *BENCH_SHAPES[] = {"cave", "maze", "rooms"};
+
+#define BENCH_LENGTH(array) (sizeof(array) / sizeof(array[0]))
+
+typedef enum __bench_format {
+  BENCH_CSV = 0,
+  BENCH_JSON,
+} bench_format;
+
+typedef struct __bench_options {
+  size_t runs;
+  size_t warmup;
+  size_t queries;
+  size_t limit; /// queries read per `.scen` file, all when 0
+  unsigned seed;
+  bool quick;
+  bool large;
+  bool expand_kernel;
+  bool prune;
+  size_t interleave; /// queries resolved together
+  size_t parallel;   /// threads of astar_resolve_parallel, 0 for none
+  bench_format format;
+  const char *output;
+  const char *movingai[BENCH_MAX_MOVINGAI][2]; /// map and scen paths
+  size_t movingai_count;
+  const char *compare[2];
+  double threshold; /// percent
+} bench_options;
+
+typedef struct __bench_result {
+  char name[BENCH_NAME_SIZE];
+  size_t rows;
+  size_t cols;
+  size_t queries;
+  size_t runs;
+  size_t solved;
+  double median_us;
+  double p99_us;
+  double mean_us;
+  size_t expanded;
+  size_t comparisons;
+  double expansion_ns;
+  double cost_ratio; /// path cost over the reference cost, 0 when unknown
+  long peak_rss_kb;
+} bench_result;
+
+static double bench_now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static long bench_peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static int bench_compare_double(const void *left, const void *right) {
+  double l = *(const double *)left;
+  double r = *(const double *)right;
+  return (l > r) - (l < r);
+}
+
+/// Nearest-rank percentile of sorted samples.
+static double bench_percentile(const double *sorted, size_t count,
+                               double percent) {
+  if (!count) {
+    return 0;
+  }
+  size_t rank = (size_t)(percent / 100 * count + 0.999999);
+  return sorted[rank ? rank - 1 : 0];
+}
+
+/// Runs one scenario, taking over `map`.
+static void bench_run(const char *name, tile_map map,
+                      const astar_scenario scenario,
+                      const bench_options *options, bench_result *result) {
+  size_t count = scenario->count;
+  double *samples =
+      (double *)malloc(sizeof(double) * (count * options->runs + 1));
+  size_t sample_count = 0;
+  size_t group = options->interleave;
+  astar_context *contexts =
+      (astar_context *)malloc(sizeof(astar_context) * group);
+  astar_prune prune = NULL;
+  if (options->prune) {
+    double before = bench_now_us();
+    prune = astar_prune_new(map);
+    double built = bench_now_us() - before;
+    double skipped = 0;
+    for (size_t q = 0; prune && q < count; q++) {
+      astar_prune_query query = astar_prune_query_new(
+          prune, scenario->queries[q].start, scenario->queries[q].end);
+      skipped += astar_prune_count(prune, &query);
+    }
+    if (prune && count && prune->empty_count) {
+      fprintf(stderr,
+              "%s: pruned %.1f%% of %zu empty tiles per query, %zu pockets, "
+              "%zu swamp tiles in %zu regions, built in %.1f ms\n",
+              name, skipped * 100 / count / prune->empty_count,
+              prune->empty_count, prune->pocket_count, prune->swamp_tiles,
+              prune->swamp_count, built / 1000);
+    }
+  }
+  for (size_t i = 0; i < group; i++) {
+    contexts[i] = astar_init(map, (point){0, 0}, (point){0, 0});
+    astar_set_owns_map(contexts[i], i == 0); // shared with the first one
+    astar_set_expand_kernel(contexts[i], options->expand_kernel);
+    astar_set_prune(contexts[i], prune);
+  }
+
+  memset(result, 0, sizeof(*result));
+  snprintf(result->name, sizeof(result->name), "%s", name);
+  result->rows = map->rows;
+  result->cols = map->cols;
+  result->queries = count;
+  result->runs = options->runs;
+
+  double path_cost = 0;
+  double optimal_cost = 0;
+  for (size_t run = 0; run < options->warmup + options->runs; run++) {
+    bool measured = run >= options->warmup;
+    bool first = run == options->warmup;
+    for (size_t begin = 0; begin < count; begin += group) {
+      size_t size = count - begin < group ? count - begin : group;
+      const astar_query *queries = scenario->queries + begin;
+      double before = bench_now_us();
+      for (size_t i = 0; i < size; i++) {
+        astar_reset(contexts[i], queries[i].start, queries[i].end);
+      }
+      if (options->parallel) {
+        astar_resolve_parallel(contexts[0], options->parallel, NULL);
+      } else if (group == 1) {
+        astar_resolve(contexts[0]);
+      } else {
+        astar_resolve_interleaved(contexts, size);
+      }
+      double after = bench_now_us();
+      for (size_t i = 0; i < size && measured; i++) {
+        samples[sample_count++] = (after - before) / size;
+      }
+      for (size_t i = 0; i < size && first; i++) {
+        astar_context astar = contexts[i];
+        result->expanded += astar->iteration;
+        result->comparisons += astar->comparison_count;
+        if (astar->state == ASTAR_SUCCEEDED) {
+          result->solved++;
+          if (queries[i].optimal_cost > 0) {
+            path_cost += astar->path_cost;
+            optimal_cost += queries[i].optimal_cost;
+          }
+        }
+      }
+    }
+  }
+
+  qsort(samples, sample_count, sizeof(double), bench_compare_double);
+  double sum = 0;
+  for (size_t i = 0; i < sample_count; i++) {
+    sum += samples[i];
+  }
+  result->median_us = bench_percentile(samples, sample_count, 50);
+  result->p99_us = bench_percentile(samples, sample_count, 99);
+  result->mean_us = sample_count ? sum / sample_count : 0;
+  result->expansion_ns =
+      result->expanded ? sum * 1000 / (result->expanded * options->runs) : 0;
+  result->cost_ratio = optimal_cost > 0 ? path_cost / optimal_cost : 0;
+  result->peak_rss_kb = bench_peak_rss_kb();
+
+  for (size_t i = 1; i < group; i++) {
+    astar_free(contexts + i);
+  }
+  astar_free(contexts); // frees the map too
+  free(contexts);
+  astar_prune_free(&prune);
+  free(samples);
+}
+
+static void bench_write_header(FILE *file, bench_format format) {
+  if (format == BENCH_CSV) {
+    fprintf(file, "name,rows,cols,queries,runs,solved,median_us,p99_us,"
+                  "mean_us,expanded,comparisons,expansion_ns,cost_ratio,"
+                  "peak_rss_kb\n");
+  } else {
+    fprintf(file, "[\n");
+  }
+}
+
+static void bench_write_result(FILE *file, bench_format format,
+                               const bench_result *r, bool first) {
+  if (format == BENCH_CSV) {
+    fprintf(file,
+            "%s,%zu,%zu,%zu,%zu,%zu,%.3f,%.3f,%.3f,%zu,%zu,%.1f,%.4f,%ld\n",
+            r->name, r->rows, r->cols, r->queries, r->runs, r->solved,
+            r->median_us, r->p99_us, r->mean_us, r->expanded, r->comparisons,
+            r->expansion_ns, r->cost_ratio, r->peak_rss_kb);
+  } else {
+    fprintf(file,
+            "%s  {\"name\": \"%s\", \"rows\": %zu, \"cols\": %zu, "
+            "\"queries\": %zu, \"runs\": %zu, \"solved\": %zu, "
+            "\"median_us\": %.3f, \"p99_us\": %.3f, \"mean_us\": %.3f, "
+            "\"expanded\": %zu, \"comparisons\": %zu, "
+            "\"expansion_ns\": %.1f, \"cost_ratio\": %.4f, "
+            "\"peak_rss_kb\": %ld}",
+            first ? "" : ",\n", r->name, r->rows, r->cols, r->queries, r->runs,
+            r->solved, r->median_us, r->p99_us, r->mean_us, r->expanded,
+            r->comparisons, r->expansion_ns, r->cost_ratio, r->peak_rss_kb);
+  }
+  fflush(file);
+}
+
+static void bench_write_footer(FILE *file, bench_format format, bool empty) {
+  if (format == BENCH_JSON) {
+    fprintf(file, "%s]\n", empty ? "" : "\n");
+  }
+}
+
+/// Seeds the map and the queries of a scenario from its name, so sets can
+/// change without moving the other scenarios.
+static void bench_seeds(const bench_options *options, const char *name,
+                        uint64_t *map_seed, uint64_t *query_seed) {
+  uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+  for (const char *c = name; *c; c++) {
+    hash = (hash ^ (unsigned char)*c) * 0x100000001b3ull;
+  }
+  uint64_t seed = random_split(options->seed, hash);
+  *map_seed = random_split(seed, 0);
+  *query_seed = random_split(seed, 1);
+}
+
+static int bench_suite(const bench_options *options) {
+  FILE *file = options->output ? fopen(options->output, "w") : stdout;
+  if (!file) {
+    fprintf(stderr, "cannot open %s\n", options->output);
+    return EXIT_FAILURE;
+  }
+  const bench_map_size *sizes =
+      options->quick ? BENCH_QUICK_SIZES : BENCH_SIZES;
+  size_t size_count = options->quick ? BENCH_LENGTH(BENCH_QUICK_SIZES)
+                                     : BENCH_LENGTH(BENCH_SIZES);
+  const double *walls =
+      options->quick ? BENCH_QUICK_WALL_RATIOS : BENCH_WALL_RATIOS;
+  size_t wall_count = options->quick ? BENCH_LENGTH(BENCH_QUICK_WALL_RATIOS)
+                                     : BENCH_LENGTH(BENCH_WALL_RATIOS);
+  int status = EXIT_SUCCESS;
+  bool first = true;
+  bench_result result;
+  char name[BENCH_NAME_SIZE];
+  uint64_t map_seed, query_seed;
+  bench_write_header(file, options->format);
+
+  for (size_t s = 0; s < size_count; s++) {
+    for (size_t w = 0; w < wall_count; w++) {
+      snprintf(name, sizeof(name), "random-%zux%zu-w%02d", sizes[s].rows,
+               sizes[s].cols, (int)(walls[w] * 100 + 0.5));
+      bench_seeds(options, name, &map_seed, &query_seed);
+      tile_map map = tile_map_generate(sizes[s].rows, sizes[s].cols,
+                                       1 - walls[w], map_seed);
+      astar_scenario scenario =
+          astar_scenario_random(map, options->queries, query_seed);
+      bench_run(name, map, scenario, options, &result);
+      bench_write_result(file, options->format, &result, first);
+      first = false;
+      astar_scenario_free(&scenario);
+    }
+    for (size_t shape = 0; shape < BENCH_LENGTH(BENCH_SHAPES); shape++) {
+      snprintf(name, sizeof(name), "%s-%zux%zu", BENCH_SHAPES[shape],
+               sizes[s].rows, sizes[s].cols);
+      bench_seeds(options, name, &map_seed, &query_seed);
+      tile_map map = tile_map_generate_named(
+          BENCH_SHAPES[shape], sizes[s].rows, sizes[s].cols, map_seed);
+      astar_scenario scenario =
+          astar_scenario_random(map, options->queries, query_seed);
+      bench_run(name, map, scenario, options, &result);
+      bench_write_result(file, options->format, &result, first);
+      first = false;
+      astar_scenario_free(&scenario);
+    }
+  }
+
+  for (size_t shape = 0; options->large && shape < 2; shape++) {
+    bench_map_size size = BENCH_LARGE_SIZE;
+    // no caves: a query into a small cave would search the whole map
+    snprintf(name, sizeof(name), shape ? "rooms-%zux%zu-near"
+                                       : "random-%zux%zu-w%02d-near",
+             size.rows, size.cols, (int)(BENCH_LARGE_WALL_RATIO * 100 + 0.5));
+    bench_seeds(options, name, &map_seed, &query_seed);
+    tile_map map =
+        shape ? tile_map_generate_named("rooms", size.rows, size.cols,
+                                        map_seed)
+              : tile_map_generate(size.rows, size.cols,
+                                  1 - BENCH_LARGE_WALL_RATIO, map_seed);
+    astar_scenario scenario = astar_scenario_random_near(
+        map, options->queries, BENCH_LARGE_RADIUS, query_seed);
+    bench_run(name, map, scenario, options, &result);
+    bench_write_result(file, options->format, &result, first);
+    first = false;
+    astar_scenario_free(&scenario);
+  }
+
+  for (size_t i = 0; i < options->movingai_count; i++) {
+    const char *map_path = options->movingai[i][0];
+    const char *scen_path = options->movingai[i][1];
+    tile_map map = tile_map_read_movingai(map_path);
+    astar_scenario scenario =
+        map ? astar_scenario_read_movingai(scen_path, options->limit) : NULL;
+    if (!map || !scenario) {
+      fprintf(stderr, "cannot read %s\n", map ? scen_path : map_path);
+      tile_map_free(&map);
+      status = EXIT_FAILURE;
+      continue;
+    }
+    // drop queries that do not fit the map instead of reading past it
+    size_t kept = 0;
+    for (size_t q = 0; q < scenario->count; q++) {
+      astar_query query = scenario->queries[q];
+      if (tile_map_contains(map, query.start) &&
+          tile_map_contains(map, query.end)) {
+        scenario->queries[kept++] = query;
+      }
+    }
+    scenario->count = kept;
+    const char *base = strrchr(map_path, '/');
+    snprintf(name, sizeof(name), "movingai-%s", base ? base + 1 : map_path);
+    bench_run(name, map, scenario, options, &result);
+    bench_write_result(file, options->format, &result, first);
+    first = false;
+    astar_scenario_free(&scenario);
+  }
+
+  bench_write_footer(file, options->format, first);
+  if (file != stdout) {
+    fclose(file);
+  }
+  return status;
+}
+
+typedef struct __bench_record {
+  char name[BENCH_NAME_SIZE];
+  double median_us;
+  double p99_us;
+  double expanded;
+  double comparisons;
+} bench_record;
+
+typedef struct __bench_records {
+  size_t count;
+  size_t capacity;
+  bench_record *items;
+} bench_records;
+
+static void bench_record_set(bench_record *record, const char *key,
+                             const char *value) {
+  if (strcmp(key, "name") == 0) {
+    size_t length = strcspn(value, "\",\r\n");
+    if (length >= sizeof(record->name)) {
+      length = sizeof(record->name) - 1;
+    }
+    memcpy(record->name, value, length);
+    record->name[length] = '\0';
+  } else if (strcmp(key, "median_us") == 0) {
+    record->median_us = strtod(value, NULL);
+  } else if (strcmp(key, "p99_us") == 0) {
+    record->p99_us = strtod(value, NULL);
+  } else if (strcmp(key, "expanded") == 0) {
+    record->expanded = strtod(value, NULL);
+  } else if (strcmp(key, "comparisons") == 0) {
+    record->comparisons = strtod(value, NULL);
+  }
+}
+
+static bench_record *bench_records_add(bench_records *records) {
+  if (records->count == records->capacity) {
+    records->capacity = records->capacity ? records->capacity * 2 : 16;
+    records->items = (bench_record *)realloc(
+        records->items, sizeof(bench_record) * records->capacity);
+  }
+  bench_record *record = records->items + records->count++;
+  memset(record, 0, sizeof(*record));
+  return record;
+}
+
+static const char *BENCH_KEYS[] = {"name", "median_us", "p99_us", "expanded",
+                                   "comparisons"};
+
+/// Reads what bench_write_result writes: a CSV table with a header line, or
+/// a JSON array holding one object per line.
+static bool bench_read_records(const char *path, bench_records *records) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  char line[BENCH_LINE_SIZE];
+  char header[BENCH_LINE_SIZE];
+  bool is_json = false;
+  bool has_header = false;
+  while (fgets(line, sizeof(line), file)) {
+    if (!has_header && !is_json) {
+      is_json = line[strspn(line, " \t")] == '[';
+      if (!is_json) {
+        memcpy(header, line, sizeof(header));
+        has_header = true;
+      }
+      continue;
+    }
+    if (is_json) {
+      if (!strchr(line, '{')) {
+        continue;
+      }
+      bench_record *record = bench_records_add(records);
+      for (size_t k = 0; k < BENCH_LENGTH(BENCH_KEYS); k++) {
+        char pattern[64];
+        snprintf(pattern, sizeof(pattern), "\"%s\":", BENCH_KEYS[k]);
+        const char *found = strstr(line, pattern);
+        if (found) {
+          found += strlen(pattern);
+          found += strspn(found, " \"");
+          bench_record_set(record, BENCH_KEYS[k], found);
+        }
+      }
+      continue;
+    }
+    if (line[strspn(line, " \t\r\n")] == '\0') {
+      continue;
+    }
+    bench_record *record = bench_records_add(records);
+    const char *key = header;
+    const char *value = line;
+    for (;;) {
+      char name[64];
+      size_t length = strcspn(key, ",\r\n");
+      if (length < sizeof(name)) {
+        memcpy(name, key, length);
+        name[length] = '\0';
+        bench_record_set(record, name, value);
+      }
+      value += strcspn(value, ",\r\n");
+      if (key[length] != ',' || *value != ',') {
+        break;
+      }
+      key += length + 1;
+      value++;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+/// Percent change from base to current, 0 when there is no base.
+static double bench_change(double base, double current) {
+  return base > 0 ? (current / base - 1) * 100 : 0;
+}
+
+static int bench_compare(const bench_options *options) {
+  bench_records base = {0, 0, NULL};
+  bench_records current = {0, 0, NULL};
+  if (!bench_read_records(options->compare[0], &base) ||
+      !bench_read_records(options->compare[1], &current)) {
+    free(base.items);
+    free(current.items);
+    return 2;
+  }
+  size_t regressions = 0;
+  printf("%-32s %10s %10s %10s %10s  %s\n", "name", "median", "p99",
+         "expanded", "compared", "verdict");
+  for (size_t i = 0; i < current.count; i++) {
+    const bench_record *now = current.items + i;
+    const bench_record *was = NULL;
+    for (size_t j = 0; j < base.count && !was; j++) {
+      if (strcmp(base.items[j].name, now->name) == 0) {
+        was = base.items + j;
+      }
+    }
+    if (!was) {
+      printf("%-32s %10s %10s %10s %10s  new\n", now->name, "-", "-", "-", "-");
+      continue;
+    }
+    double changes[4] = {bench_change(was->median_us, now->median_us),
+                         bench_change(was->p99_us, now->p99_us),
+                         bench_change(was->expanded, now->expanded),
+                         bench_change(was->comparisons, now->comparisons)};
+    bool regressed = false;
+    for (size_t c = 0; c < 4; c++) {
+      regressed = regressed || changes[c] > options->threshold;
+    }
+    regressions += regressed;
+    printf("%-32s %+9.1f%% %+9.1f%% %+9.1f%% %+9.1f%%  %s\n", now->name,
+           changes[0], changes[1], changes[2], changes[3],
+           regressed ? "REGRESSION" : "ok");
+  }
+  for (size_t j = 0; j < base.count; j++) {
+    bool found = false;
+    for (size_t i = 0; i < current.count && !found; i++) {
+      found = strcmp(base.items[j].name, current.items[i].name) == 0;
+    }
+    if (!found) {
+      printf("%-32s %10s %10s %10s %10s  missing\n", base.items[j].name, "-",
+             "-", "-", "-");
+    }
+  }
+  printf("%zu regression(s) over %.1f%%\n", regressions, options->threshold);
+  free(base.items);
+  free(current.items);
+  return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void bench_usage(FILE *file) {
+  fprintf(file,
+          "usage: bench [options]\n"
+          "       bench --compare BASE NEW [--threshold PCT]\n"
+          "  --quick              smaller set of generated maps\n"
+          "  --large              add %zux%zu maps with local queries\n"
+          "  --runs N             measured passes per scenario (%d)\n"
+          "  --warmup N           unmeasured passes first (%d)\n"
+          "  --queries N          queries per generated map (%d)\n"
+          "  --seed N             seed of the generated maps (1)\n"
+          "  --movingai MAP SCEN  add a MovingAI map and scenario file\n"
+          "  --limit N            queries read per scenario file, 0 for all\n"
+          "  --expand ISA         relax neighbours with the scalar, sse4.1 or\n"
+          "                       avx2 kernel\n"
+          "  --interleave N       resolve N queries at a time, interleaved\n"
+          "  --prune              skip dead ends and swamps of every map\n"
+          "  --parallel N         resolve each query on N threads, not with\n"
+          "                       --interleave\n"
+          "  --format csv|json    output format (csv)\n"
+          "  --output FILE        write results to FILE instead of stdout\n"
+          "  --threshold PCT      allowed growth before a regression (%.0f)\n",
+          BENCH_LARGE_SIZE.rows, BENCH_LARGE_SIZE.cols, BENCH_DEFAULT_RUNS,
+          BENCH_DEFAULT_WARMUP, BENCH_DEFAULT_QUERIES,
+          BENCH_DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char **argv) {
+  bench_options options;
+  memset(&options, 0, sizeof(options));
+  options.runs = BENCH_DEFAULT_RUNS;
+  options.warmup = BENCH_DEFAULT_WARMUP;
+  options.queries = BENCH_DEFAULT_QUERIES;
+  options.seed = 1;
+  options.interleave = 1;
+  options.threshold = BENCH_DEFAULT_THRESHOLD;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--quick") == 0) {
+      options.quick = true;
+    } else if (strcmp(arg, "--large") == 0) {
+      options.large = true;
+    } else if (strcmp(arg, "--prune") == 0) {
+      options.prune = true;
+    } else if (strcmp(arg, "--interleave") == 0 && has_value) {
+      options.interleave = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--parallel") == 0 && has_value) {
+      options.parallel = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--runs") == 0 && has_value) {
+      options.runs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--warmup") == 0 && has_value) {
+      options.warmup = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--queries") == 0 && has_value) {
+      options.queries = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && has_value) {
+      options.seed = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--limit") == 0 && has_value) {
+      options.limit = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--expand") == 0 && has_value) {
+      const char *name = argv[++i];
+      bool found = false;
+      for (size_t isa = 0; isa < ASTAR_EXPAND_ISA_LENGTH && !found; isa++) {
+        astar_expand_isa kernel = (astar_expand_isa)isa;
+        found = strcmp(name, astar_expand_isa_str(kernel)) == 0 &&
+                astar_expand_set_isa(kernel);
+      }
+      if (!found) {
+        fprintf(stderr, "kernel %s is not available\n", name);
+        return 2;
+      }
+      options.expand_kernel = true;
+    } else if (strcmp(arg, "--format") == 0 && has_value) {
+      options.format = strcmp(argv[++i], "json") == 0 ? BENCH_JSON : BENCH_CSV;
+    } else if (strcmp(arg, "--output") == 0 && has_value) {
+      options.output = argv[++i];
+    } else if (strcmp(arg, "--threshold") == 0 && has_value) {
+      options.threshold = strtod(argv[++i], NULL);
+    } else if (strcmp(arg, "--movingai") == 0 && i + 2 < argc &&
+               options.movingai_count < BENCH_MAX_MOVINGAI) {
+      options.movingai[options.movingai_count][0] = argv[++i];
+      options.movingai[options.movingai_count++][1] = argv[++i];
+    } else if (strcmp(arg, "--compare") == 0 && i + 2 < argc) {
+      options.compare[0] = argv[++i];
+      options.compare[1] = argv[++i];
+    } else {
+      bench_usage(strcmp(arg, "--help") == 0 ? stdout : stderr);
+      return strcmp(arg, "--help") == 0 ? EXIT_SUCCESS : 2;
+    }
+  }
+  if (!options.runs) {
+    options.runs = 1;
+  }
+  if (!options.interleave) {
+    options.interleave = 1;
+  }
+  if (options.parallel && options.interleave > 1) {
+    fprintf(stderr, "--parallel and --interleave exclude each other\n");
+    return 2;
+  }
+
+  if (options.compare[0]) {
+    return bench_compare(&options);
+  }
+  return bench_suite(&options);
+}
@@ -1,16 +1,27 @@
 #include "image/bitmap.h"
 #include "struct/bool.h"
 #include "util/debug.h"
+#include <fcntl.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 bitmap_image bitmap_new(size_t width, size_t height) {
+  bitmap_image image = bitmap_alloc(width, height);
+  size_t byte_size = sizeof(bitmap_byte) * width * height * BYTES_PER_PIXEL;
+  memset(image->data, (bitmap_byte)(255), byte_size);
+  return image;
+}
+
+bitmap_image bitmap_alloc(size_t width, size_t height) {
   bitmap_image image;
   size_t byte_size = sizeof(bitmap_byte) * width * height * BYTES_PER_PIXEL;
   image = (bitmap_image)malloc(sizeof(*image) + byte_size);
-  memset(image->data, (bitmap_byte)(255), byte_size);
   image->width = width;
   image->height = height;
   return image;
@@ -36,94 +47,241 @@ inline void bitmap_set_color(bitmap_image image, size_t x, size_t y,
   ptr[0] = color.blue;
 }
 
-static bool bitmap_image_write_file_header(bitmap_image image, FILE *file,
-                                           size_t file_size);
-static bool bitmap_image_write_info_header(bitmap_image image, FILE *file);
+inline bitmap_byte *bitmap_row(bitmap_image image, size_t y) {
+  return image->data + y * image->width * BYTES_PER_PIXEL;
+}
+
+/// Pixels per fill pattern, 48 bytes hold a whole number of pixels and of
+/// 16-byte vector stores.
+#define BITMAP_SPAN_PIXELS 16
+
+void bitmap_fill_span(bitmap_byte *ptr, bitmap_color color, size_t count) {
+  bitmap_byte pattern[BITMAP_SPAN_PIXELS * BYTES_PER_PIXEL];
+  size_t head = count < BITMAP_SPAN_PIXELS ? count : BITMAP_SPAN_PIXELS;
+  for (size_t i = 0; i < head; i++) {
+    pattern[i * BYTES_PER_PIXEL + 2] = color.red;
+    pattern[i * BYTES_PER_PIXEL + 1] = color.green;
+    pattern[i * BYTES_PER_PIXEL + 0] = color.blue;
+  }
+  size_t done = 0;
+  for (; done + BITMAP_SPAN_PIXELS <= count; done += BITMAP_SPAN_PIXELS) {
+    memcpy(ptr + done * BYTES_PER_PIXEL, pattern, sizeof(pattern));
+  }
+  memcpy(ptr + done * BYTES_PER_PIXEL, pattern,
+         (count - done) * BYTES_PER_PIXEL);
+}
+
+static bool bitmap_write_header(size_t width, size_t height, FILE *file);
+static size_t bitmap_stride(size_t width);
+static size_t bitmap_block_rows(size_t stride);
+
 bool bitmap_image_write(bitmap_image image, FILE *file) {
   debugf("bitmap_image_write start\n");
   if (!file) {
     debugf("bitmap_image_write no file\n");
     return false;
   }
+  if (!bitmap_write_header(image->width, image->height, file)) {
+    return false;
+  }
+
   size_t width_bytes = image->width * BYTES_PER_PIXEL;
-  bitmap_byte padding[3] = {0, 0, 0};
-  size_t padding_size = (4 - (width_bytes) % 4) % 4;
-  size_t stride = width_bytes + padding_size;
+  size_t stride = bitmap_stride(image->width);
+  if (stride == width_bytes) {
+    // rows are already laid out like the pixel array
+    size_t size = width_bytes * image->height;
+    bool ok = !size || fwrite(image->data, 1, size, file) == size;
+    debugf("bitmap_image_write end\n");
+    return ok;
+  }
 
-  size_t file_size =
-      FILE_HEADER_SIZE + INFO_HEADER_SIZE + (stride * image->height);
+  size_t block_rows = bitmap_block_rows(stride);
+  bitmap_byte *block = (bitmap_byte *)calloc(block_rows, stride);
+  bool ok = true;
+  for (size_t y = 0; ok && y < image->height; y += block_rows) {
+    size_t rows =
+        image->height - y < block_rows ? image->height - y : block_rows;
+    for (size_t i = 0; i < rows; i++) {
+      // padding bytes stay zero from calloc
+      memcpy(block + i * stride, image->data + (y + i) * width_bytes,
+             width_bytes);
+    }
+    ok = fwrite(block, stride, rows, file) == rows;
+  }
+  free(block);
+  debugf("bitmap_image_write end\n");
+  return ok;
+}
 
-  debugf("bitmap_image_write_file_header start\n");
-  if (!bitmap_image_write_file_header(image, file, file_size)) {
+bool bitmap_stream_write(size_t width, size_t height, bitmap_row_writer writer,
+                         void *context, FILE *file) {
+  debugf("bitmap_stream_write start\n");
+  if (!file) {
+    debugf("bitmap_stream_write no file\n");
     return false;
   }
-  debugf("bitmap_image_write_file_header end\n");
-
-  debugf("bitmap_image_write_info_header start\n");
-  if (!bitmap_image_write_info_header(image, file)) {
+  if (!bitmap_write_header(width, height, file)) {
     return false;
   }
-  debugf("bitmap_image_write_info_header end\n");
 
-  for (int i = 0; i < image->height; i++) {
-    if (!fwrite(image->data + (i * width_bytes), BYTES_PER_PIXEL, image->width,
-                file)) {
-      return false;
-    }
-    if (!fwrite(padding, 1, padding_size, file)) {
-      return false;
+  size_t stride = bitmap_stride(width);
+  size_t block_rows = bitmap_block_rows(stride);
+  bitmap_byte *block = (bitmap_byte *)calloc(block_rows, stride);
+  bool ok = true;
+  for (size_t y = 0; ok && y < height; y += block_rows) {
+    size_t rows = height - y < block_rows ? height - y : block_rows;
+    for (size_t i = 0; ok && i < rows; i++) {
+      ok = writer(context, y + i, block + i * stride);
     }
+    ok = ok && fwrite(block, stride, rows, file) == rows;
   }
+  free(block);
+  debugf("bitmap_stream_write end\n");
+  return ok;
+}
+
+static inline size_t bitmap_stride(size_t width) {
+  size_t width_bytes = width * BYTES_PER_PIXEL;
+  return width_bytes + (4 - width_bytes % 4) % 4;
+}
+
+/// Rows written per fwrite, at least one.
+static inline size_t bitmap_block_rows(size_t stride) {
+  size_t rows = BITMAP_WRITE_BLOCK_SIZE / (stride ? stride : 1);
+  return rows ? rows : 1;
+}
+
+static inline void bitmap_put_le32(bitmap_byte *ptr, size_t value) {
+  ptr[0] = (bitmap_byte)(value);
+  ptr[1] = (bitmap_byte)(value >> 8);
+  ptr[2] = (bitmap_byte)(value >> 16);
+  ptr[3] = (bitmap_byte)(value >> 24);
+}
+
+static bool bitmap_write_header(size_t width, size_t height, FILE *file) {
+  size_t stride = bitmap_stride(width);
+  size_t header_size = FILE_HEADER_SIZE + INFO_HEADER_SIZE;
+  // every size below is stored as 32 bits, refuse rather than truncate
+  if (width > BITMAP_MAX_DIMENSION || height > BITMAP_MAX_DIMENSION ||
+      (height && stride > (BITMAP_MAX_FILE_SIZE - header_size) / height)) {
+    fprintf(stderr, "bitmap: %zu x %zu pixels do not fit in a bmp file\n",
+            width, height);
+    return false;
+  }
+  size_t image_size = stride * height;
+  size_t file_size = header_size + image_size;
+
+  bitmap_byte header_bytes[FILE_HEADER_SIZE + INFO_HEADER_SIZE] = {0};
+  bitmap_byte *file_header = header_bytes;
+  bitmap_byte *info_header = header_bytes + FILE_HEADER_SIZE;
+
+  /// signature, image file size in bytes, start of pixel array
+  file_header[0] = (bitmap_byte)('B');
+  file_header[1] = (bitmap_byte)('M');
+  bitmap_put_le32(file_header + 2, file_size);
+  bitmap_put_le32(file_header + 10, header_size);
+
+  /// header size, image width and height, color planes, bits per pixel,
+  /// image size, horizontal and vertical resolution
+  bitmap_put_le32(info_header, INFO_HEADER_SIZE);
+  bitmap_put_le32(info_header + 4, width);
+  bitmap_put_le32(info_header + 8, height);
+  info_header[12] = (bitmap_byte)(1);
+  info_header[14] = (bitmap_byte)(BYTES_PER_PIXEL * 8);
+  bitmap_put_le32(info_header + 20, image_size);
+  bitmap_put_le32(info_header + 24, BITMAP_PIXELS_PER_METER);
+  bitmap_put_le32(info_header + 28, BITMAP_PIXELS_PER_METER);
+
+  return fwrite(header_bytes, sizeof(header_bytes), 1, file) == 1;
+}
+
+static inline size_t bitmap_get_le32(const bitmap_byte *ptr) {
+  return (size_t)ptr[0] | (size_t)ptr[1] << 8 | (size_t)ptr[2] << 16 |
+         (size_t)ptr[3] << 24;
+}
+
+static inline size_t bitmap_get_le16(const bitmap_byte *ptr) {
+  return (size_t)ptr[0] | (size_t)ptr[1] << 8;
+}
+
+bitmap_reader bitmap_open(const char *path) {
+  debugf("bitmap_open %s\n", path);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    debugf("bitmap_open cannot open %s\n", path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < FILE_HEADER_SIZE + INFO_HEADER_SIZE) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)st.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    debugf("bitmap_open cannot map %s\n", path);
+    return NULL;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  const bitmap_byte *bytes = (const bitmap_byte *)mapping;
+  const bitmap_byte *info = bytes + FILE_HEADER_SIZE;
+  size_t pixel_offset = bitmap_get_le32(bytes + 10);
+  size_t info_size = bitmap_get_le32(info);
+  int32_t width = (int32_t)bitmap_get_le32(info + 4);
+  int32_t height = (int32_t)bitmap_get_le32(info + 8);
+  size_t bits_per_pixel = bitmap_get_le16(info + 14);
+  size_t compression = bitmap_get_le32(info + 16);
+  size_t colors_used = bitmap_get_le32(info + 32);
+
+  bitmap_reader reader = (bitmap_reader)malloc(sizeof(*reader));
+  reader->width = width > 0 ? (size_t)width : 0;
+  reader->height = height < 0 ? (size_t)-(int64_t)height : (size_t)height;
+  reader->bits_per_pixel = bits_per_pixel;
+  reader->stride = (reader->width * bits_per_pixel + 31) / 32 * 4;
+  reader->top_down = height < 0;
+  reader->palette_size = 0;
+  reader->palette = NULL;
+  reader->pixels = bytes + pixel_offset;
+  reader->mapping = mapping;
+  reader->mapping_size = size;
+  if (bits_per_pixel <= 8) {
+    size_t full_palette = (size_t)1 << bits_per_pixel;
+    reader->palette_size = colors_used ? colors_used : full_palette;
+    reader->palette = bytes + FILE_HEADER_SIZE + info_size;
+  }
+
+  bool ok = bytes[0] == 'B' && bytes[1] == 'M' && width > 0 &&
+            info_size >= INFO_HEADER_SIZE && compression == 0 &&
+            (bits_per_pixel == 1 || bits_per_pixel == 8 ||
+             bits_per_pixel == 24) &&
+            pixel_offset <= size &&
+            reader->stride * reader->height <= size - pixel_offset;
+  if (ok && reader->palette) {
+    ok = reader->palette_size <= 256 &&
+         FILE_HEADER_SIZE + info_size + reader->palette_size * 4 <= size;
+  }
+  if (!ok) {
+    debugf("bitmap_open unsupported bitmap %s\n", path);
+    bitmap_close(&reader);
+  }
+  return reader;
+}
+
+void bitmap_close(bitmap_reader *reader_ptr) {
+  if (reader_ptr && *reader_ptr) {
+    munmap((*reader_ptr)->mapping, (*reader_ptr)->mapping_size);
+    free(*reader_ptr);
+    *reader_ptr = NULL;
+  }
+}
 
-  return true;
-}
-
-static bool bitmap_image_write_file_header(bitmap_image image, FILE *file,
-                                           size_t file_size) {
-  bitmap_byte header_bytes[FILE_HEADER_SIZE] = {
-      0, 0,       /// signature
-      0, 0, 0, 0, /// image file size in bytes
-      0, 0, 0, 0, /// reserved
-      0, 0, 0, 0, /// start of pixel array
-  };
-
-  header_bytes[0] = (bitmap_byte)('B');
-  header_bytes[1] = (bitmap_byte)('M');
-  header_bytes[2] = (bitmap_byte)(file_size);
-  header_bytes[3] = (bitmap_byte)(file_size >> 8);
-  header_bytes[4] = (bitmap_byte)(file_size >> 16);
-  header_bytes[5] = (bitmap_byte)(file_size >> 24);
-  header_bytes[10] = (bitmap_byte)(FILE_HEADER_SIZE + INFO_HEADER_SIZE);
-
-  return !!fwrite(header_bytes, FILE_HEADER_SIZE, 1, file);
-}
-
-static bool bitmap_image_write_info_header(bitmap_image image, FILE *file) {
-  bitmap_byte header_bytes[INFO_HEADER_SIZE] = {
-      0, 0, 0, 0, /// header size
-      0, 0, 0, 0, /// image width
-      0, 0, 0, 0, /// image height
-      0, 0,       /// number of color planes
-      0, 0,       /// bits per pixel
-      0, 0, 0, 0, /// compression
-      0, 0, 0, 0, /// image size
-      0, 0, 0, 0, /// horizontal resolution
-      0, 0, 0, 0, /// vertical resolution
-      0, 0, 0, 0, /// colors in color table
-      0, 0, 0, 0, /// important color count
-  };
-
-  header_bytes[0] = (bitmap_byte)(INFO_HEADER_SIZE);
-  header_bytes[4] = (bitmap_byte)(image->width);
-  header_bytes[5] = (bitmap_byte)(image->width >> 8);
-  header_bytes[6] = (bitmap_byte)(image->width >> 16);
-  header_bytes[7] = (bitmap_byte)(image->width >> 24);
-  header_bytes[8] = (bitmap_byte)(image->height);
-  header_bytes[9] = (bitmap_byte)(image->height >> 8);
-  header_bytes[10] = (bitmap_byte)(image->height >> 16);
-  header_bytes[11] = (bitmap_byte)(image->height >> 24);
-  header_bytes[12] = (bitmap_byte)(1);
-  header_bytes[14] = (unsigned char)(BYTES_PER_PIXEL * 8);
-
-  return !!fwrite(header_bytes, INFO_HEADER_SIZE, 1, file);
+/// Rows are numbered bottom-up like bitmap_image rows, whatever the order in
+/// the file.
+inline const bitmap_byte *bitmap_reader_row(const bitmap_reader reader,
+                                            size_t y) {
+  size_t stored = reader->top_down ? reader->height - 1 - y : y;
+  return reader->pixels + stored * reader->stride;
 }
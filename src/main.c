@@ -1,9 +1,13 @@
 #include "algorithm/astar.h"
 #include "algorithm/astar_draw_image.h"
+#include "algorithm/astar_prune.h"
+#include "algorithm/astar_stats.h"
+#include "algorithm/astar_view.h"
 #include "image/bitmap.h"
 #include "struct/point.h"
 #include "struct/tile.h"
-#include "util/debug.h"
+#include "struct/tile_generate.h"
+#include "util/trace.h"
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,37 +17,6 @@ size_t MAP_ROWS = 270;
 size_t MAP_COLS = 480;
 double EMPTY_RATIO = 0.54321;
 
-tile_map generate_tile_map(size_t rows, size_t cols) {
-  tile_map map = tile_map_new(rows, cols);
-  for (size_t r = 0; r < rows; r++) {
-    for (size_t c = 0; c < cols; c++) {
-      bool is_empty = (double)((unsigned)random() % 1000) / 1000 < EMPTY_RATIO;
-      tile_t val = tile_from_int(is_empty ? TILE_EMPTY : TILE_WALL);
-      tile_map_set(map, r, c, val);
-    }
-  }
-  return map;
-}
-
-point generate_empty_point(tile_map map, point *except) {
-  point pt;
-  for (size_t i = 0; i < 1000; i++) {
-    pt.row = (unsigned)random() % map->rows;
-    pt.col = (unsigned)random() % map->cols;
-    if (tile_map_get(map, pt.row, pt.col) != TILE_EMPTY) {
-      continue;
-    }
-    if (except && point_equal(pt, *except)) {
-      continue;
-    }
-    return pt;
-  }
-  debugf("failed to generate empty point in %d tries.\n", 1000);
-  pt.row = map->rows;
-  pt.col = map->cols;
-  return pt;
-}
-
 double current_time() {
   struct timespec ts;
   timespec_get(&ts, TIME_UTC);
@@ -53,24 +26,39 @@ double current_time() {
 int main() {
   unsigned seed = (long)current_time();
   // unsigned seed = 283098000;
-  srandom(seed);
   printf("seed: %u\n", seed);
 
-  tile_map map = generate_tile_map(MAP_ROWS, MAP_COLS);
+  tile_map map = tile_map_generate(MAP_ROWS, MAP_COLS, EMPTY_RATIO, seed);
+
+  // ASTAR_TRACE=<file> traces the search into <file>, replayable with
+  // trace_decode on the map written next to it
+  const char *trace_path = getenv("ASTAR_TRACE");
+  if (trace_path) {
+    char map_path[4096];
+    snprintf(map_path, sizeof(map_path), "%s.map.bmp", trace_path);
+    FILE *trace_map_file = fopen(map_path, "wb");
+    if (trace_map_file) {
+      tile_map_write_bitmap(map, trace_map_file);
+      fclose(trace_map_file);
+    }
+    trace_set_failure_path(trace_path);
+    trace_enable(true);
+  }
 
   FILE *map_file = fopen("astar_map.generated.bmp", "wb");
-  bitmap_image map_image = tile_map_draw_image(map);
-  bitmap_image_write(map_image, map_file);
+  tile_map_write_image(map, map_file);
   fclose(map_file);
-  bitmap_free(&map_image);
 
-  point start_point = generate_empty_point(map, NULL);
+  tile_empty_index empty_index = tile_empty_index_new(map);
+  point start_point = tile_empty_index_sample(empty_index, map, seed, 0, NULL);
   if (!tile_map_contains(map, start_point)) {
     printf("seed: %u\n", seed);
     return EXIT_FAILURE;
   }
   printf("start point is (%zu, %zu)\n", start_point.row, start_point.col);
-  point end_point = generate_empty_point(map, &start_point);
+  point end_point =
+      tile_empty_index_sample(empty_index, map, seed, 1, &start_point);
+  tile_empty_index_free(&empty_index);
   if (!tile_map_contains(map, end_point)) {
     printf("seed: %u\n", seed);
     return EXIT_FAILURE;
@@ -84,9 +72,33 @@ int main() {
   printf("astar init time: %.3fms = %.1f times/frame\n", time_cost_init,
          50 / time_cost_init / 3);
 
+  // ASTAR_VIEW=<iterations> draws the search live on the terminal every
+  // <iterations> iterations, the whole map at once; resolve times include it
+  const char *view_interval = getenv("ASTAR_VIEW");
+  astar_view view = NULL;
+  size_t view_rows, view_cols;
+  if (view_interval &&
+      astar_view_terminal_size(stdout, &view_rows, &view_cols)) {
+    fflush(stdout);
+    view = astar_view_new(stdout, view_rows, view_cols);
+    view->frame_interval = strtoul(view_interval, NULL, 10);
+    astar_view_fit(view, map);
+    astar_set_observer(astar, astar_view_observe, view);
+  }
+
   double time_before_resolve = current_time();
   astar_resolve(astar);
   double time_after_resolve = current_time();
+  if (view) {
+    astar_set_observer(astar, NULL, NULL);
+    size_t frames = view->frames, bytes = view->bytes;
+    astar_view_free(&view);
+    printf("view: %zu frames, %.1f bytes/frame\n", frames,
+           frames ? (double)bytes / frames : 0.0);
+  }
+  if (trace_path) {
+    trace_dump(trace_path);
+  }
   // astar_print(astar, stdout);
   printf("astar iteration: %zu, path length: %zu\n", astar->iteration,
          astar->path_length);
@@ -107,11 +119,38 @@ int main() {
   printf("map: %zu x %zu = %zu blocks\n", MAP_ROWS, MAP_COLS,
          MAP_ROWS * MAP_COLS);
 
+  // the same query again, skipping dead ends and swamps
+  double time_before_prune = current_time();
+  astar_prune prune = astar_prune_new(map);
+  double time_cost_prune = current_time() - time_before_prune;
+  if (prune && prune->empty_count) {
+    astar_context pruned = astar_init(map, start_point, end_point);
+    astar_set_owns_map(pruned, false); // shared with astar
+    astar_set_prune(pruned, prune);
+    astar_resolve(pruned);
+    astar_prune_query query =
+        astar_prune_query_new(prune, start_point, end_point);
+    printf("prune time: %.3fms, skipped %.1f%% of empty tiles\n",
+           time_cost_prune,
+           100.0 * astar_prune_count(prune, &query) / prune->empty_count);
+    printf("pruned iteration: %zu (%.1f%% fewer), path cost: %.1f\n",
+           pruned->iteration,
+           astar->iteration
+               ? 100.0 * (1 - (double)pruned->iteration / astar->iteration)
+               : 0.0,
+           (double)pruned->path_cost);
+    astar_free(&pruned);
+  }
+  astar_prune_free(&prune);
+
   FILE *result_file = fopen("astar_result.generated.bmp", "wb");
-  bitmap_image result_image = astar_draw_image(astar);
-  bitmap_image_write(result_image, result_file);
+  astar_write_image(astar, result_file);
   fclose(result_file);
-  bitmap_free(&result_image);
+
+  if (ASTAR_STATS_ENABLED) {
+    printf("stats: ");
+    astar_stats_write_json(astar_get_stats(astar), stdout);
+  }
 
   return EXIT_SUCCESS;
 }
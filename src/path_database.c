@@ -0,0 +1,213 @@
+#include "algorithm/astar.h"
+#include "algorithm/astar_cpd.h"
+#include "algorithm/astar_service.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include "util/parallel.h"
+#include "util/trace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Builds and measures compressed path databases, see algorithm/astar_cpd.h.
+///
+/// `build` writes the database of a map to a file and prints the build time
+/// and sizes. `query` maps a database, answers random queries between empty
+/// tiles with it and with astar_resolve, and prints both latencies, the
+/// path costs and the queries where the two disagree on reachability.
+
+#define DATABASE_DEFAULT_QUERIES 1000
+
+typedef struct __database_options {
+  const char *command;
+  const char *map;
+  const char *generate; /// generator name, see tile_map_generate_named
+  size_t rows;
+  size_t cols;
+  unsigned long long map_seed;
+  const char *database;
+  size_t queries;
+  unsigned long long seed;
+} database_options;
+
+static tile_map database_load_map(const database_options *options) {
+  if (options->map) {
+    return tile_map_read(options->map);
+  }
+  return tile_map_generate_named(options->generate, options->rows,
+                                 options->cols, options->map_seed);
+}
+
+static int database_build(const database_options *options, tile_map map) {
+  uint64_t started = trace_clock_ns();
+  astar_cpd cpd = astar_cpd_build(map);
+  double seconds = (trace_clock_ns() - started) / 1e9;
+  if (!cpd) {
+    fprintf(stderr, "the map has too many empty tiles\n");
+    return EXIT_FAILURE;
+  }
+  FILE *file = fopen(options->database, "wb");
+  bool written = file && astar_cpd_write(cpd, file);
+  if (file) {
+    written = fclose(file) == 0 && written;
+  }
+  if (!written) {
+    fprintf(stderr, "cannot write %s\n", options->database);
+    astar_cpd_free(&cpd);
+    return EXIT_FAILURE;
+  }
+  const astar_cpd_header *header = cpd->header;
+  size_t tiles = header->tile_count;
+  printf("{\"rows\": %llu, \"cols\": %llu, \"tiles\": %zu, \"threads\": %zu, "
+         "\"build_seconds\": %.3f, \"runs\": %llu, \"runs_per_source\": %.2f, "
+         "\"bytes\": %zu, \"uncompressed_bytes\": %zu}\n",
+         (unsigned long long)header->rows, (unsigned long long)header->cols,
+         tiles, parallel_threads(), seconds,
+         (unsigned long long)header->run_count,
+         tiles ? (double)header->run_count / tiles : 0.0, cpd->image_size,
+         tiles * tiles / 2); // a 4 bit move for every pair
+  astar_cpd_free(&cpd);
+  return EXIT_SUCCESS;
+}
+
+static int database_query(const database_options *options, tile_map map) {
+  astar_cpd cpd = astar_cpd_open(options->database);
+  if (!cpd) {
+    fprintf(stderr, "cannot open %s\n", options->database);
+    return EXIT_FAILURE;
+  }
+  if (!astar_cpd_matches(cpd, map)) {
+    fprintf(stderr, "%s was built for another map\n", options->database);
+    astar_cpd_free(&cpd);
+    return EXIT_FAILURE;
+  }
+  tile_empty_index index = tile_empty_index_new(map);
+  if (index->count < 2) {
+    fprintf(stderr, "the map has less than two empty tiles\n");
+    tile_empty_index_free(&index);
+    astar_cpd_free(&cpd);
+    return EXIT_FAILURE;
+  }
+
+  astar_context astar = astar_init(map, (point){0, 0}, (point){0, 0});
+  point *path = (point *)malloc(sizeof(point) * index->count);
+  astar_latency database_latency, search_latency;
+  astar_latency_clear(&database_latency);
+  astar_latency_clear(&search_latency);
+  size_t solved = 0, disagreements = 0, database_steps = 0;
+  double database_cost = 0, search_cost = 0;
+  for (size_t q = 0; q < options->queries; q++) {
+    point start =
+        tile_empty_index_sample(index, map, options->seed, 2 * q, NULL);
+    point end =
+        tile_empty_index_sample(index, map, options->seed, 2 * q + 1, &start);
+    size_t length;
+    aster_cost_t cost;
+    uint64_t before = trace_clock_ns();
+    astar_state state =
+        astar_cpd_path(cpd, start, end, path, index->count, &length, &cost);
+    uint64_t after = trace_clock_ns();
+    astar_latency_add(&database_latency, after - before);
+
+    astar_reset(astar, start, end);
+    before = trace_clock_ns();
+    astar_resolve(astar);
+    astar_latency_add(&search_latency, trace_clock_ns() - before);
+
+    if (state != astar->state) {
+      disagreements++;
+    } else if (state == ASTAR_SUCCEEDED) {
+      solved++;
+      database_steps += length;
+      database_cost += cost;
+      search_cost += astar->path_cost;
+    }
+  }
+
+  printf("{\"queries\": %zu, \"solved\": %zu, \"disagreements\": %zu, "
+         "\"database_bytes\": %zu, \"mean_path_length\": %.1f, "
+         "\"search_cost_ratio\": %.4f,\n \"database_latency\": ",
+         options->queries, solved, disagreements, cpd->image_size,
+         solved ? (double)database_steps / solved : 0.0,
+         database_cost > 0 ? search_cost / database_cost : 0.0);
+  astar_latency_write_json(&database_latency, stdout);
+  printf(",\n \"search_latency\": ");
+  astar_latency_write_json(&search_latency, stdout);
+  printf("}\n");
+
+  free(path);
+  astar_free(&astar); // frees the map too
+  tile_empty_index_free(&index);
+  astar_cpd_free(&cpd);
+  return disagreements ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void database_usage() {
+  fprintf(stderr,
+          "usage: path_database build (--map MAP | --generate KIND ROWS COLS "
+          "SEED)\n"
+          "                           --database FILE\n"
+          "       path_database query (--map MAP | --generate KIND ROWS COLS "
+          "SEED)\n"
+          "                           --database FILE [--queries N] "
+          "[--seed N]\n"
+          "  --map MAP          bitmap or MovingAI .map file\n"
+          "  --generate KIND    random, cave, maze or rooms map\n"
+          "  --database FILE    database written by build\n"
+          "  --queries N        random queries to measure (%d)\n"
+          "  --seed N           seed of the queries (1)\n",
+          DATABASE_DEFAULT_QUERIES);
+}
+
+int main(int argc, char **argv) {
+  database_options options;
+  memset(&options, 0, sizeof(options));
+  options.queries = DATABASE_DEFAULT_QUERIES;
+  options.seed = 1;
+  if (argc > 1) {
+    options.command = argv[1];
+  }
+  for (int i = 2; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--map") == 0 && has_value) {
+      options.map = argv[++i];
+    } else if (strcmp(arg, "--generate") == 0 && i + 4 < argc) {
+      options.generate = argv[++i];
+      options.rows = strtoul(argv[++i], NULL, 10);
+      options.cols = strtoul(argv[++i], NULL, 10);
+      options.map_seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--database") == 0 && has_value) {
+      options.database = argv[++i];
+    } else if (strcmp(arg, "--queries") == 0 && has_value) {
+      options.queries = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && has_value) {
+      options.seed = strtoull(argv[++i], NULL, 10);
+    } else {
+      database_usage();
+      return 2;
+    }
+  }
+  bool build = options.command && strcmp(options.command, "build") == 0;
+  bool query = options.command && strcmp(options.command, "query") == 0;
+  if ((!build && !query) || (!options.map && !options.generate) ||
+      !options.database) {
+    database_usage();
+    return 2;
+  }
+  tile_map map = database_load_map(&options);
+  if (!map) {
+    fprintf(stderr, "cannot load the map\n");
+    return EXIT_FAILURE;
+  }
+  if (build) {
+    int status = database_build(&options, map);
+    tile_map_free(&map);
+    return status;
+  }
+  return database_query(&options, map);
+}
@@ -1,6 +1,11 @@
 #include "struct/tile.h"
 #include "struct/point.h"
+#include "struct/tile_store.h"
+#include "util/debug.h"
+#include "util/parallel.h"
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +13,10 @@
 inline tile_t tile_from_int(int i) { return (unsigned)i % TILE_INVALID; }
 inline tile_t tile_from_char(char c) { return tile_from_int((int)(c - '0')); }
 
+/// Ids keep data derived from a freed map from matching a new map that
+/// reuses its address.
+static _Atomic uint64_t tile_map_last_id;
+
 char *tile_str(tile_t value) {
   static const char *str[] = {EMPTY_BLOCK, WALL_BLOCK, INVALID_BLOCK};
   return (char *)str[value];
@@ -20,41 +29,60 @@ tile_map tile_map_new(size_t rows, size_t cols) {
   memset(ret->tiles, 0, tile_size);
   ret->rows = rows;
   ret->cols = cols;
+  ret->version = 0;
+  ret->id = tile_map_new_id();
+  ret->chunks = NULL;
+  ret->snapshot = NULL;
   return ret;
 }
 
+uint64_t tile_map_new_id() {
+  return atomic_fetch_add(&tile_map_last_id, 1) + 1;
+}
+
 void tile_map_free(tile_map *map_ptr) {
   if (map_ptr) {
+    if (*map_ptr && (*map_ptr)->snapshot) {
+      tile_snapshot_release((*map_ptr)->snapshot);
+    }
     free(*map_ptr);
     *map_ptr = NULL;
   }
 }
 
+char *tile_print_block(char *out, const char *block) {
+  size_t length = strlen(block);
+  memcpy(out, block, length);
+  return out + length;
+}
+
+void tile_print_border(char *line, size_t cols, FILE *f) {
+  char *out = line;
+  for (size_t c = 0; c < cols + 2; c++) {
+    out = tile_print_block(out, BORDER_BLOCK);
+  }
+  *out++ = '\n';
+  fwrite(line, 1, out - line, f);
+}
+
 void tile_map_print(const tile_map map, FILE *f) {
   if (!f) {
     f = stdout;
   }
-  fprintf(f, "\n");
-  fprintf(f, BORDER_BLOCK);
-  for (size_t c = 0; c < map->cols; c++) {
-    fprintf(f, BORDER_BLOCK);
-  }
-  fprintf(f, BORDER_BLOCK);
-  fprintf(f, "\n");
+  char *line = (char *)malloc(TILE_PRINT_LINE(map->cols));
+  fputc('\n', f);
+  tile_print_border(line, map->cols, f);
   for (size_t r = 0; r < map->rows; r++) {
-    fprintf(f, BORDER_BLOCK);
+    char *out = tile_print_block(line, BORDER_BLOCK);
     for (size_t c = 0; c < map->cols; c++) {
-      fprintf(f, "%3s", tile_str(tile_map_get(map, r, c)));
+      out = tile_print_block(out, tile_str(tile_map_get(map, r, c)));
     }
-    fprintf(f, BORDER_BLOCK);
-    fprintf(f, "\n");
-  }
-  fprintf(f, BORDER_BLOCK);
-  for (size_t c = 0; c < map->cols; c++) {
-    fprintf(f, BORDER_BLOCK);
+    out = tile_print_block(out, BORDER_BLOCK);
+    *out++ = '\n';
+    fwrite(line, 1, out - line, f);
   }
-  fprintf(f, BORDER_BLOCK);
-  fprintf(f, "\n");
+  tile_print_border(line, map->cols, f);
+  free(line);
 }
 
 inline tile_t tile_map_get(const tile_map map, size_t row, size_t col) {
@@ -71,13 +99,168 @@ inline size_t tile_map_pos(const tile_map map, size_t row, size_t col) {
 }
 
 inline tile_t tile_map_pos_get(const tile_map map, size_t pos) {
+  if (map->chunks) {
+    return map->chunks[pos >> TILE_CHUNK_BITS][pos & TILE_CHUNK_MASK];
+  }
   return map->tiles[pos];
 }
 
 inline void tile_map_pos_set(tile_map map, size_t pos, tile_t value) {
+  if (map->chunks) {
+    debugf("tile_map_pos_set on read-only snapshot view ignored\n");
+    return;
+  }
   map->tiles[pos] = value;
+  map->version++;
 }
 
 bool tile_map_contains(tile_map map, point pt) {
   return pt.row >= 0 && pt.row < map->rows && pt.col >= 0 && pt.col < map->cols;
 }
+
+typedef struct __tile_bitmap_load {
+  bitmap_reader reader;
+  tile_map map;
+  const tile_color *colors;
+  size_t color_count;
+  tile_t palette_tiles[256]; /// palette index to tile, for 1- and 8-bit files
+} tile_bitmap_load;
+
+static inline tile_t tile_from_bgr(const tile_bitmap_load *load,
+                                   bitmap_byte blue, bitmap_byte green,
+                                   bitmap_byte red) {
+  for (size_t i = 0; i < load->color_count; i++) {
+    bitmap_color color = load->colors[i].color;
+    if (color.red == red && color.green == green && color.blue == blue) {
+      return load->colors[i].tile;
+    }
+  }
+  unsigned luma = (299u * red + 587u * green + 114u * blue) / 1000;
+  return luma < 128 ? TILE_WALL : TILE_EMPTY;
+}
+
+static void tile_map_read_rows(void *context, size_t begin, size_t end) {
+  tile_bitmap_load *load = (tile_bitmap_load *)context;
+  size_t cols = load->map->cols;
+  for (size_t row = begin; row < end; row++) {
+    const bitmap_byte *src = bitmap_reader_row(load->reader, row);
+    tile_t *dst = load->map->tiles + row * cols;
+    switch (load->reader->bits_per_pixel) {
+    case 1:
+      for (size_t col = 0; col < cols; col++) {
+        dst[col] = load->palette_tiles[(src[col >> 3] >> (7 - (col & 7))) & 1];
+      }
+      break;
+    case 8:
+      for (size_t col = 0; col < cols; col++) {
+        dst[col] = load->palette_tiles[src[col]];
+      }
+      break;
+    default: {
+      // painted maps are mostly long runs of one color
+      uint32_t last_key = UINT32_MAX;
+      tile_t last_tile = TILE_EMPTY;
+      for (size_t col = 0; col < cols; col++, src += 3) {
+        uint32_t key = (uint32_t)src[0] | (uint32_t)src[1] << 8 |
+                       (uint32_t)src[2] << 16;
+        if (key != last_key) {
+          last_key = key;
+          last_tile = tile_from_bgr(load, src[0], src[1], src[2]);
+        }
+        dst[col] = last_tile;
+      }
+      break;
+    }
+    }
+  }
+}
+
+tile_map tile_map_read_bitmap(const char *path, const tile_color *colors,
+                              size_t color_count) {
+  bitmap_reader reader = bitmap_open(path);
+  if (!reader) {
+    return NULL;
+  }
+  tile_map map = tile_map_new(reader->height, reader->width);
+  tile_bitmap_load load = {reader, map, colors, color_count, {TILE_EMPTY}};
+  for (size_t i = 0; i < reader->palette_size; i++) {
+    const bitmap_byte *entry = reader->palette + i * 4;
+    load.palette_tiles[i] = tile_from_bgr(&load, entry[0], entry[1], entry[2]);
+  }
+  parallel_for(0, map->rows, tile_map_read_rows, &load);
+  bitmap_close(&reader);
+  return map;
+}
+
+static bool tile_map_write_row(void *context, size_t y, bitmap_byte *row) {
+  static const bitmap_color colors[] = {BITMAP_WHITE, BITMAP_BLACK,
+                                        BITMAP_MAGENTA};
+  const tile_map map = (const tile_map)context;
+  for (size_t col = 0; col < map->cols; col++, row += BYTES_PER_PIXEL) {
+    bitmap_color color = colors[tile_map_get(map, y, col)];
+    row[0] = color.blue;
+    row[1] = color.green;
+    row[2] = color.red;
+  }
+  return true;
+}
+
+bool tile_map_write_bitmap(const tile_map map, FILE *file) {
+  return bitmap_stream_write(map->cols, map->rows, tile_map_write_row, map,
+                             file);
+}
+
+static inline tile_t tile_from_movingai(int c) {
+  return c == '.' || c == 'G' || c == 'S' ? TILE_EMPTY : TILE_WALL;
+}
+
+tile_map tile_map_read_movingai(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    debugf("tile_map_read_movingai cannot open %s\n", path);
+    return NULL;
+  }
+  size_t rows = 0;
+  size_t cols = 0;
+  char key[32];
+  while (fscanf(file, "%31s", key) == 1 && strcmp(key, "map") != 0) {
+    if (strcmp(key, "height") == 0) {
+      if (fscanf(file, "%zu", &rows) != 1) {
+        break;
+      }
+    } else if (strcmp(key, "width") == 0) {
+      if (fscanf(file, "%zu", &cols) != 1) {
+        break;
+      }
+    } else if (fscanf(file, "%31s", key) != 1) { // type, value ignored
+      break;
+    }
+  }
+  if (strcmp(key, "map") != 0 || !rows || !cols) {
+    debugf("tile_map_read_movingai bad header in %s\n", path);
+    fclose(file);
+    return NULL;
+  }
+  tile_map map = tile_map_new(rows, cols);
+  size_t pos = 0;
+  for (int c; pos < rows * cols && (c = fgetc(file)) != EOF;) {
+    if (c != '\n' && c != '\r') {
+      map->tiles[pos++] = tile_from_movingai(c);
+    }
+  }
+  fclose(file);
+  if (pos < rows * cols) {
+    debugf("tile_map_read_movingai %s ends after %zu tiles\n", path, pos);
+    tile_map_free(&map);
+  }
+  return map;
+}
+
+tile_map tile_map_read(const char *path) {
+  size_t length = strlen(path);
+  if (length > 4 && strcmp(path + length - 4, ".map") == 0) {
+    return tile_map_read_movingai(path);
+  }
+  tile_color colors[] = {{BITMAP_MAGENTA, TILE_INVALID}};
+  return tile_map_read_bitmap(path, colors, 1);
+}
@@ -0,0 +1,402 @@
+#include "struct/tile_generate.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/parallel.h"
+#include "util/random.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Tiles hashed per inner loop, a constant trip count lets the compiler
+/// vectorise the hash even without a known row length.
+#define TILE_GENERATE_LANES 16
+#define TILE_CAVE_WALL_RATIO 0.45
+#define TILE_CAVE_ROUNDS 4
+#define TILE_CAVE_WALLS 5 /// walls among the 9 tiles around that keep a wall
+#define TILE_ROOM_MIN 3
+#define TILE_NAMED_EMPTY_RATIO 0.6
+#define TILE_NAMED_ROOMS 24
+
+typedef struct __tile_noise {
+  uint64_t seed;
+  uint64_t threshold; /// hashes below it are empty, out of 1 << 32
+  size_t cols;
+  tile_t *tiles;
+  uint8_t *walls; /// written instead of `tiles` when not NULL
+} tile_noise;
+
+/// Tile `col` of the row keyed `key`. Chaining two hashes of both key halves
+/// keeps rows from being shifted copies of each other.
+static inline uint32_t tile_noise_hash(uint64_t key, size_t col) {
+  return random_mix32(random_mix32((uint32_t)col + (uint32_t)(key >> 32)) ^
+                      (uint32_t)key);
+}
+
+/// Fills rows [begin, end), inlined into one copy per instruction set.
+static inline __attribute__((always_inline)) void
+tile_noise_fill(const tile_noise *noise, size_t begin, size_t end) {
+  size_t cols = noise->cols;
+  for (size_t r = begin; r < end; r++) {
+    uint64_t key = random_split(noise->seed, r);
+    uint64_t threshold = noise->threshold;
+    size_t c = 0;
+    if (noise->walls) {
+      uint8_t *row = noise->walls + r * cols;
+      for (; c + TILE_GENERATE_LANES <= cols; c += TILE_GENERATE_LANES) {
+        for (size_t i = 0; i < TILE_GENERATE_LANES; i++) {
+          row[c + i] = tile_noise_hash(key, c + i) >= threshold;
+        }
+      }
+      for (; c < cols; c++) {
+        row[c] = tile_noise_hash(key, c) >= threshold;
+      }
+      continue;
+    }
+    tile_t *row = noise->tiles + r * cols;
+    for (; c + TILE_GENERATE_LANES <= cols; c += TILE_GENERATE_LANES) {
+      for (size_t i = 0; i < TILE_GENERATE_LANES; i++) {
+        row[c + i] =
+            tile_noise_hash(key, c + i) < threshold ? TILE_EMPTY : TILE_WALL;
+      }
+    }
+    for (; c < cols; c++) {
+      row[c] = tile_noise_hash(key, c) < threshold ? TILE_EMPTY : TILE_WALL;
+    }
+  }
+}
+
+static void tile_noise_rows(void *context, size_t begin, size_t end) {
+  tile_noise_fill((const tile_noise *)context, begin, end);
+}
+
+__attribute__((target("sse4.1"))) static void
+tile_noise_rows_sse41(void *context, size_t begin, size_t end) {
+  tile_noise_fill((const tile_noise *)context, begin, end);
+}
+
+__attribute__((target("avx2"))) static void
+tile_noise_rows_avx2(void *context, size_t begin, size_t end) {
+  tile_noise_fill((const tile_noise *)context, begin, end);
+}
+
+/// Dispatched by hand rather than with ifunc, which sanitizers do not
+/// support.
+static void tile_noise_run(size_t rows, tile_noise *noise) {
+  __builtin_cpu_init();
+  parallel_task task = tile_noise_rows;
+  if (__builtin_cpu_supports("avx2")) {
+    task = tile_noise_rows_avx2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    task = tile_noise_rows_sse41;
+  }
+  parallel_for(0, rows, task, noise);
+}
+
+static uint64_t tile_noise_threshold(double empty_ratio) {
+  if (!(empty_ratio > 0)) {
+    return 0;
+  }
+  if (empty_ratio >= 1) {
+    return (uint64_t)1 << 32;
+  }
+  return (uint64_t)(empty_ratio * ((uint64_t)1 << 32));
+}
+
+tile_map tile_map_generate(size_t rows, size_t cols, double empty_ratio,
+                           uint64_t seed) {
+  tile_map map = tile_map_new(rows, cols);
+  tile_noise noise = {seed, tile_noise_threshold(empty_ratio), cols,
+                      map->tiles, NULL};
+  tile_noise_run(rows, &noise);
+  return map;
+}
+
+typedef struct __tile_cave {
+  size_t rows;
+  size_t cols;
+  const uint8_t *from; /// 1 for walls
+  uint8_t *to;
+  const uint8_t *border; /// a row of walls standing for rows off the map
+  tile_t *tiles;         /// written by the last pass
+} tile_cave;
+
+/// Applies the rule to one tile, counting tiles off the map as walls.
+static uint8_t tile_cave_cell(const uint8_t *near[3], size_t cols, size_t c) {
+  unsigned walls = 0;
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t cc = c - 1; cc != c + 2; cc++) {
+      walls += cc < cols ? near[i][cc] : 1; // c - 1 wraps around at 0
+    }
+  }
+  return walls >= TILE_CAVE_WALLS;
+}
+
+static void tile_cave_rows(void *context, size_t begin, size_t end) {
+  tile_cave *cave = (tile_cave *)context;
+  size_t cols = cave->cols;
+  for (size_t r = begin; r < end; r++) {
+    const uint8_t *near[3] = {
+        r > 0 ? cave->from + (r - 1) * cols : cave->border,
+        cave->from + r * cols,
+        r + 1 < cave->rows ? cave->from + (r + 1) * cols : cave->border};
+    uint8_t *to = cave->to + r * cols;
+    for (size_t c = 1; c + 1 < cols; c++) {
+      unsigned walls = near[0][c - 1] + near[0][c] + near[0][c + 1] +
+                       near[1][c - 1] + near[1][c] + near[1][c + 1] +
+                       near[2][c - 1] + near[2][c] + near[2][c + 1];
+      to[c] = walls >= TILE_CAVE_WALLS;
+    }
+    to[0] = tile_cave_cell(near, cols, 0);
+    to[cols - 1] = tile_cave_cell(near, cols, cols - 1);
+  }
+}
+
+static void tile_cave_finish(void *context, size_t begin, size_t end) {
+  tile_cave *cave = (tile_cave *)context;
+  for (size_t pos = begin; pos < end; pos++) {
+    cave->tiles[pos] = cave->from[pos] ? TILE_WALL : TILE_EMPTY;
+  }
+}
+
+tile_map tile_map_generate_cave(size_t rows, size_t cols, uint64_t seed) {
+  tile_map map = tile_map_new(rows, cols);
+  if (!rows || !cols) {
+    return map;
+  }
+  uint8_t *buffers[2] = {(uint8_t *)malloc(rows * cols),
+                         (uint8_t *)malloc(rows * cols)};
+  uint8_t *border = (uint8_t *)malloc(cols);
+  memset(border, 1, cols);
+  tile_noise noise = {seed, tile_noise_threshold(1 - TILE_CAVE_WALL_RATIO),
+                      cols, NULL, buffers[0]};
+  tile_noise_run(rows, &noise);
+  tile_cave cave = {rows, cols, NULL, NULL, border, map->tiles};
+  for (size_t round = 0; round < TILE_CAVE_ROUNDS; round++) {
+    cave.from = buffers[round % 2];
+    cave.to = buffers[(round + 1) % 2];
+    parallel_for(0, rows, tile_cave_rows, &cave);
+  }
+  cave.from = buffers[TILE_CAVE_ROUNDS % 2];
+  parallel_for(0, rows * cols, tile_cave_finish, &cave);
+  free(buffers[0]);
+  free(buffers[1]);
+  free(border);
+  return map;
+}
+
+typedef struct __tile_maze {
+  uint64_t seed;
+  size_t rows;
+  size_t cols;
+  tile_t *tiles;
+} tile_maze;
+
+/// Band b holds the wall row 2b and the corridor row 2b + 1. Sidewinder only
+/// opens the corridor row and the wall row above it, so bands are
+/// independent.
+static void tile_maze_bands(void *context, size_t begin, size_t end) {
+  tile_maze *maze = (tile_maze *)context;
+  size_t cols = maze->cols;
+  for (size_t b = begin; b < end; b++) {
+    tile_t *above = maze->tiles + 2 * b * cols;
+    for (size_t c = 0; c < cols; c++) {
+      above[c] = TILE_WALL;
+    }
+    if (2 * b + 1 >= maze->rows) {
+      continue;
+    }
+    tile_t *row = above + cols;
+    for (size_t c = 0; c < cols; c++) {
+      row[c] = c % 2 ? TILE_EMPTY : TILE_WALL;
+    }
+    uint64_t stream = random_split(maze->seed, b);
+    size_t run_start = 1;
+    for (size_t c = 1; c < cols; c += 2) {
+      bool last = c + 2 >= cols;
+      if (b == 0 || (!last && random_at(stream, c) & 1)) {
+        if (!last) {
+          row[c + 1] = TILE_EMPTY; // the run goes on east
+        }
+        continue;
+      }
+      size_t cells = (c - run_start) / 2 + 1;
+      above[run_start + 2 * random_below(stream, c + 1, cells)] = TILE_EMPTY;
+      run_start = c + 2;
+    }
+  }
+}
+
+tile_map tile_map_generate_maze(size_t rows, size_t cols, uint64_t seed) {
+  tile_map map = tile_map_new(rows, cols);
+  tile_maze maze = {seed, rows, cols, map->tiles};
+  parallel_for(0, (rows + 1) / 2, tile_maze_bands, &maze);
+  return map;
+}
+
+static void tile_fill_walls(void *context, size_t begin, size_t end) {
+  tile_t *tiles = (tile_t *)context;
+  for (size_t pos = begin; pos < end; pos++) {
+    tiles[pos] = TILE_WALL;
+  }
+}
+
+static void tile_carve(tile_map map, size_t row, size_t col, size_t height,
+                       size_t width) {
+  for (size_t r = row; r < row + height; r++) {
+    for (size_t c = col; c < col + width; c++) {
+      map->tiles[r * map->cols + c] = TILE_EMPTY;
+    }
+  }
+}
+
+static size_t tile_room_size(uint64_t stream, uint64_t counter, size_t span,
+                             size_t limit) {
+  size_t size = TILE_ROOM_MIN + random_below(stream, counter,
+                                             span - TILE_ROOM_MIN + 1);
+  return size < limit ? size : limit;
+}
+
+tile_map tile_map_generate_rooms(size_t rows, size_t cols, size_t room_count,
+                                 uint64_t seed) {
+  tile_map map = tile_map_new(rows, cols);
+  if (!rows || !cols) {
+    return map;
+  }
+  parallel_for(0, rows * cols, tile_fill_walls, map->tiles);
+  size_t span = (rows < cols ? rows : cols) / 4;
+  span = span > TILE_ROOM_MIN ? span : TILE_ROOM_MIN;
+  size_t last_row = 0, last_col = 0;
+  for (size_t i = 0; i < room_count; i++) {
+    uint64_t stream = random_split(seed, i);
+    size_t height = tile_room_size(stream, 0, span, rows);
+    size_t width = tile_room_size(stream, 1, span, cols);
+    size_t row = random_below(stream, 2, rows - height + 1);
+    size_t col = random_below(stream, 3, cols - width + 1);
+    tile_carve(map, row, col, height, width);
+    size_t center_row = row + height / 2, center_col = col + width / 2;
+    if (i > 0) {
+      // one leg along the row of a room, the other along the column of the
+      // other room, picking which at random
+      bool row_first = random_at(stream, 4) & 1;
+      size_t corner_row = row_first ? last_row : center_row;
+      size_t corner_col = row_first ? center_col : last_col;
+      size_t low, high;
+      low = last_col < center_col ? last_col : center_col;
+      high = last_col < center_col ? center_col : last_col;
+      tile_carve(map, corner_row, low, 1, high - low + 1);
+      low = last_row < center_row ? last_row : center_row;
+      high = last_row < center_row ? center_row : last_row;
+      tile_carve(map, low, corner_col, high - low + 1, 1);
+    }
+    last_row = center_row;
+    last_col = center_col;
+  }
+  return map;
+}
+
+tile_map tile_map_generate_named(const char *name, size_t rows, size_t cols,
+                                 uint64_t seed) {
+  if (strcmp(name, "random") == 0) {
+    return tile_map_generate(rows, cols, TILE_NAMED_EMPTY_RATIO, seed);
+  } else if (strcmp(name, "cave") == 0) {
+    return tile_map_generate_cave(rows, cols, seed);
+  } else if (strcmp(name, "maze") == 0) {
+    return tile_map_generate_maze(rows, cols, seed);
+  } else if (strcmp(name, "rooms") == 0) {
+    return tile_map_generate_rooms(rows, cols, TILE_NAMED_ROOMS, seed);
+  }
+  return NULL;
+}
+
+typedef struct __tile_index_count {
+  const tile_map map;
+  tile_empty_index index;
+} tile_index_count;
+
+static size_t tile_count_empty(const tile_map map, size_t begin, size_t end) {
+  size_t count = 0;
+  if (!map->chunks) {
+    for (size_t pos = begin; pos < end; pos++) {
+      count += map->tiles[pos] == TILE_EMPTY;
+    }
+    return count;
+  }
+  for (size_t pos = begin; pos < end; pos++) {
+    count += tile_map_pos_get(map, pos) == TILE_EMPTY;
+  }
+  return count;
+}
+
+static void tile_index_count_blocks(void *context, size_t begin, size_t end) {
+  tile_index_count *count = (tile_index_count *)context;
+  size_t size = count->map->rows * count->map->cols;
+  for (size_t b = begin; b < end; b++) {
+    size_t last = (b + 1) * TILE_EMPTY_BLOCK;
+    count->index->prefix[b + 1] = tile_count_empty(
+        count->map, b * TILE_EMPTY_BLOCK, last < size ? last : size);
+  }
+}
+
+tile_empty_index tile_empty_index_new(const tile_map map) {
+  size_t size = map->rows * map->cols;
+  size_t blocks = (size + TILE_EMPTY_BLOCK - 1) / TILE_EMPTY_BLOCK;
+  tile_empty_index index = (tile_empty_index)malloc(
+      sizeof(*index) + sizeof(size_t) * (blocks + 1));
+  index->block_count = blocks;
+  index->prefix[0] = 0;
+  tile_index_count count = {map, index};
+  parallel_for(0, blocks, tile_index_count_blocks, &count);
+  for (size_t b = 0; b < blocks; b++) {
+    index->prefix[b + 1] += index->prefix[b];
+  }
+  index->count = index->prefix[blocks];
+  return index;
+}
+
+void tile_empty_index_free(tile_empty_index *index_ptr) {
+  if (index_ptr && *index_ptr) {
+    free(*index_ptr);
+    *index_ptr = NULL;
+  }
+}
+
+point tile_empty_index_get(const tile_empty_index index, const tile_map map,
+                           size_t k) {
+  // last block with fewer than k + 1 empty tiles before it
+  size_t low = 0, high = index->block_count;
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if (index->prefix[middle] <= k) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  size_t rank = index->prefix[low];
+  for (size_t pos = low * TILE_EMPTY_BLOCK;; pos++) {
+    if (tile_map_pos_get(map, pos) == TILE_EMPTY && rank++ == k) {
+      return (point){pos / map->cols, pos % map->cols};
+    }
+  }
+}
+
+point tile_empty_index_sample(const tile_empty_index index,
+                              const tile_map map, uint64_t seed,
+                              uint64_t counter, const point *except) {
+  size_t skip = index->count; // rank of `except`, count when not empty
+  if (except && tile_map_contains(map, *except) &&
+      tile_map_get(map, except->row, except->col) == TILE_EMPTY) {
+    size_t pos = tile_map_pos(map, except->row, except->col);
+    size_t block = pos / TILE_EMPTY_BLOCK;
+    skip = index->prefix[block] +
+           tile_count_empty(map, block * TILE_EMPTY_BLOCK, pos);
+  }
+  size_t choices = index->count - (skip < index->count);
+  if (!choices) {
+    return (point){map->rows, map->cols};
+  }
+  size_t k = random_below(seed, counter, choices);
+  return tile_empty_index_get(index, map, k < skip ? k : k + 1);
+}
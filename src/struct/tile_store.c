@@ -0,0 +1,224 @@
+#include "struct/tile_store.h"
+#include "struct/tile.h"
+#include "util/debug.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct __tile_chunk_struct {
+  size_t refs; /// snapshots sharing the chunk, guarded by the write lock
+  tile_t tiles[TILE_CHUNK_SIZE];
+} *tile_chunk;
+
+struct __tile_snapshot_struct {
+  atomic_size_t pins; /// views currently reading the snapshot
+  tile_snapshot retired_next;
+  tile_store store;
+  size_t version;
+  size_t chunk_count;
+  tile_t *chunks[]; /// tiles of each chunk, handed out to views
+};
+
+struct __tile_store_struct {
+  size_t rows;
+  size_t cols;
+  uint64_t id; /// of every view, see tile_map
+  _Atomic(tile_snapshot) current;
+  atomic_size_t acquiring; /// readers between loading current and pinning it
+  pthread_mutex_t write_lock;
+  size_t version;
+  tile_snapshot draft;   /// staged edits, not yet published
+  tile_snapshot retired; /// replaced versions waiting for their last view
+};
+
+static inline tile_chunk tile_chunk_of(tile_t *tiles) {
+  return (tile_chunk)((char *)tiles - offsetof(struct __tile_chunk_struct,
+                                               tiles));
+}
+
+static tile_snapshot tile_snapshot_new(tile_store store, size_t chunk_count);
+static void tile_snapshot_free(tile_snapshot snapshot);
+static size_t tile_store_sweep(tile_store store);
+
+tile_store tile_store_new(const tile_map map) {
+  tile_store store = (tile_store)malloc(sizeof(*store));
+  size_t size = map->rows * map->cols;
+  size_t chunk_count = (size + TILE_CHUNK_SIZE - 1) >> TILE_CHUNK_BITS;
+  store->rows = map->rows;
+  store->cols = map->cols;
+  store->id = tile_map_new_id();
+  atomic_init(&store->acquiring, 0);
+  pthread_mutex_init(&store->write_lock, NULL);
+  store->version = 0;
+  store->draft = NULL;
+  store->retired = NULL;
+
+  tile_snapshot snapshot = tile_snapshot_new(store, chunk_count);
+  for (size_t i = 0; i < chunk_count; i++) {
+    tile_chunk chunk = (tile_chunk)malloc(sizeof(*chunk));
+    chunk->refs = 1;
+    size_t begin = i << TILE_CHUNK_BITS;
+    size_t length =
+        size - begin < TILE_CHUNK_SIZE ? size - begin : TILE_CHUNK_SIZE;
+    for (size_t offset = 0; offset < length; offset++) {
+      chunk->tiles[offset] = tile_map_pos_get(map, begin + offset);
+    }
+    snapshot->chunks[i] = chunk->tiles;
+  }
+  atomic_init(&store->current, snapshot);
+  return store;
+}
+
+void tile_store_free(tile_store *store_ptr) {
+  if (store_ptr && *store_ptr) {
+    tile_store store = *store_ptr;
+    while (store->retired) {
+      tile_snapshot next = store->retired->retired_next;
+      tile_snapshot_free(store->retired);
+      store->retired = next;
+    }
+    if (store->draft) {
+      tile_snapshot_free(store->draft);
+    }
+    tile_snapshot_free(atomic_load(&store->current));
+    pthread_mutex_destroy(&store->write_lock);
+    free(store);
+    *store_ptr = NULL;
+  }
+}
+
+tile_map tile_store_acquire(tile_store store) {
+  // a writer only frees a retired snapshot while nobody is in this window,
+  // so the snapshot loaded here stays alive until it is pinned
+  atomic_fetch_add(&store->acquiring, 1);
+  tile_snapshot snapshot = atomic_load(&store->current);
+  atomic_fetch_add(&snapshot->pins, 1);
+  atomic_fetch_sub(&store->acquiring, 1);
+
+  tile_map view = (tile_map)malloc(sizeof(*view));
+  view->rows = store->rows;
+  view->cols = store->cols;
+  view->version = snapshot->version;
+  view->id = store->id;
+  view->chunks = snapshot->chunks;
+  view->snapshot = snapshot;
+  return view;
+}
+
+void tile_snapshot_release(tile_snapshot snapshot) {
+  // the snapshot may be freed as soon as it is unpinned
+  tile_store store = snapshot->store;
+  if (atomic_fetch_sub(&snapshot->pins, 1) != 1) {
+    return;
+  }
+  if (pthread_mutex_trylock(&store->write_lock) == 0) {
+    tile_store_sweep(store);
+    pthread_mutex_unlock(&store->write_lock);
+  }
+}
+
+void tile_store_set(tile_store store, size_t row, size_t col, tile_t value) {
+  if (row >= store->rows || col >= store->cols) {
+    return;
+  }
+  size_t pos = store->cols * row + col;
+  pthread_mutex_lock(&store->write_lock);
+  if (!store->draft) {
+    tile_snapshot current = atomic_load(&store->current);
+    store->draft = tile_snapshot_new(store, current->chunk_count);
+    for (size_t i = 0; i < current->chunk_count; i++) {
+      store->draft->chunks[i] = current->chunks[i];
+      tile_chunk_of(current->chunks[i])->refs++;
+    }
+  }
+  tile_t **slot = store->draft->chunks + (pos >> TILE_CHUNK_BITS);
+  tile_chunk chunk = tile_chunk_of(*slot);
+  if (chunk->refs > 1) {
+    debugf("tile_store copy chunk %zu\n", pos >> TILE_CHUNK_BITS);
+    tile_chunk copy = (tile_chunk)malloc(sizeof(*copy));
+    memcpy(copy->tiles, chunk->tiles, sizeof(copy->tiles));
+    copy->refs = 1;
+    chunk->refs--;
+    *slot = copy->tiles;
+  }
+  (*slot)[pos & TILE_CHUNK_MASK] = (unsigned)value % TILE_INVALID;
+  pthread_mutex_unlock(&store->write_lock);
+}
+
+size_t tile_store_publish(tile_store store) {
+  pthread_mutex_lock(&store->write_lock);
+  if (store->draft) {
+    store->draft->version = ++store->version;
+    tile_snapshot old = atomic_exchange(&store->current, store->draft);
+    store->draft = NULL;
+    old->retired_next = store->retired;
+    store->retired = old;
+    tile_store_sweep(store);
+  }
+  size_t version = store->version;
+  pthread_mutex_unlock(&store->write_lock);
+  return version;
+}
+
+size_t tile_store_reclaim(tile_store store) {
+  pthread_mutex_lock(&store->write_lock);
+  size_t pinned = tile_store_sweep(store);
+  pthread_mutex_unlock(&store->write_lock);
+  return pinned;
+}
+
+size_t tile_store_version(tile_store store) {
+  return atomic_load(&store->current)->version;
+}
+
+static tile_snapshot tile_snapshot_new(tile_store store, size_t chunk_count) {
+  tile_snapshot snapshot = (tile_snapshot)malloc(
+      sizeof(*snapshot) + sizeof(tile_t *) * chunk_count);
+  atomic_init(&snapshot->pins, 0);
+  snapshot->retired_next = NULL;
+  snapshot->store = store;
+  snapshot->version = store->version;
+  snapshot->chunk_count = chunk_count;
+  return snapshot;
+}
+
+/// Drops the snapshot's chunk references, the caller holds the write lock.
+static void tile_snapshot_free(tile_snapshot snapshot) {
+  for (size_t i = 0; i < snapshot->chunk_count; i++) {
+    tile_chunk chunk = tile_chunk_of(snapshot->chunks[i]);
+    if (--chunk->refs == 0) {
+      free(chunk);
+    }
+  }
+  free(snapshot);
+}
+
+/// Frees the retired snapshots nobody pins and returns how many are still
+/// pinned, the caller holds the write lock.
+static size_t tile_store_sweep(tile_store store) {
+  if (atomic_load(&store->acquiring) != 0) {
+    // a reader may be about to pin a retired snapshot, retry next time
+    size_t pinned = 0;
+    for (tile_snapshot s = store->retired; s; s = s->retired_next) {
+      pinned++;
+    }
+    return pinned;
+  }
+  size_t pinned = 0;
+  tile_snapshot *link = &store->retired;
+  while (*link) {
+    tile_snapshot snapshot = *link;
+    if (atomic_load(&snapshot->pins) == 0) {
+      *link = snapshot->retired_next;
+      debugf("tile_store reclaim version %zu\n", snapshot->version);
+      tile_snapshot_free(snapshot);
+    } else {
+      link = &snapshot->retired_next;
+      pinned++;
+    }
+  }
+  return pinned;
+}
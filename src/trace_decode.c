@@ -0,0 +1,246 @@
+#include "algorithm/astar.h"
+#include "algorithm/astar_record.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "util/trace.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Turns a trace dump (see util/trace.h) back into text, or replays every
+/// query found in it on the traced map and records it as an animation.
+
+#define DECODE_NAME_SIZE 4096
+
+typedef struct __decode_options {
+  const char *dump;
+  const char *map;
+  const char *animate; /// output prefix, NULL to print text
+  astar_record_format format;
+  size_t interval;
+} decode_options;
+
+typedef struct __decode_replay {
+  const decode_options *options;
+  uint64_t thread;
+  size_t rows; /// from the last map event, 0 when unknown
+  size_t cols;
+  size_t queries;
+  astar_context astar;       /// NULL without a map
+  astar_recorder recorder;   /// query being replayed, or NULL
+} decode_replay;
+
+static void decode_print(const decode_replay *replay, uint64_t index,
+                         const trace_event *event) {
+  printf("%llu %llu %-7s", (unsigned long long)replay->thread,
+         (unsigned long long)index, trace_kind_str((trace_kind)event->kind));
+  switch (event->kind) {
+  case TRACE_MAP:
+    printf(" %llu x %llu\n", (unsigned long long)event->a,
+           (unsigned long long)event->b);
+    return;
+  case TRACE_STATE:
+    printf(" %s iteration %llu at %llu ns\n",
+           astar_state_str((astar_state)event->value),
+           (unsigned long long)event->a, (unsigned long long)event->b);
+    return;
+  default:
+    break;
+  }
+  uint64_t positions[2] = {event->a, event->b};
+  size_t count = event->kind == TRACE_QUERY ? 2 : 1;
+  for (size_t i = 0; i < count; i++) {
+    if (replay->cols) {
+      printf(" (%llu, %llu)", (unsigned long long)(positions[i] / replay->cols),
+             (unsigned long long)(positions[i] % replay->cols));
+    } else {
+      printf(" #%llu", (unsigned long long)positions[i]);
+    }
+  }
+  if (event->kind == TRACE_ENQUEUE || event->kind == TRACE_DEQUEUE) {
+    printf(" open %llu", (unsigned long long)event->b);
+  } else if (event->kind == TRACE_MARK) {
+    printf(" %s paid %.4f", direction_str((direction_t)event->value),
+           trace_bits_double(event->b));
+  }
+  printf("\n");
+}
+
+static void decode_finish_query(decode_replay *replay) {
+  if (replay->recorder) {
+    astar_recorder_flush(replay->recorder, replay->astar);
+    fprintf(stderr, "thread %llu query %zu: %zu frames\n",
+            (unsigned long long)replay->thread, replay->queries - 1,
+            astar_recorder_frames(replay->recorder));
+    astar_recorder_free(&replay->recorder);
+  }
+}
+
+static point decode_point(const decode_replay *replay, uint64_t pos) {
+  return (point){pos / replay->cols, pos % replay->cols};
+}
+
+static void decode_start_query(decode_replay *replay,
+                               const trace_event *event) {
+  decode_finish_query(replay);
+  replay->queries++;
+  tile_map map = replay->astar->map;
+  if (replay->rows != map->rows || replay->cols != map->cols) {
+    fprintf(stderr, "thread %llu query %zu: traced on a %zu x %zu map\n",
+            (unsigned long long)replay->thread, replay->queries - 1,
+            replay->rows, replay->cols);
+    return;
+  }
+  astar_reset(replay->astar, decode_point(replay, event->a),
+              decode_point(replay, event->b));
+  replay->astar->state = ASTAR_RUNNING;
+  char name[DECODE_NAME_SIZE];
+  snprintf(name, sizeof(name), "%st%lluq%zu%s", replay->options->animate,
+           (unsigned long long)replay->thread, replay->queries - 1,
+           replay->options->format == ASTAR_RECORD_RAW ? ".raw" : "_");
+  replay->recorder = astar_recorder_new(replay->astar, name,
+                                        replay->options->format,
+                                        replay->options->interval);
+}
+
+static void decode_replay_event(decode_replay *replay,
+                                const trace_event *event) {
+  if (event->kind == TRACE_MAP) {
+    replay->rows = event->a;
+    replay->cols = event->b;
+    return;
+  }
+  if (event->kind == TRACE_QUERY) {
+    decode_start_query(replay, event);
+    return;
+  }
+  if (!replay->recorder) {
+    return; // the query started before the oldest event kept
+  }
+  astar_context astar = replay->astar;
+  if (event->a >= astar->map->rows * astar->map->cols) {
+    return;
+  }
+  astar_point_state *state = astar->states + event->a;
+  switch (event->kind) {
+  case TRACE_MARK:
+    if (!state->marked) {
+      // astar_reset only clears the states of queued points
+      *astar->queue_end++ = decode_point(replay, event->a);
+    }
+    state->direction = (direction_t)event->value;
+    state->paid_cost = trace_bits_double(event->b);
+    state->marked = true;
+    astar_recorder_touch(replay->recorder, event->a);
+    break;
+  case TRACE_EXPAND:
+    state->visited = true;
+    astar_recorder_touch(replay->recorder, event->a);
+    astar->iteration++;
+    astar_recorder_frame(replay->recorder, astar);
+    break;
+  case TRACE_PATH:
+    state->is_path = true;
+    astar_recorder_touch(replay->recorder, event->a);
+    break;
+  case TRACE_STATE:
+    if (event->value == ASTAR_SUCCEEDED || event->value == ASTAR_FAILED) {
+      astar->state = (astar_state)event->value;
+      decode_finish_query(replay);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static int decode(const decode_options *options) {
+  FILE *file = fopen(options->dump, "rb");
+  if (!file) {
+    fprintf(stderr, "cannot open %s\n", options->dump);
+    return EXIT_FAILURE;
+  }
+  char magic[8];
+  uint32_t header[2];
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+      fread(header, sizeof(header), 1, file) != 1 ||
+      header[0] != TRACE_VERSION || header[1] != sizeof(trace_event)) {
+    fprintf(stderr, "%s is not a version %d trace dump\n", options->dump,
+            TRACE_VERSION);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  astar_context astar = NULL;
+  if (options->animate) {
+    tile_map map = tile_map_read(options->map);
+    if (!map) {
+      fprintf(stderr, "cannot read map %s\n", options->map);
+      fclose(file);
+      return EXIT_FAILURE;
+    }
+    astar = astar_init(map, (point){0, 0}, (point){0, 0});
+  }
+
+  uint64_t info[2];
+  while (fread(info, sizeof(info), 1, file) == 1) {
+    decode_replay replay = {options, info[0], 0, 0, 0, astar, NULL};
+    for (uint64_t i = 0; i < info[1]; i++) {
+      trace_event event;
+      if (fread(&event, sizeof(event), 1, file) != 1) {
+        fprintf(stderr, "%s is truncated\n", options->dump);
+        break;
+      }
+      if (astar) {
+        decode_replay_event(&replay, &event);
+      } else {
+        if (event.kind == TRACE_MAP) {
+          replay.cols = event.b;
+        }
+        decode_print(&replay, i, &event);
+      }
+    }
+    if (astar) {
+      decode_finish_query(&replay);
+    }
+  }
+  fclose(file);
+  astar_free(&astar); // frees the map too
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+  decode_options options = {NULL, NULL, NULL, ASTAR_RECORD_BMP, 1};
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+      options.map = argv[++i];
+    } else if (strcmp(argv[i], "--animate") == 0 && i + 1 < argc) {
+      options.animate = argv[++i];
+    } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+      options.interval = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--raw") == 0) {
+      options.format = ASTAR_RECORD_RAW;
+    } else if (!options.dump && argv[i][0] != '-') {
+      options.dump = argv[i];
+    } else {
+      options.dump = NULL;
+      break;
+    }
+  }
+  if (!options.dump || (options.animate && !options.map)) {
+    fprintf(stderr,
+            "usage: trace_decode DUMP\n"
+            "       trace_decode DUMP --map MAP --animate PREFIX [--raw] "
+            "[--interval N]\n"
+            "MAP is a bitmap written by tile_map_write_bitmap or a MovingAI "
+            ".map file.\n"
+            "Frames of query q of thread t go to PREFIXt<t>q<q>_*.bmp, or to "
+            "PREFIXt<t>q<q>.raw with --raw.\n");
+    return 2;
+  }
+  return decode(&options);
+}
@@ -0,0 +1,82 @@
+#include "util/parallel.h"
+#include "struct/bool.h"
+#include "util/debug.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PARALLEL_MAX_THREADS 256
+
+/// 0 until detected or set, threads detecting at once store the same count
+static atomic_size_t parallel_thread_count = 0;
+
+typedef struct __parallel_range {
+  parallel_task task;
+  void *context;
+  size_t begin;
+  size_t end;
+} parallel_range;
+
+static void *parallel_run(void *arg) {
+  parallel_range *range = (parallel_range *)arg;
+  range->task(range->context, range->begin, range->end);
+  return NULL;
+}
+
+/// At most PARALLEL_MAX_THREADS, the size of the arrays of parallel_for.
+static size_t parallel_cap(size_t threads) {
+  return threads > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : threads;
+}
+
+size_t parallel_threads() {
+  size_t threads = atomic_load(&parallel_thread_count);
+  if (!threads) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = parallel_cap(online > 0 ? (size_t)online : 1);
+    atomic_store(&parallel_thread_count, threads);
+  }
+  return threads;
+}
+
+void parallel_set_threads(size_t threads) {
+  atomic_store(&parallel_thread_count, parallel_cap(threads));
+}
+
+void parallel_for(size_t begin, size_t end, parallel_task task, void *context) {
+  size_t length = end > begin ? end - begin : 0;
+  size_t threads = parallel_threads();
+  if (threads > length) {
+    threads = length;
+  }
+  if (threads <= 1) {
+    task(context, begin, end);
+    return;
+  }
+
+  pthread_t ids[PARALLEL_MAX_THREADS];
+  parallel_range ranges[PARALLEL_MAX_THREADS];
+  for (size_t i = 0; i < threads; i++) {
+    ranges[i].task = task;
+    ranges[i].context = context;
+    ranges[i].begin = begin + length * i / threads;
+    ranges[i].end = begin + length * (i + 1) / threads;
+  }
+  size_t started = 1;
+  while (started < threads &&
+         !pthread_create(ids + started, NULL, parallel_run, ranges + started)) {
+    started++;
+  }
+  if (started < threads) {
+    debugf("parallel_for started %zu of %zu threads\n", started, threads);
+  }
+  // ranges that could not get their own thread run here
+  parallel_run(ranges);
+  for (size_t i = started; i < threads; i++) {
+    parallel_run(ranges + i);
+  }
+  for (size_t i = 1; i < started; i++) {
+    pthread_join(ids[i], NULL);
+  }
+}
@@ -0,0 +1,164 @@
+#include "util/trace.h"
+#include "struct/bool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_PATH_SIZE 4096
+
+typedef struct __trace_ring {
+  struct __trace_ring *next; /// registry of every ring, never unlinked
+  atomic_bool owned;         /// held by a live thread
+  _Atomic uint64_t thread;
+  _Atomic uint64_t head; /// events written since the ring was taken
+  trace_event events[TRACE_RING_SIZE];
+} trace_ring;
+
+atomic_bool trace_enabled = false;
+
+static _Atomic(trace_ring *) trace_rings = NULL;
+static atomic_uint_fast64_t trace_threads = 0;
+static _Thread_local trace_ring *trace_local = NULL;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_failure_lock = PTHREAD_MUTEX_INITIALIZER;
+static char trace_failure_path[TRACE_PATH_SIZE];
+
+char *trace_kind_str(trace_kind kind) {
+  static char *strs[TRACE_KIND_LENGTH] = {"none",    "map",     "query",
+                                          "state",   "enqueue", "dequeue",
+                                          "expand",  "mark",    "path"};
+  return strs[kind % TRACE_KIND_LENGTH];
+}
+
+void trace_enable(bool enabled) {
+  atomic_store_explicit(&trace_enabled, enabled, memory_order_relaxed);
+}
+
+static void trace_release(void *ring) {
+  atomic_store_explicit(&((trace_ring *)ring)->owned, false,
+                        memory_order_release);
+}
+
+static void trace_key_init() { pthread_key_create(&trace_key, trace_release); }
+
+/// Takes over the ring of an exited thread, or registers a new one.
+static trace_ring *trace_attach() {
+  pthread_once(&trace_key_once, trace_key_init);
+  trace_ring *ring = atomic_load_explicit(&trace_rings, memory_order_acquire);
+  for (; ring; ring = ring->next) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&ring->owned, &expected, true)) {
+      break;
+    }
+  }
+  if (!ring) {
+    ring = (trace_ring *)malloc(sizeof(*ring));
+    atomic_init(&ring->owned, true);
+    ring->next = atomic_load_explicit(&trace_rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&trace_rings, &ring->next,
+                                                  ring, memory_order_release,
+                                                  memory_order_relaxed)) {
+    }
+  }
+  ring->thread = atomic_fetch_add(&trace_threads, 1);
+  atomic_store_explicit(&ring->head, 0, memory_order_release);
+  pthread_setspecific(trace_key, ring);
+  trace_local = ring;
+  return ring;
+}
+
+void trace_write(trace_kind kind, uint32_t value, uint64_t a, uint64_t b) {
+  trace_ring *ring = trace_local ? trace_local : trace_attach();
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  trace_event *event = ring->events + (head & (TRACE_RING_SIZE - 1));
+  // relaxed stores are plain moves, and keep a concurrent dump well-defined
+  __atomic_store_n(&event->kind, kind, __ATOMIC_RELAXED);
+  __atomic_store_n(&event->value, value, __ATOMIC_RELAXED);
+  __atomic_store_n(&event->a, a, __ATOMIC_RELAXED);
+  __atomic_store_n(&event->b, b, __ATOMIC_RELAXED);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+uint64_t trace_double_bits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double trace_bits_double(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint64_t trace_clock_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool trace_dump(const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  uint32_t header[2] = {TRACE_VERSION, sizeof(trace_event)};
+  bool ok = fwrite(TRACE_MAGIC, 1, 8, file) == 8 &&
+            fwrite(header, sizeof(header), 1, file) == 1;
+  trace_event *events = (trace_event *)malloc(sizeof(trace_event) *
+                                              TRACE_RING_SIZE);
+  trace_ring *ring = atomic_load_explicit(&trace_rings, memory_order_acquire);
+  for (; ring && ok; ring = ring->next) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+    for (uint64_t i = 0; i < count; i++) {
+      trace_event *event =
+          ring->events + ((head - count + i) & (TRACE_RING_SIZE - 1));
+      events[i].kind = __atomic_load_n(&event->kind, __ATOMIC_RELAXED);
+      events[i].value = __atomic_load_n(&event->value, __ATOMIC_RELAXED);
+      events[i].a = __atomic_load_n(&event->a, __ATOMIC_RELAXED);
+      events[i].b = __atomic_load_n(&event->b, __ATOMIC_RELAXED);
+    }
+    // the writer may have reused slots meanwhile: writing index `later`
+    // overwrites event `later - size`, so drop every event from there back;
+    // the calling thread cannot be writing its own ring
+    uint64_t later = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (ring != trace_local) {
+      later++;
+    }
+    uint64_t safe = later > TRACE_RING_SIZE ? later - TRACE_RING_SIZE : 0;
+    uint64_t first = head - count;
+    uint64_t skip = safe > first ? safe - first : 0;
+    skip = skip < count ? skip : count;
+    uint64_t info[2] = {ring->thread, count - skip};
+    ok = fwrite(info, sizeof(info), 1, file) == 1 &&
+         fwrite(events + skip, sizeof(trace_event), count - skip, file) ==
+             count - skip;
+  }
+  free(events);
+  return fclose(file) == 0 && ok;
+}
+
+void trace_set_failure_path(const char *path) {
+  pthread_mutex_lock(&trace_failure_lock);
+  snprintf(trace_failure_path, sizeof(trace_failure_path), "%s",
+           path ? path : "");
+  pthread_mutex_unlock(&trace_failure_lock);
+}
+
+void trace_fail() {
+  if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+    return;
+  }
+  pthread_mutex_lock(&trace_failure_lock);
+  if (trace_failure_path[0]) {
+    trace_dump(trace_failure_path);
+  }
+  pthread_mutex_unlock(&trace_failure_lock);
+}
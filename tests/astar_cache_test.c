@@ -0,0 +1,181 @@
+#include "algorithm/astar.h"
+#include "algorithm/astar_cache.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// A context that answered from the cache and was reset must search like a
+/// fresh one: the states a hit wrote are cleared by astar_reset too. Suffix
+/// hits are only served from optimal searches and then cost what an optimal
+/// search finds, and entries never match another map, even one at the same
+/// address.
+
+#define TEST_ROWS 96
+#define TEST_COLS 96
+#define TEST_QUERIES 64
+
+static bool test_same_search(const astar_context astar,
+                             const astar_context fresh) {
+  if (astar->state != fresh->state || astar->iteration != fresh->iteration ||
+      astar->path_length != fresh->path_length ||
+      astar->path_cost != fresh->path_cost) {
+    return false;
+  }
+  size_t size = fresh->map->rows * fresh->map->cols;
+  for (size_t pos = 0; pos < size; pos++) {
+    const astar_point_state *a = astar->states + pos;
+    const astar_point_state *b = fresh->states + pos;
+    if (a->marked != b->marked || a->visited != b->visited ||
+        a->is_path != b->is_path) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Queries from the middle of cached paths at `factor`, cached from
+/// astar_resolve_parallel when `optimal`, else from astar_resolve. Returns
+/// failures.
+static size_t test_suffixes(tile_map map, tile_empty_index index,
+                            double factor, bool optimal) {
+  astar_cache cache = astar_cache_new(1 << 16);
+  astar_context astar = astar_init(map, (point){0, 0}, (point){0, 0});
+  astar_set_owns_map(astar, false);
+  astar_set_estimate_cost_factor(astar, factor);
+  astar_context fresh = astar_init(map, (point){0, 0}, (point){0, 0});
+  astar_set_owns_map(fresh, false);
+  astar_set_estimate_cost_factor(fresh, factor);
+  point *path = (point *)malloc(sizeof(point) * map->rows * map->cols);
+  size_t failures = 0, suffixes = 0;
+  for (size_t q = 0; q < TEST_QUERIES; q++) {
+    point start = tile_empty_index_sample(index, map, 5, 2 * q, NULL);
+    point end = tile_empty_index_sample(index, map, 5, 2 * q + 1, &start);
+    astar_reset(astar, start, end);
+    if (optimal) {
+      astar_resolve_parallel(astar, 1, NULL);
+      astar_cache_store(cache, astar);
+    } else {
+      astar_cache_resolve(cache, astar);
+    }
+    if (astar->state != ASTAR_SUCCEEDED || astar->path_length < 3) {
+      continue;
+    }
+    astar_path_points(astar, path, astar->path_length);
+    point middle = path[astar->path_length / 2];
+    astar_reset(astar, middle, end);
+    astar_cache_resolve(cache, astar);
+    astar_reset(fresh, middle, end);
+    if (optimal) {
+      astar_resolve_parallel(fresh, 1, NULL);
+    } else {
+      astar_resolve(fresh);
+    }
+    suffixes++;
+    aster_cost_t difference = astar->path_cost - fresh->path_cost;
+    if (astar->state != fresh->state || astar->optimal != optimal ||
+        difference > 1e-6 || difference < -1e-6) {
+      fprintf(stderr,
+              "%s factor %.4f query %zu: suffix cost %.4f, search %.4f\n",
+              optimal ? "optimal" : "weighted", factor, q,
+              (double)astar->path_cost, (double)fresh->path_cost);
+      failures++;
+    }
+  }
+  // the middle of a path of astar_resolve is never a cached start
+  astar_cache_stats stats = astar_cache_get_stats(cache);
+  if (stats.suffix_hits != (optimal ? suffixes : 0)) {
+    fprintf(stderr, "%s factor %.4f: %zu suffix hits of %zu\n",
+            optimal ? "optimal" : "weighted", factor, stats.suffix_hits,
+            suffixes);
+    failures++;
+  }
+  free(path);
+  astar_free(&fresh);
+  astar_free(&astar);
+  astar_cache_free(&cache);
+  return failures;
+}
+
+/// A map freed and replaced by another of the same shape and version.
+static size_t test_new_map(astar_cache cache) {
+  tile_map map = tile_map_new(8, 8);
+  for (size_t r = 0; r < 8; r++) {
+    tile_map_set(map, r, 4, TILE_EMPTY);
+  }
+  astar_context astar = astar_init(map, (point){0, 0}, (point){7, 7});
+  astar_cache_resolve(cache, astar);
+  astar_free(&astar);
+  map = tile_map_new(8, 8);
+  for (size_t r = 0; r < 8; r++) {
+    tile_map_set(map, r, 4, TILE_WALL);
+  }
+  astar = astar_init(map, (point){0, 0}, (point){7, 7});
+  astar_cache_resolve(cache, astar);
+  size_t failures = astar->state != ASTAR_FAILED;
+  if (failures) {
+    fprintf(stderr, "a new map was answered from the old one\n");
+  }
+  astar_free(&astar);
+  return failures;
+}
+
+int main() {
+  tile_map map = tile_map_generate_cave(TEST_ROWS, TEST_COLS, 7);
+  tile_empty_index index = tile_empty_index_new(map);
+  astar_cache cache = astar_cache_new(1 << 16);
+  astar_context astar = astar_init(map, (point){0, 0}, (point){0, 0});
+  size_t failures = 0;
+  for (size_t q = 0; q < TEST_QUERIES; q++) {
+    point start = tile_empty_index_sample(index, map, 3, 4 * q, NULL);
+    point end = tile_empty_index_sample(index, map, 3, 4 * q + 1, &start);
+    astar_reset(astar, start, end);
+    astar_cache_resolve(cache, astar); // a miss, stored
+    astar_reset(astar, start, end);
+    size_t hits = astar_cache_get_stats(cache).hits;
+    astar_cache_resolve(cache, astar);
+    if (astar_cache_get_stats(cache).hits != hits + 1) {
+      fprintf(stderr, "query %zu: no cache hit\n", q);
+      failures++;
+    }
+
+    point next_start = tile_empty_index_sample(index, map, 3, 4 * q + 2, NULL);
+    point next_end =
+        tile_empty_index_sample(index, map, 3, 4 * q + 3, &next_start);
+    astar_reset(astar, next_start, next_end);
+    astar_resolve(astar);
+    astar_context fresh = astar_init(map, next_start, next_end);
+    astar_set_owns_map(fresh, false);
+    astar_resolve(fresh);
+    if (!test_same_search(astar, fresh)) {
+      fprintf(stderr, "query %zu: search after a hit differs\n", q);
+      failures++;
+    }
+    astar_free(&fresh);
+  }
+  static const char *kinds[] = {"random", "cave", "rooms", "maze"};
+  for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    tile_map kind_map =
+        tile_map_generate_named(kinds[k], TEST_ROWS, TEST_COLS, 11);
+    tile_empty_index kind_index = tile_empty_index_new(kind_map);
+    failures += test_suffixes(kind_map, kind_index, 1, true);
+    failures += test_suffixes(kind_map, kind_index, 1.4142, true);
+    failures += test_suffixes(kind_map, kind_index, 1, false);
+    failures += test_suffixes(kind_map, kind_index, 1.4142, false);
+    tile_empty_index_free(&kind_index);
+    tile_map_free(&kind_map);
+  }
+  failures += test_new_map(cache);
+  astar_free(&astar); // frees the map too
+  astar_cache_free(&cache);
+  tile_empty_index_free(&index);
+  if (failures) {
+    fprintf(stderr, "%zu failures\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("%d queries ok\n", TEST_QUERIES);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include "algorithm/astar.h"
+#include "struct/bool.h"
+#include "struct/point.h"
+#include "struct/tile.h"
+#include "struct/tile_generate.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// astar_resolve_parallel must find optimal paths: its costs at 1, 2 and 4
+/// threads are compared with a plain Dijkstra on several kinds of maps, and
+/// its paths are walked to check that they are connected and cost as much
+/// as reported.
+
+#define TEST_ROWS 96
+#define TEST_COLS 96
+#define TEST_QUERIES 24
+#define TEST_UNREACHABLE 1e30
+#define TEST_EPSILON 1e-6
+
+typedef struct __test_heap_item {
+  aster_cost_t distance;
+  size_t pos;
+} test_heap_item;
+
+typedef struct __test_dijkstra {
+  aster_cost_t *distances;
+  test_heap_item *heap; /// may hold a position several times
+  size_t heap_count;
+} test_dijkstra;
+
+static void test_heap_push(test_dijkstra *dijkstra, test_heap_item item) {
+  size_t i = dijkstra->heap_count++;
+  while (i && dijkstra->heap[(i - 1) / 2].distance > item.distance) {
+    dijkstra->heap[i] = dijkstra->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  dijkstra->heap[i] = item;
+}
+
+static test_heap_item test_heap_pop(test_dijkstra *dijkstra) {
+  test_heap_item top = dijkstra->heap[0];
+  test_heap_item last = dijkstra->heap[--dijkstra->heap_count];
+  size_t i = 0;
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= dijkstra->heap_count) {
+      break;
+    }
+    if (child + 1 < dijkstra->heap_count &&
+        dijkstra->heap[child + 1].distance < dijkstra->heap[child].distance) {
+      child++;
+    }
+    if (dijkstra->heap[child].distance >= last.distance) {
+      break;
+    }
+    dijkstra->heap[i] = dijkstra->heap[child];
+    i = child;
+  }
+  dijkstra->heap[i] = last;
+  return top;
+}
+
+/// Distance from `start` to `end`, TEST_UNREACHABLE without a path.
+static aster_cost_t test_dijkstra_distance(test_dijkstra *dijkstra,
+                                           const tile_map map, point start,
+                                           point end) {
+  size_t size = map->rows * map->cols;
+  for (size_t pos = 0; pos < size; pos++) {
+    dijkstra->distances[pos] = TEST_UNREACHABLE;
+  }
+  size_t start_pos = tile_map_pos(map, start.row, start.col);
+  size_t end_pos = tile_map_pos(map, end.row, end.col);
+  dijkstra->distances[start_pos] = 0;
+  dijkstra->heap_count = 0;
+  test_heap_push(dijkstra, (test_heap_item){0, start_pos});
+  while (dijkstra->heap_count) {
+    test_heap_item item = test_heap_pop(dijkstra);
+    if (item.distance > dijkstra->distances[item.pos]) {
+      continue; // reached again more cheaply since it was pushed
+    }
+    if (item.pos == end_pos) {
+      break;
+    }
+    point pt = {item.pos / map->cols, item.pos % map->cols};
+    for (direction_t d = 0; d < 9; d++) {
+      if (d == DIRECTION_NONE) {
+        continue;
+      }
+      point next = point_move(pt, d);
+      if (!tile_map_contains(map, next) ||
+          tile_map_get(map, next.row, next.col) != TILE_EMPTY) {
+        continue;
+      }
+      size_t next_pos = tile_map_pos(map, next.row, next.col);
+      aster_cost_t distance = item.distance + direction_cost(d);
+      if (distance < dijkstra->distances[next_pos] - TEST_EPSILON) {
+        dijkstra->distances[next_pos] = distance;
+        test_heap_push(dijkstra, (test_heap_item){distance, next_pos});
+      }
+    }
+  }
+  return dijkstra->distances[end_pos];
+}
+
+/// Whether the path of `astar` goes from start to end over empty tiles and
+/// costs path_cost.
+static bool test_valid_path(const astar_context astar, point *buffer,
+                            size_t capacity) {
+  size_t length = astar_path_points(astar, buffer, capacity);
+  if (!length || length > capacity || length != astar->path_length ||
+      !point_equal(buffer[0], astar->start_point) ||
+      !point_equal(buffer[length - 1], astar->end_point)) {
+    return false;
+  }
+  aster_cost_t cost = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (tile_map_get(astar->map, buffer[i].row, buffer[i].col) != TILE_EMPTY) {
+      return false;
+    }
+    if (i) {
+      direction_t d = point_move_direction(buffer[i - 1], buffer[i]);
+      if (d == DIRECTION_NONE ||
+          !point_equal(point_move(buffer[i - 1], d), buffer[i])) {
+        return false;
+      }
+      cost += direction_cost(d);
+    }
+  }
+  aster_cost_t difference = cost - astar->path_cost;
+  return difference < TEST_EPSILON && difference > -TEST_EPSILON;
+}
+
+int main() {
+  static const char *kinds[] = {"random", "cave", "rooms", "maze"};
+  static const size_t threads[] = {1, 2, 4};
+  size_t size = TEST_ROWS * TEST_COLS;
+  test_dijkstra dijkstra = {
+      .distances = (aster_cost_t *)malloc(sizeof(aster_cost_t) * size),
+      .heap = (test_heap_item *)malloc(sizeof(test_heap_item) * size * 8),
+      .heap_count = 0,
+  };
+  point *path = (point *)malloc(sizeof(point) * size);
+  size_t failures = 0, checked = 0;
+  for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    tile_map map =
+        tile_map_generate_named(kinds[k], TEST_ROWS, TEST_COLS, 11);
+    tile_empty_index index = tile_empty_index_new(map);
+    astar_context astar = astar_init(map, (point){0, 0}, (point){0, 0});
+    for (size_t q = 0; q < TEST_QUERIES; q++) {
+      point start = tile_empty_index_sample(index, map, 5, 2 * q, NULL);
+      point end = tile_empty_index_sample(index, map, 5, 2 * q + 1, &start);
+      aster_cost_t expected =
+          test_dijkstra_distance(&dijkstra, map, start, end);
+      for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        astar_reset(astar, start, end);
+        astar_state state = astar_resolve_parallel(astar, threads[t], NULL);
+        bool ok;
+        if (expected >= TEST_UNREACHABLE) {
+          ok = state == ASTAR_FAILED;
+        } else {
+          aster_cost_t difference = astar->path_cost - expected;
+          ok = state == ASTAR_SUCCEEDED && difference < TEST_EPSILON &&
+               difference > -TEST_EPSILON &&
+               test_valid_path(astar, path, size);
+        }
+        if (!ok) {
+          fprintf(stderr,
+                  "%s query %zu on %zu threads: %s cost %.4f, "
+                  "dijkstra %.4f\n",
+                  kinds[k], q, threads[t], astar_state_str(state),
+                  (double)astar->path_cost, (double)expected);
+          failures++;
+        }
+        checked++;
+      }
+    }
+    astar_free(&astar); // frees the map too
+    tile_empty_index_free(&index);
+  }
+  free(path);
+  free(dijkstra.heap);
+  free(dijkstra.distances);
+  if (failures) {
+    fprintf(stderr, "%zu of %zu searches failed\n", failures, checked);
+    return EXIT_FAILURE;
+  }
+  printf("%zu searches ok\n", checked);
+  return EXIT_SUCCESS;
+}